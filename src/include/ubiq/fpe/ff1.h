@@ -8,15 +8,19 @@
 __BEGIN_DECLS
 
 struct ff1_ctx;
+struct ff1_tweak;
+struct fpe_pool;
 
 /*
  * Create a context instance for use with the FF1 algorithm
  *
  * The created instance can be used for encryption or decryption
- * or both. The instance is not thread-safe, though. For example,
- * multiple instances can be created and used in different, individual
- * threads. However, a single instance cannot be used for simultaneous
- * encryptions/decryptions in multiple threads.
+ * or both. The instance is thread-safe: once created, a single
+ * instance may be used for simultaneous encryptions/decryptions in
+ * any number of threads. The key schedule and alphabet are shared
+ * and never modified; each operation borrows its scratch space from
+ * a pool kept by the instance, which grows to the number of
+ * operations that have been in progress at once.
  *
  * @ctx: Pointer to location to store pointer to context data
  *       Caller supplies the address to a pointer. This function
@@ -28,7 +32,11 @@ struct ff1_ctx;
  * @mintwklen: The minimum number of bytes allowed for the tweak data
  * @maxtwklen: The maximum number of bytes allowed for the tweak data
  *             This number may be 0 to indicate that the maximum is unlimited
- * @radix: The radix of the plain/cipher text data
+ * @radix: The radix of the plain/cipher text data, from 2 to 65536.
+ *         Strings passed to ff1_encrypt() and ff1_decrypt() use the
+ *         standard character set for the radix, which only exists for
+ *         a radix up to 255. Texts in a larger radix must be passed as
+ *         numerals; see ff1_encrypt_numerals()
  *
  * @return 0 on success or a negative error number on failure
  */
@@ -95,6 +103,283 @@ int ff1_decrypt(struct ff1_ctx * const ctx,
                 const char * const X,
                 const uint8_t * const T, const size_t t);
 
+/*
+ * Encrypt data of a given length using the FF1 algorithm
+ *
+ * This function is identical to ff1_encrypt() except that the plain
+ * text need not be nul-terminated, so it can be read directly from a
+ * larger buffer, and the cipher text is written without a terminator.
+ *
+ * @Y: A pointer to the location to output the cipher text
+ * @ylen: On input, the number of bytes available at @Y. On output,
+ *        the number of bytes written. For alphabets of single-byte
+ *        characters, this is the same as @xlen. For those containing
+ *        multibyte characters, it may differ. ff1_output_len() returns
+ *        a size that is always sufficient. If @Y is too small, -ENOSPC
+ *        is returned
+ * @X: A pointer to the plain text
+ * @xlen: The number of bytes in the plain text
+ */
+int ff1_encrypt_len(struct ff1_ctx * const ctx,
+                    char * const Y, size_t * const ylen,
+                    const char * const X, const size_t xlen,
+                    const uint8_t * const T, const size_t t);
+/*
+ * Decrypt data of a given length using the FF1 algorithm
+ *
+ * This function is identical to ff1_decrypt() except that the texts
+ * are passed as described for ff1_encrypt_len()
+ */
+int ff1_decrypt_len(struct ff1_ctx * const ctx,
+                    char * const Y, size_t * const ylen,
+                    const char * const X, const size_t xlen,
+                    const uint8_t * const T, const size_t t);
+
+/*
+ * Return the number of bytes of output space that is sufficient
+ * for the encryption or decryption of any text of @xlen bytes, not
+ * including a nul-terminator
+ *
+ * @ctx: The pointer returned by the create function
+ * @xlen: The number of bytes in the input text
+ */
+size_t ff1_output_len(const struct ff1_ctx * const ctx, const size_t xlen);
+
+/*
+ * Prepare a tweak for repeated use with the FF1 algorithm
+ *
+ * Much of the work done by the algorithm depends only on the tweak
+ * and the length of the input. A prepared tweak caches that work,
+ * per input length, so that encryptions and decryptions using the
+ * prepared tweak don't have to repeat it. This is worthwhile when
+ * the same tweak is used for many inputs.
+ *
+ * The prepared tweak may only be used with the context for which
+ * it was prepared and must be destroyed before that context is.
+ * Unlike the context, the prepared tweak is not thread-safe; each
+ * thread using a shared context should prepare its own.
+ *
+ * @ctx: The pointer returned by the create function
+ * @T: A pointer to the tweak. If NULL, the tweak supplied to the
+ *     create function is prepared
+ * @t: The number of bytes pointed to by @T. If T is NULL, t is a
+ *     don't-care
+ * @twk: Pointer to location to store pointer to the prepared tweak
+ *
+ * @return 0 on success or a negative error number on failure
+ */
+int ff1_tweak_prepare(struct ff1_ctx * const ctx,
+                      const uint8_t * T, size_t t,
+                      struct ff1_tweak ** const twk);
+
+/*
+ * Encrypt data using the FF1 algorithm and a prepared tweak
+ *
+ * This function is identical to ff1_encrypt() except that the
+ * tweak is supplied by a pointer returned by ff1_tweak_prepare()
+ */
+int ff1_encrypt_prepared(struct ff1_ctx * const ctx,
+                         char * const Y,
+                         const char * const X,
+                         struct ff1_tweak * const twk);
+/*
+ * Decrypt data using the FF1 algorithm and a prepared tweak
+ *
+ * This function is identical to ff1_decrypt() except that the
+ * tweak is supplied by a pointer returned by ff1_tweak_prepare()
+ */
+int ff1_decrypt_prepared(struct ff1_ctx * const ctx,
+                         char * const Y,
+                         const char * const X,
+                         struct ff1_tweak * const twk);
+
+/*
+ * Encrypt data represented as numerals using the FF1 algorithm
+ *
+ * This function is identical to ff1_encrypt() except that the plain
+ * and cipher texts are arrays of numerals, i.e. the values of the
+ * digits, each of which must be less than the radix. No alphabet is
+ * involved, so this works for any radix supported by the context, and
+ * a numeral of 0 is as valid as any other. A context created with a
+ * custom alphabet treats the numerals as positions in that alphabet.
+ *
+ * @Y: A pointer to the location to output the @n numerals of the
+ *     cipher text. @Y may be the same as @X
+ * @X: A pointer to the @n numerals of the plain text
+ * @n: The number of numerals in the text
+ */
+int ff1_encrypt_numerals(struct ff1_ctx * const ctx,
+                         uint16_t * const Y,
+                         const uint16_t * const X, const size_t n,
+                         const uint8_t * const T, const size_t t);
+/*
+ * Decrypt data represented as numerals using the FF1 algorithm
+ *
+ * This function is identical to ff1_decrypt() except that the texts
+ * are arrays of numerals, as described for ff1_encrypt_numerals()
+ */
+int ff1_decrypt_numerals(struct ff1_ctx * const ctx,
+                         uint16_t * const Y,
+                         const uint16_t * const X, const size_t n,
+                         const uint8_t * const T, const size_t t);
+
+/*
+ * Encrypt a batch of records using the FF1 algorithm
+ *
+ * Each record is encrypted exactly as by ff1_encrypt(), but the work
+ * that doesn't depend on the individual records is done once for the
+ * whole batch. In particular, the default tweak is prepared (see
+ * ff1_tweak_prepare()) once and used for every record that doesn't
+ * supply its own. Those records are grouped by length, and short
+ * records of the same length are encrypted several at a time,
+ * wherever they are in the batch. The records are read and written
+ * in place, and the results are the same as when they are encrypted
+ * one at a time. A record that fails doesn't stop the others from
+ * being processed.
+ *
+ * @ctx: The pointer returned by the create function
+ * @Y: An array of @cnt pointers to the locations to output the cipher
+ *     texts. Each must have space for the cipher text of the
+ *     corresponding record and a nul-terminator.
+ * @X: An array of @cnt pointers to the plain texts
+ * @Xlen: An array of @cnt lengths, in bytes, of the plain texts, which
+ *        need not be nul-terminated. If NULL, the plain texts must be
+ *        nul-terminated
+ * @T: An array of @cnt pointers to the tweaks. Either the array or any
+ *     of its elements may be NULL, in which case the tweak supplied to
+ *     the create function is used for the affected records
+ * @Tlen: An array of @cnt lengths of the tweaks. It is required when
+ *        @T is not NULL
+ * @cnt: The number of records
+ * @status: An array of @cnt results, one for each record: 0 on success
+ *          or a negative error number. May be NULL
+ *
+ * @return 0 if every record succeeded or the error for the first
+ *         record that failed
+ */
+int ff1_encrypt_batch(struct ff1_ctx * const ctx,
+                      char * const * const Y,
+                      const char * const * const X,
+                      const size_t * const Xlen,
+                      const uint8_t * const * const T,
+                      const size_t * const Tlen,
+                      const size_t cnt,
+                      int * const status);
+/*
+ * Decrypt a batch of records using the FF1 algorithm
+ *
+ * This function is identical to ff1_encrypt_batch() except that
+ * @X contains the cipher texts and @Y receives the plain texts
+ */
+int ff1_decrypt_batch(struct ff1_ctx * const ctx,
+                      char * const * const Y,
+                      const char * const * const X,
+                      const size_t * const Xlen,
+                      const uint8_t * const * const T,
+                      const size_t * const Tlen,
+                      const size_t cnt,
+                      int * const status);
+
+/*
+ * Encrypt a batch of records using the FF1 algorithm and the
+ * threads of a pool
+ *
+ * This function is identical to ff1_encrypt_batch() except that the
+ * records are divided among the workers of @pool (see pool.h), and
+ * the function returns once all of them have been processed. Each
+ * worker prepares the default tweak for itself. If @pool is NULL,
+ * the records are processed by the calling thread.
+ */
+int ff1_encrypt_batch_mt(struct ff1_ctx * const ctx,
+                         struct fpe_pool * const pool,
+                         char * const * const Y,
+                         const char * const * const X,
+                         const size_t * const Xlen,
+                         const uint8_t * const * const T,
+                         const size_t * const Tlen,
+                         const size_t cnt,
+                         int * const status);
+/*
+ * Decrypt a batch of records using the FF1 algorithm and the
+ * threads of a pool
+ *
+ * This function is identical to ff1_encrypt_batch_mt() except that
+ * @X contains the cipher texts and @Y receives the plain texts
+ */
+int ff1_decrypt_batch_mt(struct ff1_ctx * const ctx,
+                         struct fpe_pool * const pool,
+                         char * const * const Y,
+                         const char * const * const X,
+                         const size_t * const Xlen,
+                         const uint8_t * const * const T,
+                         const size_t * const Tlen,
+                         const size_t cnt,
+                         int * const status);
+
+/*
+ * Encrypt a column of fixed-width fields using the FF1 algorithm
+ *
+ * The fields are @width bytes each and are found every @xstride
+ * bytes, starting at @X. For example, values packed back to back
+ * have a stride equal to their width, while a field at a fixed
+ * offset within fixed-length records has a stride equal to the
+ * record length. The fields are not nul-terminated, and the cipher
+ * texts are written, also without terminators, to the corresponding
+ * fields of the output column. The output may be the input itself.
+ *
+ * Because every field has the same length, all of the work that
+ * depends only on the tweak and the length is done once for the
+ * column. The same tweak is used for every field. A field that fails
+ * doesn't stop the others from being processed, and its output is
+ * left untouched.
+ *
+ * Only contexts whose alphabets consist of single-byte characters
+ * are supported, since the input and output must be the same size.
+ *
+ * @ctx: The pointer returned by the create function
+ * @Y: A pointer to the first field of the output column
+ * @ystride: The number of bytes between fields in the output column
+ * @X: A pointer to the first field of the input column
+ * @xstride: The number of bytes between fields in the input column
+ * @width: The number of bytes in each field
+ * @cnt: The number of fields
+ * @T: A pointer to the tweak. If NULL, the tweak supplied to the
+ *     create function is used
+ * @t: The number of bytes pointed to by @T
+ * @status: An array of @cnt results, one for each field: 0 on success
+ *          or a negative error number. May be NULL
+ *
+ * @return 0 if every field succeeded or a negative error number
+ *         for the first failure. If the column can't be processed
+ *         at all, e.g. because the tweak is invalid, the error is
+ *         returned without filling in @status
+ */
+int ff1_encrypt_strided(struct ff1_ctx * const ctx,
+                        char * const Y, const size_t ystride,
+                        const char * const X, const size_t xstride,
+                        const size_t width, const size_t cnt,
+                        const uint8_t * const T, const size_t t,
+                        int * const status);
+/*
+ * Decrypt a column of fixed-width fields using the FF1 algorithm
+ *
+ * This function is identical to ff1_encrypt_strided() except that
+ * @X contains the cipher texts and @Y receives the plain texts
+ */
+int ff1_decrypt_strided(struct ff1_ctx * const ctx,
+                        char * const Y, const size_t ystride,
+                        const char * const X, const size_t xstride,
+                        const size_t width, const size_t cnt,
+                        const uint8_t * const T, const size_t t,
+                        int * const status);
+
+/*
+ * Destroy a tweak prepared by ff1_tweak_prepare()
+ *
+ * @twk: The pointer returned by the prepare function
+ */
+void ff1_tweak_destroy(struct ff1_tweak * const twk);
+
 /*
  * Destroy the context structure associated with the FF1 algorithm
  *
@@ -8,15 +8,18 @@
 __BEGIN_DECLS
 
 struct ff3_1_ctx;
+struct fpe_pool;
 
 /*
  * Create a context instance for use with the FF3-1 algorithm
  *
  * The created instance can be used for encryption or decryption
- * or both. The instance is not thread-safe, though. For example,
- * multiple instances can be created and used in different, individual
- * threads. However, a single instance cannot be used for simultaneous
- * encryptions/decryptions in multiple threads.
+ * or both. The instance is thread-safe: once created, a single
+ * instance may be used for simultaneous encryptions/decryptions in
+ * any number of threads. The key schedule and alphabet are shared
+ * and never modified; each operation borrows its scratch space from
+ * a pool kept by the instance, which grows to the number of
+ * operations that have been in progress at once.
  *
  * @ctx: Pointer to location to store pointer to context data
  *       Caller supplies the address to a pointer. This function
@@ -33,6 +36,31 @@ int ff3_1_ctx_create(struct ff3_1_ctx ** const ctx,
                      const uint8_t * const twkbuf,
                      const unsigned int radix);
 
+/*
+ * Create a context instance for use with the FF3-1 algorithm
+ * with a custom alphabet
+ *
+ * All parameters are the same as for ff3_1_ctx_create() except:
+ *
+ * @custom_radix_str: A nul-terminated string containing the characters
+ *                    of the alphabet, in order: the first character
+ *                    represents the digit 0, the second 1, and so on.
+ *                    The radix is the number of characters in the
+ *                    string, which may be ASCII or UTF-8, and must be
+ *                    between 2 and 65536. The plain and cipher texts
+ *                    passed to ff3_1_encrypt() and ff3_1_decrypt() are
+ *                    made up of these characters. The string is
+ *                    translated into lookup tables when the context is
+ *                    created, so it need not persist afterward.
+ *
+ * @return 0 on success or a negative error number on failure
+ */
+int ff3_1_ctx_create_custom_radix(struct ff3_1_ctx ** const ctx,
+                                  const uint8_t * const keybuf,
+                                  const size_t keylen,
+                                  const uint8_t * const twkbuf,
+                                  const uint8_t * const custom_radix_str);
+
 /*
  * Encrypt data using the FF3-1 algorithm
  *
@@ -81,6 +109,166 @@ int ff3_1_decrypt(struct ff3_1_ctx * const ctx,
                   char * const Y,
                   const char * const X, const uint8_t * const T);
 
+/*
+ * Encrypt data of a given length using the FF3-1 algorithm
+ *
+ * This function is identical to ff3_1_encrypt() except that the plain
+ * text need not be nul-terminated, and the cipher text is written
+ * without a terminator.
+ *
+ * @Y: A pointer to the location to output the cipher text
+ * @ylen: On input, the number of bytes available at @Y. On output,
+ *        the number of bytes written. ff3_1_output_len() returns a
+ *        size that is always sufficient. If @Y is too small, -ENOSPC
+ *        is returned
+ * @X: A pointer to the plain text
+ * @xlen: The number of bytes in the plain text
+ */
+int ff3_1_encrypt_len(struct ff3_1_ctx * const ctx,
+                      char * const Y, size_t * const ylen,
+                      const char * const X, const size_t xlen,
+                      const uint8_t * const T);
+/*
+ * Decrypt data of a given length using the FF3-1 algorithm
+ *
+ * This function is identical to ff3_1_decrypt() except that the texts
+ * are passed as described for ff3_1_encrypt_len()
+ */
+int ff3_1_decrypt_len(struct ff3_1_ctx * const ctx,
+                      char * const Y, size_t * const ylen,
+                      const char * const X, const size_t xlen,
+                      const uint8_t * const T);
+
+/*
+ * Return the number of bytes of output space that is sufficient
+ * for the encryption or decryption of any text of @xlen bytes, not
+ * including a nul-terminator
+ */
+size_t ff3_1_output_len(const struct ff3_1_ctx * const ctx,
+                        const size_t xlen);
+
+/*
+ * Encrypt a batch of records using the FF3-1 algorithm
+ *
+ * Each record is encrypted exactly as by ff3_1_encrypt(). The
+ * context's scratch space and the parameters for each length are
+ * shared by all of the records. The records are grouped by length,
+ * and records of the same length are encrypted several at a time,
+ * wherever they are in the batch and whatever their tweaks. A record
+ * that fails doesn't stop the others from being processed.
+ *
+ * @ctx: The pointer returned by the create function
+ * @Y: An array of @cnt pointers to the locations to output the cipher
+ *     texts. Each must have space for the cipher text of the
+ *     corresponding record and a nul-terminator.
+ * @X: An array of @cnt pointers to the plain texts
+ * @Xlen: An array of @cnt lengths, in bytes, of the plain texts, which
+ *        need not be nul-terminated. If NULL, the plain texts must be
+ *        nul-terminated
+ * @T: An array of @cnt pointers to 7-byte tweaks. Either the array or
+ *     any of its elements may be NULL, in which case the tweak supplied
+ *     to the create function is used for the affected records
+ * @cnt: The number of records
+ * @status: An array of @cnt results, one for each record: 0 on success
+ *          or a negative error number. May be NULL
+ *
+ * @return 0 if every record succeeded or the error for the first
+ *         record that failed
+ */
+int ff3_1_encrypt_batch(struct ff3_1_ctx * const ctx,
+                        char * const * const Y,
+                        const char * const * const X,
+                        const size_t * const Xlen,
+                        const uint8_t * const * const T,
+                        const size_t cnt,
+                        int * const status);
+/*
+ * Decrypt a batch of records using the FF3-1 algorithm
+ *
+ * This function is identical to ff3_1_encrypt_batch() except that
+ * @X contains the cipher texts and @Y receives the plain texts
+ */
+int ff3_1_decrypt_batch(struct ff3_1_ctx * const ctx,
+                        char * const * const Y,
+                        const char * const * const X,
+                        const size_t * const Xlen,
+                        const uint8_t * const * const T,
+                        const size_t cnt,
+                        int * const status);
+
+/*
+ * Encrypt a batch of records using the FF3-1 algorithm and the
+ * threads of a pool
+ *
+ * This function is identical to ff3_1_encrypt_batch() except that
+ * the records are divided among the workers of @pool (see pool.h),
+ * and the function returns once all of them have been processed.
+ * If @pool is NULL, the records are processed by the calling thread.
+ */
+int ff3_1_encrypt_batch_mt(struct ff3_1_ctx * const ctx,
+                           struct fpe_pool * const pool,
+                           char * const * const Y,
+                           const char * const * const X,
+                           const size_t * const Xlen,
+                           const uint8_t * const * const T,
+                           const size_t cnt,
+                           int * const status);
+/*
+ * Decrypt a batch of records using the FF3-1 algorithm and the
+ * threads of a pool
+ *
+ * This function is identical to ff3_1_encrypt_batch_mt() except that
+ * @X contains the cipher texts and @Y receives the plain texts
+ */
+int ff3_1_decrypt_batch_mt(struct ff3_1_ctx * const ctx,
+                           struct fpe_pool * const pool,
+                           char * const * const Y,
+                           const char * const * const X,
+                           const size_t * const Xlen,
+                           const uint8_t * const * const T,
+                           const size_t cnt,
+                           int * const status);
+
+/*
+ * Encrypt a column of fixed-width fields using the FF3-1 algorithm
+ *
+ * The fields are @width bytes each and are found every @xstride
+ * bytes, starting at @X. The cipher texts are written, without
+ * terminators, to the corresponding fields of the output column,
+ * which may be the input itself. The same tweak is used for every
+ * field. A field that fails doesn't stop the others from being
+ * processed, and its output is left untouched. See
+ * ff1_encrypt_strided() for more details.
+ *
+ * Only contexts whose alphabets consist of single-byte characters
+ * are supported, since the input and output must be the same size.
+ *
+ * @T: A pointer to the 7-byte tweak. If NULL, the tweak supplied
+ *     to the create function is used
+ *
+ * @return 0 if every field succeeded or a negative error number
+ *         for the first failure. If the column can't be processed
+ *         at all, the error is returned without filling in @status
+ */
+int ff3_1_encrypt_strided(struct ff3_1_ctx * const ctx,
+                          char * const Y, const size_t ystride,
+                          const char * const X, const size_t xstride,
+                          const size_t width, const size_t cnt,
+                          const uint8_t * const T,
+                          int * const status);
+/*
+ * Decrypt a column of fixed-width fields using the FF3-1 algorithm
+ *
+ * This function is identical to ff3_1_encrypt_strided() except that
+ * @X contains the cipher texts and @Y receives the plain texts
+ */
+int ff3_1_decrypt_strided(struct ff3_1_ctx * const ctx,
+                          char * const Y, const size_t ystride,
+                          const char * const X, const size_t xstride,
+                          const size_t width, const size_t cnt,
+                          const uint8_t * const T,
+                          int * const status);
+
 /*
  * Destroy the context structure associated with the FF3-1 algorithm
  *
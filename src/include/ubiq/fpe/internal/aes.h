@@ -0,0 +1,87 @@
+#ifndef UBIQ_FPE_INTERNAL_AES_H
+#define UBIQ_FPE_INTERNAL_AES_H
+
+#include <sys/cdefs.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+__BEGIN_DECLS
+
+/*
+ * expanded aes encryption key for use with the native
+ * (aes-ni) implementation of the block cipher. @nr is the
+ * number of rounds: 10, 12, or 14 for 128, 192, and 256-bit
+ * keys, respectively. the key schedule holds @nr + 1 round keys
+ */
+struct ffx_aes
+{
+    uint8_t rk[15][16];
+    unsigned int nr;
+};
+
+/*
+ * returns non-zero if the processor supports the aes-ni
+ * instructions *and* the library was built with support
+ * for them
+ */
+int ffx_aesni_supported(void);
+
+/*
+ * expand the @keylen bytes of @key into @aes. @keylen must
+ * be 16, 24, or 32. the function must not be called unless
+ * ffx_aesni_supported() returns true
+ */
+void ffx_aesni_expand(struct ffx_aes * const aes,
+                      const uint8_t * const key, const size_t keylen);
+
+/*
+ * perform an aes-cbc encryption of @src, chaining from the
+ * (16-byte) block pointed to by @iv, and store the last block
+ * of output into @dst. @len must be a multiple of 16. @dst may
+ * point to the same location as @iv or @src
+ */
+void ffx_aesni_cbcmac(const struct ffx_aes * const aes,
+                      uint8_t * const dst, const uint8_t * const iv,
+                      const uint8_t * const src, const size_t len);
+
+/*
+ * the largest number of independent chains that can be
+ * passed to the multi-buffer versions of the function above
+ */
+#define FFX_AES_LANES   16
+
+/*
+ * perform @n (at most FFX_AES_LANES) independent cbc encryptions,
+ * as by ffx_aesni_cbcmac(), of @src[0] through @src[n - 1], all @len
+ * bytes long. the encryptions are done in lockstep, with the rounds
+ * interleaved, so that the latency of one encryption is hidden by
+ * the others. @dst[k] may point to the same location as @iv[k] or
+ * @src[k] but must not overlap the input of any other chain
+ */
+void ffx_aesni_cbcmac_xn(const struct ffx_aes * const aes,
+                         const unsigned int n,
+                         uint8_t * const * const dst,
+                         const uint8_t * const * const iv,
+                         const uint8_t * const * const src,
+                         const size_t len);
+
+/*
+ * the same, using the vector aes instructions, which encrypt 4
+ * blocks with each instruction. ffx_vaes_supported() returns
+ * non-zero if the processor supports those instructions, along
+ * with the 512-bit registers they operate on, *and* the library
+ * was built with support for them. ffx_vaes_cbcmac_xn() must not
+ * be called otherwise. the key is expanded by ffx_aesni_expand()
+ */
+int ffx_vaes_supported(void);
+void ffx_vaes_cbcmac_xn(const struct ffx_aes * const aes,
+                        const unsigned int n,
+                        uint8_t * const * const dst,
+                        const uint8_t * const * const iv,
+                        const uint8_t * const * const src,
+                        const size_t len);
+
+__END_DECLS
+
+#endif
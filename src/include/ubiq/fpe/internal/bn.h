@@ -30,15 +30,18 @@ void bigint_swap(bigint_t * const x, bigint_t * const y)
     mpz_swap(*x, *y);
 }
 
+static inline
+void bigint_set(bigint_t * const x, const bigint_t * const y)
+{
+    mpz_set(*x, *y);
+}
+
 static inline
 void bigint_set_ui(bigint_t * const x, const unsigned int n)
 {
     mpz_set_ui(*x, n);
 }
 
-int __u32_bigint_set_str(bigint_t * const x,
-                    const uint32_t * const str, const uint32_t * const alpha);
-
 static inline
 int bigint_set_str(bigint_t * const x,
                    const char * const str, const unsigned int radix)
@@ -46,16 +49,6 @@ int bigint_set_str(bigint_t * const x,
     return mpz_set_str(*x, str, radix);
 }
 
-int __bigint_set_str(bigint_t * const x,
-                     const char * const str, const char * const alpha);
-
-// Makes assumption about character set being used rad <= 10 (0-9), rad <= 36 (0-9a-z), rad <= 62 (0-9a-zA-Z), 63 < rad (\x01 - \xFF)
-int __bigint_set_str_radix(bigint_t * const x,
-                     const char * const str, const size_t radix);
-
-int __u32_bigint_get_str(uint32_t * const str, const size_t len,
-                    const uint32_t * const alpha, const bigint_t * const x);
-
 static inline
 int bigint_get_str(char * const str, const size_t len,
                    const unsigned int radix,
@@ -73,16 +66,121 @@ int bigint_get_str(char * const str, const size_t len,
     return res;
 }
 
-// Allow getting the string value of a big number where the string does not 
-// conform to the standards for bignum, 0-9, a-z, A-Z.
-// Returns 0 or -ENOMEM if len is not big enough.
-// str and len MUST account for null terminator
-int __bigint_get_str(char * const str, const size_t len,
-                     const char * const alpha, const bigint_t * const x);
+/*
+ * Conversions between arrays of numerals and integers. A numeral is
+ * simply the value of a digit, 0 through radix - 1, so these work for
+ * any radix up to 65536, regardless of alphabet, and no character set
+ * is involved. The numerals are most significant first, and no
+ * terminator is read or written.
+ *
+ * The functions that convert to integers return -EINVAL if a numeral
+ * is not less than the radix and -EOVERFLOW if the value doesn't fit.
+ * The functions that convert from integers write exactly @len
+ * numerals, padded on the left with zeros, and those that return a
+ * value return -EOVERFLOW if the integer can't be represented in
+ * @len numerals. __bigint_get_num_consume() uses @x as scratch space,
+ * and its value is lost.
+ *
+ * The native versions are used when the numbers involved are known
+ * to be small enough to avoid the overhead of the big integer library.
+ * For a radix that is a power of 2, the __bytes_ versions hold the
+ * number as a big endian array of @n bytes. Each numeral is simply
+ * log2(radix) bits of the number, so the numerals are packed and
+ * unpacked without any arithmetic. __bytes_get_num_pow2() ignores
+ * any bits of the value beyond those @len numerals.
+ */
+int __u64_set_num(uint64_t * const x,
+                  const uint16_t * const num, const size_t len,
+                  const size_t radix);
+int __u64_get_num(uint16_t * const num, const size_t len,
+                  const size_t radix, uint64_t x);
+
+int __bytes_set_num_pow2(uint8_t * const x, const size_t n,
+                         const uint16_t * const num, const size_t len,
+                         const size_t radix);
+void __bytes_get_num_pow2(uint16_t * const num, const size_t len,
+                          const size_t radix,
+                          const uint8_t * const x, const size_t n);
+
+/*
+ * Long arrays of numerals are converted to and from big integers by
+ * splitting them in half, recursively (see bn.c). The splits use the
+ * powers radix**(2**k), which depend only on the radix and the length,
+ * so they are computed once, by __bigint_pow_init(), and can then be
+ * used by any number of conversions (at once) of up to @len numerals
+ * in that radix. @cnt is the number of powers computed, which is 0 if
+ * arrays of @len numerals are short enough not to need any.
+ *
+ * Each level of the recursion also needs a temporary integer. These
+ * are supplied by the caller, in @tmp, an array of BIGINT_POW_MAX
+ * initialized integers, so that they can keep their storage from
+ * one conversion to the next. Unlike the powers, they can only be
+ * used by one conversion at a time
+ */
+#define BIGINT_POW_MAX  (8 * sizeof(size_t))
+
+struct bigint_pow
+{
+    unsigned int cnt;
+    bigint_t pw[BIGINT_POW_MAX];
+};
+
+void __bigint_pow_init(struct bigint_pow * const pw,
+                       const size_t len, const size_t radix);
+void __bigint_pow_deinit(struct bigint_pow * const pw);
+
+int __bigint_set_num(bigint_t * const x,
+                     const uint16_t * const num, const size_t len,
+                     const size_t radix, const struct bigint_pow * const pw,
+                     bigint_t * const tmp);
+int __bigint_get_num_consume(uint16_t * const num, const size_t len,
+                             const size_t radix, bigint_t * const x,
+                             const struct bigint_pow * const pw,
+                             bigint_t * const tmp);
+
+#if defined(__SIZEOF_INT128__)
+/*
+ * As above, but with 128-bit integers, and the numerals are in
+ * reverse order: the first is the least significant digit. That
+ * is, __u128_set_rnum() computes NUM(REV(num)), and
+ * __u128_get_rnum() produces REV(STR(x)).
+ */
+int __u128_set_rnum(unsigned __int128 * const x,
+                    const uint16_t * const num, const size_t len,
+                    const size_t radix);
+int __u128_get_rnum(uint16_t * const num, const size_t len,
+                    const size_t radix, unsigned __int128 x);
+#endif
+
+/*
+ * returns the value of @x, which must be non-negative and
+ * fit into 64 bits
+ */
+static inline
+uint64_t bigint_get_u64(const bigint_t * const x)
+{
+    uint64_t r = 0;
+
+    mpz_export(&r, NULL, -1, sizeof(r), 0, 0, *x);
 
-// Makes assumption about character set being used rad <= 10 (0-9), rad <= 36 (0-9a-z), rad <= 62 (0-9a-zA-Z), 63 < rad (\x01 - \xFF)
-int __bigint_get_str_radix(char * const str, const size_t len,
-                     const size_t radix, const bigint_t * const x);
+    return r;
+}
+
+#if defined(__SIZEOF_INT128__)
+/*
+ * returns the value of @x, which must be non-negative and
+ * fit into 128 bits
+ */
+static inline
+unsigned __int128 bigint_get_u128(const bigint_t * const x)
+{
+    uint64_t r[2] = { 0, 0 };
+
+    mpz_export(r, NULL, -1, sizeof(*r), 0, 0, *x);
+
+    return ((unsigned __int128)r[1] << 64) | r[0];
+}
+#endif
 
 static inline
 void * bigint_export(const bigint_t * const x, size_t * const count)
@@ -90,6 +188,29 @@ void * bigint_export(const bigint_t * const x, size_t * const count)
     return mpz_export(NULL, count, 1, 1, 1, 0, *x);
 }
 
+/*
+ * store @x, which must be non-negative, into the @len bytes at @buf
+ * as a big endian number, padded on the left with zeros. if more than
+ * @len bytes are needed, the most significant @len bytes are stored.
+ * unlike bigint_export(), no memory is allocated
+ */
+static inline
+void bigint_export_fixed(const bigint_t * const x,
+                         void * const buf, const size_t len)
+{
+    const size_t cnt = (mpz_sizeinbase(*x, 2) + 7) / 8;
+    const size_t off = (cnt > len) ? cnt - len : 0;
+    uint8_t * const b = (uint8_t *)buf;
+
+    for (size_t i = 0; i < len; i++) {
+        /* @j counts from the least significant byte */
+        const size_t j = off + (len - 1 - i);
+        const mp_limb_t l = mpz_getlimbn(*x, j / sizeof(mp_limb_t));
+
+        b[i] = l >> (8 * (j % sizeof(mp_limb_t)));
+    }
+}
+
 static inline
 void bigint_import(bigint_t * const x,
                    const void * const buf, const size_t len)
@@ -123,6 +244,31 @@ void bigint_sub(bigint_t * const res,
     mpz_sub(*res, *top, *btm);
 }
 
+static inline
+void bigint_add_ui(bigint_t * const res,
+                   const bigint_t * const top, const unsigned int btm)
+{
+    mpz_add_ui(*res, *top, btm);
+}
+
+static inline
+void bigint_sub_ui(bigint_t * const res,
+                   const bigint_t * const top, const unsigned int btm)
+{
+    mpz_sub_ui(*res, *top, btm);
+}
+
+/*
+ * returns the number of digits necessary to represent
+ * @x in the given @base, ignoring the sign. for a base
+ * that is a power of 2, the result is exact
+ */
+static inline
+size_t bigint_sizeinbase(const bigint_t * const x, const unsigned int base)
+{
+    return mpz_sizeinbase(*x, base);
+}
+
 static inline
 void bigint_mul_ui(bigint_t * const res,
                    const bigint_t * const m1, const unsigned int m2)
@@ -130,6 +276,13 @@ void bigint_mul_ui(bigint_t * const res,
     mpz_mul_ui(*res, *m1, m2);
 }
 
+static inline
+void bigint_mul(bigint_t * const res,
+                const bigint_t * const m1, const bigint_t * const m2)
+{
+    mpz_mul(*res, *m1, *m2);
+}
+
 static inline
 void bigint_pow_ui(bigint_t * const res,
                    const bigint_t * const base, const unsigned int exp)
@@ -144,6 +297,33 @@ void bigint_div_ui(bigint_t * const q, unsigned int * const r,
     *r = mpz_tdiv_q_ui(*q, *n, d);
 }
 
+/*
+ * word-sized versions of the operations above, used to move several
+ * digits at a time between strings and big integers
+ */
+static inline
+void bigint_mul_add_ul(bigint_t * const res, const bigint_t * const x,
+                       const unsigned long m, const unsigned long a)
+{
+    mpz_mul_ui(*res, *x, m);
+    mpz_add_ui(*res, *res, a);
+}
+
+static inline
+void bigint_div_ul(bigint_t * const q, unsigned long * const r,
+                   const bigint_t * const n, const unsigned long d)
+{
+    *r = mpz_tdiv_q_ui(*q, *n, d);
+}
+
+/* @q = @n / @d and @r = @n % @d, truncating toward zero */
+static inline
+void bigint_divmod(bigint_t * const q, bigint_t * const r,
+                   const bigint_t * const n, const bigint_t * const d)
+{
+    mpz_tdiv_qr(*q, *r, *n, *d);
+}
+
 static inline
 void bigint_mod(bigint_t * const res,
                 const bigint_t * const num, const bigint_t * const den)
@@ -151,19 +331,94 @@ void bigint_mod(bigint_t * const res,
     mpz_mod(*res, *num, *den);
 }
 
-int map_characters(
-    char * const dst, 
-    const char * const src,
-    const char * const src_chars,
-    const char * const dst_chars);
-
-int map_characters_from_u32(char * const dst, const uint8_t * const src,
-    const uint32_t * const src_chars,
-    const char * const dst_chars);
-
-int map_characters_to_u32(uint8_t * const dst, const char * const src,
-    const char * const src_chars,
-    const uint32_t * const dst_chars) ;
+/*
+ * translation between an alphabet of single-byte characters and the
+ * numerals that they represent. @in maps each character to its
+ * numeral plus 1, or to 0 if it isn't in the alphabet, and @out maps
+ * each numeral to its character. the alphabet consists of the first
+ * @radix (at most 255) characters of @alpha. if @nocase is set, the
+ * upper case versions of any lower case letters in the alphabet are
+ * accepted as well, as the big integer library does for a radix up
+ * to 36
+ */
+void map_numerals_tbl_init(uint8_t in[256], uint8_t out[256],
+    const char * const alpha, const size_t radix, const int nocase);
+
+/*
+ * convert the @len characters of @src, which need not be nul-
+ * terminated, to numerals through @tbl, an @in table from above.
+ * -EINVAL is returned if a character is not in the alphabet. if
+ * the processor supports it, long strings are converted 32
+ * characters at a time
+ */
+int map_numerals_from_tbl(uint16_t * const dst,
+    const char * const src, const size_t len,
+    const uint8_t tbl[256]);
+
+/*
+ * the reverse of the above, through an @out table. every numeral
+ * must be less than the radix. no nul terminator is written
+ */
+void map_numerals_to_tbl(char * const dst,
+    const uint16_t * const src, const size_t len,
+    const uint8_t tbl[256]);
+
+/*
+ * translation between an alphabet of (possibly) multibyte utf-8
+ * characters and the numerals, 0 through radix - 1, that they
+ * represent. @in is an open-addressed hash table of 2**@bits slots
+ * from code point to numeral; a slot with a code point of
+ * MAP_U8_EMPTY is empty. @out holds the utf-8 encoding of the
+ * alphabet's character for each numeral.
+ */
+#define MAP_U8_EMPTY    UINT32_MAX
+
+struct map_u8_tbl
+{
+    unsigned int radix, bits;
+    /* the shortest and longest encodings of the characters */
+    unsigned int minlen, maxlen;
+
+    struct map_u8_in {
+        uint32_t uc;
+        uint16_t d;
+    } * in;
+
+    struct map_u8_out {
+        uint8_t len;
+        uint8_t s[4];
+    } * out;
+};
+
+/*
+ * build @tbl from the nul-terminated code points of @u32_chars. the
+ * alphabet may contain up to 65536 characters. the memory allocated
+ * for the table is released by map_numerals_u8_tbl_deinit()
+ */
+int map_numerals_u8_tbl_init(struct map_u8_tbl * const tbl,
+    const uint32_t * const u32_chars);
+void map_numerals_u8_tbl_deinit(struct map_u8_tbl * const tbl);
+
+/*
+ * decode the @n bytes of utf-8 at @src and store the corresponding
+ * numerals into @dst. the number of numerals is returned in @n.
+ * -EINVAL is returned if @src is not valid utf-8 or contains
+ * characters not in the alphabet, which never includes nul
+ */
+int map_numerals_from_u8_tbl(uint16_t * const dst, size_t * const n,
+    const uint8_t * const src,
+    const struct map_u8_tbl * const tbl);
+
+/*
+ * the reverse of the above, encoding the @n numerals at @src as
+ * utf-8 into the @len bytes at @dst. no terminator is written.
+ * the number of bytes written is returned in @len. -EINVAL is
+ * returned if a numeral is not less than the radix and -ENOSPC
+ * if @dst is too small
+ */
+int map_numerals_to_u8_tbl(uint8_t * const dst, size_t * const len,
+    const uint16_t * const src, const size_t n,
+    const struct map_u8_tbl * const tbl);
 
 const char * get_standard_bignum_radix(
     const size_t radix);
@@ -0,0 +1,39 @@
+#ifndef UBIQ_FPE_INTERNAL_DIGITS_H
+#define UBIQ_FPE_INTERNAL_DIGITS_H
+
+#include <sys/cdefs.h>
+
+#include <stdint.h>
+
+__BEGIN_DECLS
+
+/*
+ * vectorized conversions between blocks of 16 decimal or
+ * hexadecimal numerals (digit values, see bn.h) and native
+ * integers. the numerals are most significant first.
+ */
+
+/*
+ * returns non-zero if the processor supports the necessary
+ * instructions *and* the library was built with support for
+ * them. none of the functions below may be called otherwise
+ */
+int ffx_digits_supported(void);
+
+/*
+ * convert the 16 numerals at @num to an integer, stored in @x.
+ * returns -EINVAL if any of them is not less than the radix
+ */
+int ffx_digits_get_dec16(uint64_t * const x, const uint16_t * const num);
+int ffx_digits_get_hex16(uint64_t * const x, const uint16_t * const num);
+
+/*
+ * write @x as exactly 16 numerals, padded on the left with zeros.
+ * for the decimal version, @x must be less than 10**16
+ */
+void ffx_digits_put_dec16(uint16_t * const num, const uint64_t x);
+void ffx_digits_put_hex16(uint16_t * const num, const uint64_t x);
+
+__END_DECLS
+
+#endif
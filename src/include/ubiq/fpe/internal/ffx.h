@@ -7,42 +7,152 @@
 #include <stddef.h>
 #include <string.h>
 
+#include <ubiq/fpe/internal/aes.h>
 #include <ubiq/fpe/internal/bn.h>
 #include <ubiq/fpe/internal/debug.h>
+#include <ubiq/fpe/internal/round.h>
 
 #include <openssl/evp.h>
 
+#include <pthread.h>
+
 __BEGIN_DECLS
 
 uint8_t * ffx_revb(uint8_t * const dst,
                    const uint8_t * const src, const size_t len);
 
-uint32_t * ffx_revu32(uint32_t * const dst,
-                  const uint32_t * const src, const size_t len);
+uint16_t * ffx_revu16(uint16_t * const dst,
+                      const uint16_t * const src, const size_t len);
 
-static inline
-char * ffx_revs(char * const dst, const char * const src)
+/*
+ * parameters of the algorithms that depend only on the radix
+ * and the length, @n, of the text. @u and @v are the lengths of
+ * the two halves of the text (@u being the shorter when n is
+ * odd), and @mU and @mV are radix**u and radix**v.
+ *
+ * @b and @d are the byte lengths from Steps 3 and 4 of FF1.
+ *
+ * When radix**v fits into 64 bits, @native is set, and @nU and
+ * @nV hold the moduli as native integers. Similarly, @wide, @wU,
+ * and @wV for 128 bits, where the compiler supports them.
+ *
+ * @pw holds the powers of the radix used to convert the halves
+ * of the text to and from big integers (see __bigint_set_num())
+ */
+struct ffx_len
 {
-    const size_t len = strlen(src);
-    char * const res =
-        (char *)ffx_revb((uint8_t *)dst, (const uint8_t *)src, len);
-    dst[len] = '\0';
-    return res;
-}
+    unsigned int n;
+    unsigned int u, v;
+    unsigned int b, d;
+    bigint_t mU, mV;
+    struct bigint_pow pw;
+
+    int native;
+    uint64_t nU, nV;
 
-int ffx_str(char * const str, const size_t len,
-            const unsigned int m, const unsigned int r, const bigint_t * n);
+#if defined(__SIZEOF_INT128__)
+    int wide;
+    unsigned __int128 wU, wV;
+#endif
+};
 
+/* the number of distinct lengths cached by a context */
+#define FFX_LEN_CACHE   16
+
+/*
+ * scratch space used by the algorithms during a single encryption
+ * or decryption. the memory is grown as necessary to accommodate
+ * the longest text seen so far and the big integers retain their
+ * storage between operations, so that, once the workspace has
+ * grown to size, encrypting and decrypting do not allocate memory.
+ *
+ * a workspace is used by one thread at a time. the context keeps
+ * a pool of them (see ffx_ws_acquire()), so that the context itself
+ * need not be modified by an operation. the contents are not
+ * preserved from one operation to the next
+ */
+struct ffx_ws
+{
+    /* the next unused workspace in the context's pool */
+    struct ffx_ws * next;
+    /*
+     * a copy of the context's evp context. evp contexts hold the
+     * state of the encryption in progress and can't be shared
+     */
+    EVP_CIPHER_CTX * evp;
+    struct {
+        uint8_t * buf;
+        size_t len;
+    } mem;
+    /*
+     * the buckets of a batch (see ffx_ws_buckets()). they are
+     * kept apart from @mem, which the records of the batch use
+     */
+    struct {
+        struct ffx_bucket * buf;
+        size_t cnt;
+    } bkt;
+    bigint_t a, b, y;
+    /* the temporaries for __bigint_set_num() and the like */
+    bigint_t dc[BIGINT_POW_MAX];
+};
 
+/*
+ * after it is created, nothing in the context is modified except
+ * the pool of workspaces and the cache of length parameters, both
+ * of which are protected by @lock. the context can, therefore, be
+ * used by any number of threads at once
+ */
 struct ffx_ctx
 {
+    /*
+     * keyed when the context is created and thereafter used only
+     * as the template for the evp contexts of the workspaces
+     */
     EVP_CIPHER_CTX * evp;
+    /*
+     * when the processor supports it, the key is also expanded
+     * for use by the native aes implementation, and @aesni is
+     * set. otherwise, all operations go through @evp. @vaes is
+     * set if the vector aes instructions can also be used for
+     * multiple chains at once; see ffx_prf_xn()
+     */
+    struct ffx_aes aes;
+    int aesni, vaes;
+    /*
+     * set if the vectorized ff1 rounds (see round.h) can be used
+     * for texts that are run in lockstep
+     */
+    int avx2, avx512;
 
     unsigned int radix;
+    /*
+     * if @radix is a power of 2, the number of bits in each
+     * digit, i.e. log2(radix). otherwise, 0
+     */
+    unsigned int radix_bits;
     char * custom_radix_str; // Radix character set - Not null if custom radix string is supplied.
     // It is possible to have a custom radix string with a normally standard radix size (10,36,62, etc).
     // If the custom radix string is not null, need to perform string mapping regardless of radix value
     uint32_t * u32_custom_radix_str; // Only used in the custom radix string contains multibyte characters.
+    /*
+     * for a radix up to 255, these translate between the characters
+     * of the alphabet and numerals: @in from characters to numerals
+     * and @out in the other direction. the alphabet is the custom
+     * radix string, if it consists only of single-byte characters,
+     * or the standard character set for the radix, otherwise. see
+     * map_numerals_tbl_init()
+     */
+    struct {
+        uint8_t in[256], out[256];
+    } map;
+    /*
+     * a custom radix string containing multibyte characters is
+     * translated to and from numerals, instead, which allows the
+     * alphabet to contain more than 255 characters. see
+     * map_numerals_from_u8_tbl()
+     */
+    struct map_u8_tbl * u8_map;
     struct {
         size_t min, max;
     } txtlen, twklen;
@@ -50,13 +160,126 @@ struct ffx_ctx
         uint8_t * buf;
         size_t len;
     } twk;
+    /*
+     * the parameters for each text length are computed
+     * the first time that length is seen and are not
+     * modified thereafter. see ffx_len_acquire()
+     */
+    struct {
+        struct ffx_len ent[FFX_LEN_CACHE];
+        unsigned int cnt;
+    } lens;
+
+    pthread_mutex_t lock;
+    struct ffx_ws * ws;
 };
 
-int ffx_prf(struct ffx_ctx * const ctx,
+const struct ffx_len * ffx_len_acquire(struct ffx_ctx * const ctx,
+                                       const unsigned int n,
+                                       struct ffx_len * const tmp);
+void ffx_len_release(const struct ffx_len * const len,
+                     struct ffx_len * const tmp);
+
+/*
+ * take a workspace from the context's pool, creating a new one if
+ * the pool is empty, and return it when the operation is complete.
+ * ffx_ws_acquire() returns NULL if a workspace can't be allocated
+ */
+struct ffx_ws * ffx_ws_acquire(struct ffx_ctx * const ctx);
+void ffx_ws_release(struct ffx_ctx * const ctx, struct ffx_ws * const ws);
+
+void * ffx_ws_reserve(struct ffx_ws * const ws, const size_t len);
+void ffx_ws_clear(struct ffx_ws * const ws, const size_t len);
+
+struct ffx_bucket * ffx_ws_buckets(struct ffx_ws * const ws, const size_t cnt);
+
+/*
+ * translate a nul-terminated string in the context's alphabet to
+ * numerals and back. @n is the length of @src, in bytes, on input
+ * and is set to the number of numerals on output, which may be
+ * fewer if the alphabet contains multibyte characters. the string
+ * produced by ffx_num_to_str() is nul-terminated. both return
+ * -EINVAL if a character or numeral is not in the alphabet
+ */
+int ffx_str_to_num(const struct ffx_ctx * const ctx,
+                   uint16_t * const dst, size_t * const n,
+                   const char * const src);
+int ffx_num_to_str(const struct ffx_ctx * const ctx,
+                   char * const dst,
+                   const uint16_t * const src, const size_t n);
+
+/*
+ * as ffx_num_to_str(), but the string is written, without a
+ * terminator, into the @len bytes at @dst, and the number of bytes
+ * written is returned in @len. -ENOSPC is returned if @dst is too
+ * small. ffx_output_len() returns a number of bytes that is always
+ * enough for the output when the input is @len bytes long
+ */
+int ffx_num_to_buf(const struct ffx_ctx * const ctx,
+                   char * const dst, size_t * const len,
+                   const uint16_t * const src, const size_t n);
+size_t ffx_output_len(const struct ffx_ctx * const ctx, const size_t len);
+/*
+ * returns the number of numerals in any text of @len bytes, or 0
+ * if that depends on the text, i.e. if the context's alphabet has
+ * characters of different lengths
+ */
+size_t ffx_input_len(const struct ffx_ctx * const ctx, const size_t len);
+
+int ffx_prf(const struct ffx_ctx * const ctx, struct ffx_ws * const ws,
             uint8_t * const dst, const uint8_t * const src, const size_t len);
-int ffx_ciph(struct ffx_ctx * const ctx,
+int ffx_prf_iv(const struct ffx_ctx * const ctx, struct ffx_ws * const ws,
+               uint8_t * const dst, const uint8_t * const iv,
+               const uint8_t * const src, const size_t len);
+int ffx_ciph(const struct ffx_ctx * const ctx, struct ffx_ws * const ws,
              uint8_t * const dst, const uint8_t * const src);
 
+/*
+ * ffx_prf_iv() for @n (at most FFX_AES_LANES) independent chains
+ * at once, all @len bytes long. ffx_prf_lanes() returns the number
+ * of chains that the context can process in parallel; there's no
+ * benefit to calling ffx_prf_xn() when that number is 1
+ */
+unsigned int ffx_prf_lanes(const struct ffx_ctx * const ctx);
+int ffx_prf_xn(const struct ffx_ctx * const ctx, struct ffx_ws * const ws,
+               const unsigned int n,
+               uint8_t * const * const dst,
+               const uint8_t * const * const iv,
+               const uint8_t * const * const src, const size_t len);
+
+/*
+ * records of the same length can only be processed together (see
+ * ffx_prf_xn()) if they're adjacent. the records of a batch of mixed
+ * lengths are bucketed by sorting an array of their lengths, @n, and
+ * positions, @i, by length and then by position. the records are
+ * then processed in that order, reading and writing them in place
+ */
+struct ffx_bucket
+{
+    size_t n, i;
+};
+
+void ffx_bucket_sort(struct ffx_bucket * const B, const size_t cnt);
+
+/*
+ * store the result, @err, of the record at position @i of a batch
+ * into @status, if it's not NULL. since the records may be processed
+ * out of order, @fail tracks the position of the first record that
+ * failed, and @res is set to that record's error
+ */
+static inline
+void ffx_bucket_status(int * const status, const size_t i, const int err,
+                       size_t * const fail, int * const res)
+{
+    if (status) {
+        status[i] = err;
+    }
+    if (err && i < *fail) {
+        *fail = i;
+        *res = err;
+    }
+}
+
 int ffx_ctx_create(void ** const _ctx,
                    const size_t len, const size_t off,
                    const uint8_t * const keybuf, const size_t keylen,
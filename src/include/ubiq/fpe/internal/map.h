@@ -0,0 +1,36 @@
+#ifndef UBIQ_FPE_INTERNAL_MAP_H
+#define UBIQ_FPE_INTERNAL_MAP_H
+
+#include <sys/cdefs.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+__BEGIN_DECLS
+
+/*
+ * returns non-zero if the processor supports the avx2
+ * instructions *and* the library was built with support
+ * for them
+ */
+int ffx_map_avx2_supported(void);
+
+/*
+ * vectorized versions of map_numerals_from_tbl() and
+ * map_numerals_to_tbl() (see bn.h) that translate the @len
+ * characters or numerals of @src through @tbl into @dst, 32 at a
+ * time. @len must be at least 32. ffx_map_avx2_to_num() returns
+ * -EINVAL if any character maps to 0, i.e. is not in the alphabet.
+ * @dst and @src may not overlap. the functions must not be called
+ * unless ffx_map_avx2_supported() returns true
+ */
+int ffx_map_avx2_to_num(uint16_t * const dst,
+                        const char * const src, const size_t len,
+                        const uint8_t tbl[256]);
+void ffx_map_avx2_from_num(char * const dst,
+                           const uint16_t * const src, const size_t len,
+                           const uint8_t tbl[256]);
+
+__END_DECLS
+
+#endif
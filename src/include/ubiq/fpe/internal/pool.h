@@ -0,0 +1,42 @@
+#ifndef UBIQ_FPE_INTERNAL_POOL_H
+#define UBIQ_FPE_INTERNAL_POOL_H
+
+#include <sys/cdefs.h>
+
+#include <stddef.h>
+
+#include <ubiq/fpe/pool.h>
+
+__BEGIN_DECLS
+
+/*
+ * a batch of @cnt records to be processed by the workers of a pool.
+ *
+ * @run is called with ranges, [lo, hi), of the records and returns
+ * 0 or the error for the first record in the range that failed.
+ * each worker that takes part gets @len bytes of private state,
+ * zeroed before the worker's first call to @run, which @run may use
+ * to hold the worker's scratch space and so on across calls. @fini
+ * is called once for each worker's state when the batch is done,
+ * whether or not the worker took part
+ */
+struct ffx_pool_job
+{
+    int (* run)(void * arg, void * state, size_t lo, size_t hi);
+    void (* fini)(void * arg, void * state);
+    void * arg;
+    size_t len;
+};
+
+/*
+ * process the @cnt records of @job in the workers of @pool, returning
+ * when all of them are done. returns 0 if every record succeeded or
+ * the error for the first record that failed. -ENOMEM is returned,
+ * and no records are processed, if the batch can't be set up
+ */
+int ffx_pool_run(struct fpe_pool * const pool,
+                 const struct ffx_pool_job * const job, const size_t cnt);
+
+__END_DECLS
+
+#endif
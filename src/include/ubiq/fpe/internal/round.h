@@ -0,0 +1,53 @@
+#ifndef UBIQ_FPE_INTERNAL_ROUND_H
+#define UBIQ_FPE_INTERNAL_ROUND_H
+
+#include <sys/cdefs.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+__BEGIN_DECLS
+
+/*
+ * vectorized versions of the part of an ff1 round, done with native
+ * integers, that follows the prf (see ff1_native_step() in ff1.c),
+ * for @n texts run in lockstep. for each k < @n:
+ *
+ *   y = NUM(R[k][0:d]) mod m
+ *   A[k], B[k] = B[k], (A[k] + y) mod m        (if @add)
+ *   A[k], B[k] = B[k], (A[k] - y) mod m        (otherwise)
+ *
+ * and the new B[k] is written, big endian, into the @b bytes at
+ * W[k] + @off, ready for the next round.
+ *
+ * @m must be less than 2**32, and A[k] less than @m, so that all of
+ * the values fit into 32 bits. @d must be a multiple of 4, at most
+ * 16, and @b at most 4, which, for ff1, follow from the limit on @m.
+ * @A and @B have room for at least @n values, rounded up to the
+ * number that the function processes at once (4 for avx2, 8 for
+ * avx-512); the values beyond @n are unspecified on return
+ *
+ * ffx_round_avx2_supported() and ffx_round_avx512_supported() return
+ * non-zero if the processor supports the necessary instructions *and*
+ * the library was built with support for them. the corresponding
+ * function must not be called otherwise
+ */
+int ffx_round_avx2_supported(void);
+void ffx_round_avx2_xn(const unsigned int n,
+                       uint64_t * const A, uint64_t * const B,
+                       const uint8_t * const * const R, const unsigned int d,
+                       const uint64_t m, const int add,
+                       uint8_t * const * const W, const size_t off,
+                       const unsigned int b);
+
+int ffx_round_avx512_supported(void);
+void ffx_round_avx512_xn(const unsigned int n,
+                         uint64_t * const A, uint64_t * const B,
+                         const uint8_t * const * const R, const unsigned int d,
+                         const uint64_t m, const int add,
+                         uint8_t * const * const W, const size_t off,
+                         const unsigned int b);
+
+__END_DECLS
+
+#endif
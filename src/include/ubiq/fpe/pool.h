@@ -0,0 +1,52 @@
+#ifndef UBIQ_FPE_POOL_H
+#define UBIQ_FPE_POOL_H
+
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+struct fpe_pool;
+
+/* pin each worker thread to its own processor */
+#define FPE_POOL_PIN    (1 << 0)
+
+/*
+ * Create a pool of worker threads for the parallel batch functions,
+ * for example, ff1_encrypt_batch_mt()
+ *
+ * The records of a batch are divided into chunks, which are spread
+ * evenly over the workers. A worker that finishes its own chunks
+ * takes the remaining chunks of another, so that all of the workers
+ * stay busy until the batch is complete. Each worker keeps its own
+ * scratch space and cipher state for the duration of a batch.
+ *
+ * The pool may be used with any number of contexts, of either
+ * algorithm, and from any number of threads, but it runs only one
+ * batch at a time. A pool used by multiple threads at once runs
+ * their batches one after another.
+ *
+ * @pool: Pointer to location to store pointer to the pool
+ * @nthreads: The number of worker threads. If 0, one thread is
+ *            created for each online processor
+ * @flags: 0 or FPE_POOL_PIN. Worker threads are pinned to the
+ *         processors on which the calling thread is allowed to run,
+ *         one per processor, in order. Pinning is only supported
+ *         on Linux
+ *
+ * @return 0 on success or a negative error number on failure
+ */
+int fpe_pool_create(struct fpe_pool ** const pool,
+                    unsigned int nthreads, const unsigned int flags);
+/*
+ * Destroy a pool of worker threads
+ *
+ * No batch may be running in the pool. Destroying the pool waits for
+ * the worker threads to exit.
+ *
+ * @pool: The pointer returned by the create function
+ */
+void fpe_pool_destroy(struct fpe_pool * const pool);
+
+__END_DECLS
+
+#endif
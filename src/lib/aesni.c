@@ -0,0 +1,384 @@
+#include <ubiq/fpe/internal/aes.h>
+
+#include <openssl/crypto.h>
+
+/*
+ * this file is compiled with the flags necessary to enable the
+ * aes-ni instructions (see lib/CMakeLists.txt). nothing in here
+ * may be called unless ffx_aesni_supported() says that the
+ * processor can execute them.
+ */
+#if defined(__AES__)
+
+#include <wmmintrin.h>
+#include <emmintrin.h>
+
+int ffx_aesni_supported(void)
+{
+    return __builtin_cpu_supports("aes");
+}
+
+/*
+ * the key expansion routines below follow those described
+ * in Intel's "Advanced Encryption Standard (AES) New
+ * Instructions Set" white paper
+ */
+static inline
+__m128i aes_128_assist(__m128i t1, __m128i t2)
+{
+    __m128i t3;
+
+    t2 = _mm_shuffle_epi32(t2, 0xff);
+    t3 = _mm_slli_si128(t1, 4);
+    t1 = _mm_xor_si128(t1, t3);
+    t3 = _mm_slli_si128(t3, 4);
+    t1 = _mm_xor_si128(t1, t3);
+    t3 = _mm_slli_si128(t3, 4);
+    t1 = _mm_xor_si128(t1, t3);
+
+    return _mm_xor_si128(t1, t2);
+}
+
+static
+void aes_128_expand(__m128i * const rk, const uint8_t * const key)
+{
+    __m128i t;
+
+    t = _mm_loadu_si128((const __m128i *)key);
+    rk[0] = t;
+
+    /* the round constant must be an immediate value */
+#define AES_128_ROUND(I, RCON)                                          \
+    t = aes_128_assist(t, _mm_aeskeygenassist_si128(t, RCON));          \
+    rk[I] = t
+
+    AES_128_ROUND(1, 0x01);
+    AES_128_ROUND(2, 0x02);
+    AES_128_ROUND(3, 0x04);
+    AES_128_ROUND(4, 0x08);
+    AES_128_ROUND(5, 0x10);
+    AES_128_ROUND(6, 0x20);
+    AES_128_ROUND(7, 0x40);
+    AES_128_ROUND(8, 0x80);
+    AES_128_ROUND(9, 0x1b);
+    AES_128_ROUND(10, 0x36);
+
+#undef AES_128_ROUND
+}
+
+static inline
+void aes_192_assist(__m128i * const t1, __m128i * const t2, __m128i * const t3)
+{
+    __m128i t4;
+
+    *t2 = _mm_shuffle_epi32(*t2, 0x55);
+    t4 = _mm_slli_si128(*t1, 4);
+    *t1 = _mm_xor_si128(*t1, t4);
+    t4 = _mm_slli_si128(t4, 4);
+    *t1 = _mm_xor_si128(*t1, t4);
+    t4 = _mm_slli_si128(t4, 4);
+    *t1 = _mm_xor_si128(*t1, t4);
+    *t1 = _mm_xor_si128(*t1, *t2);
+    *t2 = _mm_shuffle_epi32(*t1, 0xff);
+    t4 = _mm_slli_si128(*t3, 4);
+    *t3 = _mm_xor_si128(*t3, t4);
+    *t3 = _mm_xor_si128(*t3, *t2);
+}
+
+static inline
+__m128i aes_192_lo(const __m128i a, const __m128i b)
+{
+    return _mm_castpd_si128(
+        _mm_shuffle_pd(_mm_castsi128_pd(a), _mm_castsi128_pd(b), 0));
+}
+
+static inline
+__m128i aes_192_hi(const __m128i a, const __m128i b)
+{
+    return _mm_castpd_si128(
+        _mm_shuffle_pd(_mm_castsi128_pd(a), _mm_castsi128_pd(b), 1));
+}
+
+static
+void aes_192_expand(__m128i * const rk, const uint8_t * const key)
+{
+    __m128i t1, t2, t3;
+
+    /*
+     * only 8 bytes remain after the first block. load them
+     * into the lower half of the register without reading
+     * beyond the end of the key
+     */
+    t1 = _mm_loadu_si128((const __m128i *)key);
+    t3 = _mm_loadl_epi64((const __m128i *)(key + 16));
+
+    rk[0] = t1;
+    rk[1] = t3;
+
+    /*
+     * every 3 round keys are generated from 2 iterations of the
+     * schedule, and the 64-bit halves must be stitched together
+     */
+#define AES_192_STEP(RCON)                                      \
+    t2 = _mm_aeskeygenassist_si128(t3, RCON);                   \
+    aes_192_assist(&t1, &t2, &t3)
+
+    AES_192_STEP(0x01);
+    rk[1] = aes_192_lo(rk[1], t1);
+    rk[2] = aes_192_hi(t1, t3);
+    AES_192_STEP(0x02);
+    rk[3] = t1;
+    rk[4] = t3;
+    AES_192_STEP(0x04);
+    rk[4] = aes_192_lo(rk[4], t1);
+    rk[5] = aes_192_hi(t1, t3);
+    AES_192_STEP(0x08);
+    rk[6] = t1;
+    rk[7] = t3;
+    AES_192_STEP(0x10);
+    rk[7] = aes_192_lo(rk[7], t1);
+    rk[8] = aes_192_hi(t1, t3);
+    AES_192_STEP(0x20);
+    rk[9] = t1;
+    rk[10] = t3;
+    AES_192_STEP(0x40);
+    rk[10] = aes_192_lo(rk[10], t1);
+    rk[11] = aes_192_hi(t1, t3);
+    AES_192_STEP(0x80);
+    rk[12] = t1;
+
+#undef AES_192_STEP
+}
+
+static inline
+__m128i aes_256_assist_1(__m128i t1, __m128i t2)
+{
+    __m128i t4;
+
+    t2 = _mm_shuffle_epi32(t2, 0xff);
+    t4 = _mm_slli_si128(t1, 4);
+    t1 = _mm_xor_si128(t1, t4);
+    t4 = _mm_slli_si128(t4, 4);
+    t1 = _mm_xor_si128(t1, t4);
+    t4 = _mm_slli_si128(t4, 4);
+    t1 = _mm_xor_si128(t1, t4);
+
+    return _mm_xor_si128(t1, t2);
+}
+
+static inline
+__m128i aes_256_assist_2(const __m128i t1, __m128i t3)
+{
+    __m128i t2, t4;
+
+    t4 = _mm_aeskeygenassist_si128(t1, 0x00);
+    t2 = _mm_shuffle_epi32(t4, 0xaa);
+    t4 = _mm_slli_si128(t3, 4);
+    t3 = _mm_xor_si128(t3, t4);
+    t4 = _mm_slli_si128(t4, 4);
+    t3 = _mm_xor_si128(t3, t4);
+    t4 = _mm_slli_si128(t4, 4);
+    t3 = _mm_xor_si128(t3, t4);
+
+    return _mm_xor_si128(t3, t2);
+}
+
+static
+void aes_256_expand(__m128i * const rk, const uint8_t * const key)
+{
+    __m128i t1, t3;
+
+    t1 = _mm_loadu_si128((const __m128i *)key);
+    t3 = _mm_loadu_si128((const __m128i *)(key + 16));
+
+    rk[0] = t1;
+    rk[1] = t3;
+
+#define AES_256_ROUND(I, RCON)                                          \
+    t1 = aes_256_assist_1(t1, _mm_aeskeygenassist_si128(t3, RCON));     \
+    rk[I] = t1;                                                         \
+    t3 = aes_256_assist_2(t1, t3);                                      \
+    rk[I + 1] = t3
+
+    AES_256_ROUND(2, 0x01);
+    AES_256_ROUND(4, 0x02);
+    AES_256_ROUND(6, 0x04);
+    AES_256_ROUND(8, 0x08);
+    AES_256_ROUND(10, 0x10);
+    AES_256_ROUND(12, 0x20);
+
+    /* the last round only needs the first half */
+    t1 = aes_256_assist_1(t1, _mm_aeskeygenassist_si128(t3, 0x40));
+    rk[14] = t1;
+
+#undef AES_256_ROUND
+}
+
+void ffx_aesni_expand(struct ffx_aes * const aes,
+                      const uint8_t * const key, const size_t keylen)
+{
+    __m128i rk[15];
+
+    switch (keylen) {
+    case 16: aes_128_expand(rk, key); aes->nr = 10; break;
+    case 24: aes_192_expand(rk, key); aes->nr = 12; break;
+    case 32: aes_256_expand(rk, key); aes->nr = 14; break;
+    default: aes->nr = 0;                           return;
+    }
+
+    for (unsigned int i = 0; i <= aes->nr; i++) {
+        _mm_storeu_si128((__m128i *)aes->rk[i], rk[i]);
+    }
+
+    OPENSSL_cleanse(rk, sizeof(rk));
+}
+
+void ffx_aesni_cbcmac(const struct ffx_aes * const aes,
+                      uint8_t * const dst, const uint8_t * const iv,
+                      const uint8_t * const src, const size_t len)
+{
+    const unsigned int nr = aes->nr;
+    __m128i rk[15];
+    __m128i c;
+
+    /*
+     * pull the key schedule into locals so that the
+     * compiler can keep it in registers across blocks
+     */
+    for (unsigned int i = 0; i <= nr; i++) {
+        rk[i] = _mm_loadu_si128((const __m128i *)aes->rk[i]);
+    }
+
+    c = _mm_loadu_si128((const __m128i *)iv);
+    for (size_t i = 0; i < len; i += 16) {
+        c = _mm_xor_si128(c, _mm_loadu_si128((const __m128i *)&src[i]));
+
+        c = _mm_xor_si128(c, rk[0]);
+        for (unsigned int j = 1; j < nr; j++) {
+            c = _mm_aesenc_si128(c, rk[j]);
+        }
+        c = _mm_aesenclast_si128(c, rk[nr]);
+    }
+
+    _mm_storeu_si128((__m128i *)dst, c);
+
+    /* the locals may have been spilled to the stack */
+    OPENSSL_cleanse(rk, sizeof(rk));
+}
+
+void ffx_aesni_cbcmac_xn(const struct ffx_aes * const aes,
+                         const unsigned int n,
+                         uint8_t * const * const dst,
+                         const uint8_t * const * const iv,
+                         const uint8_t * const * const src,
+                         const size_t len)
+{
+    const unsigned int nr = aes->nr;
+    __m128i rk[15];
+
+    for (unsigned int i = 0; i <= nr; i++) {
+        rk[i] = _mm_loadu_si128((const __m128i *)aes->rk[i]);
+    }
+
+    /*
+     * the chains are processed 4 at a time. a group of fewer
+     * than 4 repeats its last chain in the unused lanes, and
+     * the results of the repeats are discarded
+     */
+    for (unsigned int g = 0; g < n; g += 4) {
+        const unsigned int l0 = g;
+        const unsigned int l1 = (g + 1 < n) ? g + 1 : n - 1;
+        const unsigned int l2 = (g + 2 < n) ? g + 2 : n - 1;
+        const unsigned int l3 = (g + 3 < n) ? g + 3 : n - 1;
+
+        __m128i c0, c1, c2, c3;
+
+        c0 = _mm_loadu_si128((const __m128i *)iv[l0]);
+        c1 = _mm_loadu_si128((const __m128i *)iv[l1]);
+        c2 = _mm_loadu_si128((const __m128i *)iv[l2]);
+        c3 = _mm_loadu_si128((const __m128i *)iv[l3]);
+
+        for (size_t i = 0; i < len; i += 16) {
+            c0 = _mm_xor_si128(
+                c0, _mm_loadu_si128((const __m128i *)&src[l0][i]));
+            c1 = _mm_xor_si128(
+                c1, _mm_loadu_si128((const __m128i *)&src[l1][i]));
+            c2 = _mm_xor_si128(
+                c2, _mm_loadu_si128((const __m128i *)&src[l2][i]));
+            c3 = _mm_xor_si128(
+                c3, _mm_loadu_si128((const __m128i *)&src[l3][i]));
+
+            c0 = _mm_xor_si128(c0, rk[0]);
+            c1 = _mm_xor_si128(c1, rk[0]);
+            c2 = _mm_xor_si128(c2, rk[0]);
+            c3 = _mm_xor_si128(c3, rk[0]);
+            for (unsigned int j = 1; j < nr; j++) {
+                c0 = _mm_aesenc_si128(c0, rk[j]);
+                c1 = _mm_aesenc_si128(c1, rk[j]);
+                c2 = _mm_aesenc_si128(c2, rk[j]);
+                c3 = _mm_aesenc_si128(c3, rk[j]);
+            }
+            c0 = _mm_aesenclast_si128(c0, rk[nr]);
+            c1 = _mm_aesenclast_si128(c1, rk[nr]);
+            c2 = _mm_aesenclast_si128(c2, rk[nr]);
+            c3 = _mm_aesenclast_si128(c3, rk[nr]);
+        }
+
+        /* a repeated chain just stores the same result again */
+        _mm_storeu_si128((__m128i *)dst[l0], c0);
+        _mm_storeu_si128((__m128i *)dst[l1], c1);
+        _mm_storeu_si128((__m128i *)dst[l2], c2);
+        _mm_storeu_si128((__m128i *)dst[l3], c3);
+    }
+
+    OPENSSL_cleanse(rk, sizeof(rk));
+}
+
+#else
+
+/*
+ * the library was built without aes-ni support (or for a
+ * processor that doesn't have it), so the evp implementation
+ * will be used for everything.
+ */
+int ffx_aesni_supported(void)
+{
+    return 0;
+}
+
+void ffx_aesni_expand(struct ffx_aes * const aes,
+                      const uint8_t * const key, const size_t keylen)
+{
+    (void)key;
+    (void)keylen;
+
+    aes->nr = 0;
+}
+
+void ffx_aesni_cbcmac(const struct ffx_aes * const aes,
+                      uint8_t * const dst, const uint8_t * const iv,
+                      const uint8_t * const src, const size_t len)
+{
+    (void)aes;
+    (void)dst;
+    (void)iv;
+    (void)src;
+    (void)len;
+}
+
+void ffx_aesni_cbcmac_xn(const struct ffx_aes * const aes,
+                         const unsigned int n,
+                         uint8_t * const * const dst,
+                         const uint8_t * const * const iv,
+                         const uint8_t * const * const src,
+                         const size_t len)
+{
+    (void)aes;
+    (void)n;
+    (void)dst;
+    (void)iv;
+    (void)src;
+    (void)len;
+}
+
+#endif
@@ -1,482 +1,863 @@
 #include <ubiq/fpe/internal/bn.h>
+#include <ubiq/fpe/internal/digits.h>
 #include <ubiq/fpe/internal/ffx.h>
+#include <ubiq/fpe/internal/map.h>
 
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistr.h>
 #include <uniwidth.h>
 #include <wchar.h>
 
 /*
- * Convert a numerical value in a given alphabet to a number
+ * Rather than multiplying or dividing a big integer by the radix once
+ * per digit, the conversions below collect as many digits as will fit
+ * into an unsigned long and multiply or divide by the radix raised to
+ * that number of digits. The digits within each word are handled with
+ * native arithmetic.
  *
- * An alphabet consists of single-byte symbols in which each
- * symbol represents the numerical value associated with its
- * index/position in the alphabet. for example, consider the
- * alphabet:
- *   !@#$%^&*()
- * In this alphabet ! occupies index 0 and is therefore
- * assigned that value. @ = 1, # = 2, etc. Furthermore, the
- * alphabet contains 10 characters, so that becomes the radix
- * of the input. Using the alphabet above, an input of @$#
- * translates to a value of 132 (one hundred thirty-two,
- * decimal).
- *
- * If the alphabet above were instead:
- *   !@#$%^&*
- * The radix would be 8 and an input of @$# translates to a
- * value of 90 (ninety, decimal).
- *
- * The function returns 0 or a negative error number
+ * This function returns the number of digits that fit into a word and
+ * sets @rk to the radix raised to that number.
  */
-int __u32_bigint_set_str(bigint_t * const x,
-                     const uint32_t * const str, const uint32_t * const alpha)
+static
+unsigned int __bigint_word_digits(const unsigned long radix,
+                                  unsigned long * const rk)
 {
-    const int len = u32_strlen(str);
+    unsigned long p = radix;
+    unsigned int k = 1;
 
-    /*
-     * the alphabet can be anything and doesn't have
-     * to be in a recognized canonical order. the only
-     * requirement is that every value in the list be
-     * unique. checking that constraint is an expensive
-     * undertaking, so it is assumed. as such, the radix
-     * is simply the number of characters in the alphabet.
-     */
-    const int rad = u32_strlen(alpha);
+    while (radix > 1 && p <= ULONG_MAX / radix) {
+        p *= radix;
+        k++;
+    }
 
-    bigint_t m, a;
-    int i, err;
+    *rk = p;
+    return k;
+}
 
-    /* @n will be the numerical value of @str */
-    bigint_set_ui(x, 0);
+/* @radix raised to the power @k, which must fit into a word */
+static inline
+unsigned long __bigint_word_pow(const unsigned long radix, unsigned int k)
+{
+    unsigned long p = 1;
 
-    /*
-     * @m is a multiplier used to multiply each digit
-     * of the input into its correct position in @n
-     */
-    bigint_init(&m);
-    bigint_set_ui(&m, 1);
+    while (k-- > 0) {
+        p *= radix;
+    }
 
-    /*
-     * @a is a temporary value used
-     * to add each digit into @n
-     */
-    bigint_init(&a);
+    return p;
+}
 
-    err = 0;
-    for (i = 0; i < len; i++) {
-        const uint32_t * pos;
+/*
+ * The big integer library only handles a radix up to 62, so arrays of
+ * numerals are converted here. For short arrays, this is done one
+ * word's worth of digits at a time, which is quadratic in the length
+ * of the array. Longer arrays are split in half (roughly), the halves
+ * are converted recursively, and the results are combined by
+ * multiplying/dividing by a power of the radix. The powers used are
+ * radix**(2**k), which the caller computes ahead of time (see
+ * __bigint_pow_init()) and keeps for as long as it converts arrays
+ * of that length.
+ *
+ * Below this number of digits, the simple method is faster. It also
+ * doesn't need any temporary values, whereas the recursive method
+ * needs one at each level.
+ */
+#define BIGINT_DC_THRESHOLD     64
 
-        /*
-         * determine index/position in the alphabet.
-         * if the character is not present the input
-         * is not valid.
-         */
-        pos = u32_strchr(alpha, str[len - 1 - i]);
-        if (!pos) {
-            err = -EINVAL;
-            break;
+/*
+ * the largest k such that 2**k is less than @len, where @len
+ * is greater than 1. the array is split such that the less
+ * significant part contains 2**k digits
+ */
+static inline
+unsigned int __bigint_dc_split(const size_t len)
+{
+    unsigned int k = 0;
+
+    while (((size_t)2 << k) < len) {
+        k++;
+    }
+
+    return k;
+}
+
+/*
+ * each split of an array of @len digits uses a smaller power than
+ * the one before it, so the powers needed are those up to the one
+ * used by the first split
+ */
+void __bigint_pow_init(struct bigint_pow * const pw,
+                       const size_t len, const size_t radix)
+{
+    pw->cnt = 0;
+
+    if (len > BIGINT_DC_THRESHOLD) {
+        const unsigned int k = __bigint_dc_split(len);
+
+        bigint_init(&pw->pw[0]);
+        bigint_set_ui(&pw->pw[0], radix);
+
+        for (pw->cnt = 1; pw->cnt <= k; pw->cnt++) {
+            bigint_init(&pw->pw[pw->cnt]);
+            bigint_mul(&pw->pw[pw->cnt],
+                       &pw->pw[pw->cnt - 1], &pw->pw[pw->cnt - 1]);
         }
+    }
+}
 
-        /*
-         * multiply the digit into the correct position
-         * and add it to the result
-         */
-        if (pos != alpha) {
-            if (pos - alpha == 1) {
-                bigint_add(x, x, &m);
-            } else {
-                bigint_mul_ui(&a, &m, pos - alpha);
-                bigint_add(x, x, &a);
+void __bigint_pow_deinit(struct bigint_pow * const pw)
+{
+    for (unsigned int k = 0; k < pw->cnt; k++) {
+        bigint_deinit(&pw->pw[k]);
+    }
+    pw->cnt = 0;
+}
+
+/*
+ * convert the @len numerals at @num to an integer,
+ * a word's worth at a time
+ */
+static
+int __bigint_set_digits_words(bigint_t * const x,
+                              const uint16_t * const num, const size_t len,
+                              const size_t radix)
+{
+    unsigned long rk;
+    const unsigned int k = __bigint_word_digits(radix, &rk);
+
+    bigint_set_ui(x, 0);
+
+    for (size_t i = 0; i < len;) {
+        const size_t n = (len - i < k) ? len - i : k;
+        unsigned long w = 0;
+
+        for (size_t j = 0; j < n; j++, i++) {
+            if (num[i] >= radix) {
+                return -EINVAL;
             }
+
+            w = w * radix + num[i];
         }
 
-        bigint_mul_ui(&m, &m, rad);
+        bigint_mul_add_ul(x, x, (n == k) ? rk : __bigint_word_pow(radix, n), w);
     }
 
-    bigint_deinit(&a);
-    bigint_deinit(&m);
-
-    return err;
+    return 0;
 }
 
 /*
- * This function requires str to be pre-allocated and LEN to be large enough
- * to include null terminator.
- * Will return 0 on success and < 0 if there is an error
+ * convert @x to exactly @len numerals, padded on the left with zeros,
+ * a word's worth of digits at a time. @x is left holding the part of
+ * its value that didn't fit, i.e. it is 0 if the conversion was
+ * complete
  */
-int __u32_bigint_get_str(uint32_t * const str, const size_t len,
-                   const uint32_t * const alpha, const bigint_t * const _x)
+static
+void __bigint_get_digits_words(uint16_t * const num, size_t len,
+                               const size_t radix, bigint_t * const x)
 {
-    int debug_flag = 0;
-    const char * const csu = "__u32_bigint_get_str";
-    const int rad = u32_strlen(alpha);
+    unsigned long rk;
+    const unsigned int k = __bigint_word_digits(radix, &rk);
 
-    FPE_DEBUG(debug_flag,printf("%s len(%d) rad(%d) alpha(%S) \n", csu, len, rad, alpha));
-   
-   if (str == NULL) {
-       return -EINVAL;
-   }
+    while (len > 0) {
+        const size_t n = (len < k) ? len : k;
+        unsigned long w;
 
-    bigint_t x;
-    int i;
-    int err = 0;
+        bigint_div_ul(x, &w, x, (n == k) ? rk : __bigint_word_pow(radix, n));
 
-    /*
-     * to convert the numerical value, repeatedly
-     * divide (storing the result and the remainder)
-     * @n by the desired radix of the output.
-     *
-     * the remainder is the current digit; the result
-     * of the division becomes the input to the next
-     * iteration
-     */
+        for (size_t j = 0; j < n; j++) {
+            num[--len] = w % radix;
+            w /= radix;
+        }
+    }
+}
 
-    bigint_init(&x);
-    bigint_mul_ui(&x, _x, 1);
-    i = 0;
+/*
+ * convert @len numerals to an integer. the recursion uses
+ * successively smaller powers, so a split that uses power @k
+ * can keep its temporary in @tmp[k] without interfering with
+ * the splits below it
+ */
+static
+int __bigint_set_digits_dc(bigint_t * const x,
+                           const uint16_t * const num, const size_t len,
+                           const size_t radix,
+                           const bigint_t * const pw, bigint_t * const tmp)
+{
+    int err = 0;
 
-    while (bigint_cmp_si(&x, 0) != 0) {
-        int r;
+    if (len <= BIGINT_DC_THRESHOLD) {
+        err = __bigint_set_digits_words(x, num, len, radix);
+    } else {
+        const unsigned int k = __bigint_dc_split(len);
+        const size_t h = (size_t)1 << k;
 
-        bigint_div_ui(&x, &r, &x, rad);
-        if (i < len) {
-            str[i] = alpha[r];
-        }
-        i++;
-    }
+        bigint_t * const lo = &tmp[k];
 
-    /* handle the case where the initial value was 0 */
-    if (!i) {
-        if (i < len) {
-            str[i] = alpha[0];
+        /* x = hi * radix**h + lo */
+        err = __bigint_set_digits_dc(x, num, len - h, radix, pw, tmp);
+        if (!err) {
+            err = __bigint_set_digits_dc(
+                lo, num + len - h, h, radix, pw, tmp);
+        }
+        if (!err) {
+            bigint_mul(x, x, &pw[k]);
+            bigint_add(x, x, lo);
         }
-        i++;
     }
 
-    // Make sure to set null terminator
-    str[i] = '\0';
-    FPE_DEBUG(debug_flag,wprintf(L"__u32_bigint_get_str str(%S)\n",str));
-    if (i <= len) {
+    return err;
+}
+
+/*
+ * convert @x to exactly @len numerals, padded on the left with zeros.
+ * as with __bigint_get_digits_words(), @x is left holding the part of
+ * its value that didn't fit
+ */
+static
+void __bigint_get_digits_dc(uint16_t * const num, const size_t len,
+                            const size_t radix, bigint_t * const x,
+                            const bigint_t * const pw, bigint_t * const tmp)
+{
+    if (len <= BIGINT_DC_THRESHOLD) {
+        __bigint_get_digits_words(num, len, radix, x);
+    } else {
+        const unsigned int k = __bigint_dc_split(len);
+        const size_t h = (size_t)1 << k;
+
+        bigint_t * const hi = &tmp[k];
+
+        /* hi = x / radix**h, x = x % radix**h */
+        bigint_divmod(hi, x, x, &pw[k]);
+        __bigint_get_digits_dc(num + len - h, h, radix, x, pw, tmp);
+        __bigint_get_digits_dc(num, len - h, radix, hi, pw, tmp);
         /*
-         * to simplify conversion from a numbers to a string,
-         * the output digits are stored in reverse order.
-         * reverse the final value so that the output is correct
+         * copied rather than swapped, so that each of the
+         * integers keeps the storage that it has grown into
          */
-        ffx_revu32(str, str, i);
-    } else {
-        err = -ENOMEM;
+        bigint_set(x, hi);
     }
+}
 
-    bigint_deinit(&x);
+/*
+ * an upper bound on the number of digits needed to represent @x,
+ * which is allowed to be a digit too large to absorb any rounding
+ * in the calculation
+ */
+static inline
+size_t __bigint_digits_max(const bigint_t * const x, const size_t radix)
+{
+    return (size_t)(bigint_sizeinbase(x, 2) / log2(radix)) + 2;
+}
 
-    return err;
+int __bigint_set_num(bigint_t * const x,
+                     const uint16_t * const num, const size_t len,
+                     const size_t radix, const struct bigint_pow * const pw,
+                     bigint_t * const tmp)
+{
+    return __bigint_set_digits_dc(x, num, len, radix, pw->pw, tmp);
+}
+
+int __bigint_get_num_consume(uint16_t * const num, const size_t len,
+                             const size_t radix, bigint_t * const x,
+                             const struct bigint_pow * const pw,
+                             bigint_t * const tmp)
+{
+    /*
+     * only as many numerals as the value could possibly need are
+     * computed. any others are leading zeros
+     */
+    const size_t dig = __bigint_digits_max(x, radix);
+    const size_t n = (dig < len) ? dig : len;
+
+    memset(num, 0, (len - n) * sizeof(*num));
+    __bigint_get_digits_dc(num + len - n, n, radix, x, pw->pw, tmp);
+
+    return bigint_cmp_si(x, 0) ? -EOVERFLOW : 0;
 }
 
 /*
- * Convert a numerical value in a given alphabet to a number
- *
- * An alphabet consists of single-byte symbols in which each
- * symbol represents the numerical value associated with its
- * index/position in the alphabet. for example, consider the
- * alphabet:
- *   !@#$%^&*()
- * In this alphabet ! occupies index 0 and is therefore
- * assigned that value. @ = 1, # = 2, etc. Furthermore, the
- * alphabet contains 10 characters, so that becomes the radix
- * of the input. Using the alphabet above, an input of @$#
- * translates to a value of 132 (one hundred thirty-two,
- * decimal).
- *
- * If the alphabet above were instead:
- *   !@#$%^&*
- * The radix would be 8 and an input of @$# translates to a
- * value of 90 (ninety, decimal).
- *
- * The function returns 0 or a negative error number
+ * decimal and hexadecimal numerals are converted 16 at a time if the
+ * processor supports it (see digits.h). these are, by far, the most
+ * commonly used radixes. @R is the value of the 17th digit, i.e.
+ * radix**16, or 0 if that doesn't fit into 64 bits
  */
-int __bigint_set_str(bigint_t * const x,
-                     const char * const str, const char * const alpha)
+static inline
+int __u64_blk_supported(const size_t radix)
 {
-  static const char * const csu = "__bigint_set_str";
-  int debug_flag = 0;
-  int err = 0;
+    return (radix == 10 || radix == 16) && ffx_digits_supported();
+}
 
-  FPE_DEBUG(debug_flag,printf("START DEBUG %s str(%s)   alpha(%s)\n", csu, str, alpha));
+static inline
+uint64_t __u64_blk_R(const size_t radix)
+{
+    return (radix == 10) ? UINT64_C(10000000000000000) : 0;
+}
 
+/*
+ * convert the last (up to) 16 of @len numerals at @num. shorter
+ * arrays are padded on the left with zeros to fill the block
+ */
+static
+int __u64_blk_get(uint64_t * const x,
+                  const uint16_t * const num, const size_t len,
+                  const size_t radix)
+{
+    const uint16_t * n = num + len - 16;
+    uint16_t blk[16];
 
-  const size_t rad = strlen(alpha);
+    if (len < 16) {
+        memset(blk, 0, (16 - len) * sizeof(*blk));
+        memcpy(blk + 16 - len, num, len * sizeof(*blk));
+        n = blk;
+    }
+
+    return (radix == 10) ?
+        ffx_digits_get_dec16(x, n) : ffx_digits_get_hex16(x, n);
+}
+
+/*
+ * write @x, which must be less than radix**16, as the last (up to)
+ * 16 numerals of @len at @num. returns -EOVERFLOW if @len is less
+ * than 16 and @x doesn't fit
+ */
+static
+int __u64_blk_put(uint16_t * const num, const size_t len,
+                  const size_t radix, const uint64_t x)
+{
+    uint16_t blk[16];
 
-  // Cannot make any assumption about the alpha character set.  Assume that the 
-  // character set does NOT match the expected bignum values.
-  size_t len = strlen(str);
-  char * mapped = calloc(len + 1, sizeof(char));
-  if (mapped == NULL) {
-      err = -ENOMEM;
-  } else {
-      mapped[len] = '\0';
-      FPE_DEBUG(debug_flag,printf("%s set_str (%s)\n", csu, str));
-      err = map_characters(mapped, str, alpha, get_standard_bignum_radix(rad));
-      FPE_DEBUG(debug_flag,printf(" %s mapped (%s)\n", csu, mapped));
-      if (!err) {
-          err = __bigint_set_str_radix(x, mapped, rad);
-          FPE_DEBUG(debug_flag,gmp_printf("%s x %Zd\n", csu, x));
-      }
+    if (radix == 10) {
+        ffx_digits_put_dec16(blk, x);
+    } else {
+        ffx_digits_put_hex16(blk, x);
+    }
 
-  }
-  free(mapped);
+    if (len >= 16) {
+        memcpy(num + len - 16, blk, sizeof(blk));
+    } else {
+        for (size_t i = 0; i < 16 - len; i++) {
+            if (blk[i]) {
+                return -EOVERFLOW;
+            }
+        }
+        memcpy(num, blk + 16 - len, len * sizeof(*blk));
+    }
 
-  FPE_DEBUG(debug_flag,printf("END DEBUG %s err(%d)\n\n", csu, err));
-  return err;
+    return 0;
 }
 
-int __bigint_set_str_radix(bigint_t * const x,
-                     const char * const str, const size_t radix)
+int __u64_set_num(uint64_t * const x,
+                  const uint16_t * const num, const size_t len,
+                  const size_t radix)
 {
-  static const char * const csu = "__bigint_set_str_radix";
-  int debug_flag = 0;
-  int err = 0;
+    uint64_t n = 0;
+    size_t m = len;
+
+    /*
+     * if the value can't overflow, the last 16 numerals are converted
+     * together, and the leading ones, if any, are done below
+     */
+    if (__u64_blk_supported(radix) && len <= 16 + 3 * (radix == 10)) {
+        m = (len > 16) ? len - 16 : 0;
+    }
 
-  FPE_DEBUG(debug_flag,printf("START DEBUG %s str(%s)   radix(%s)\n", csu, str, radix));
+    for (size_t i = 0; i < m; i++) {
+        const uint64_t d = num[i];
 
+        if (d >= radix) {
+            return -EINVAL;
+        }
+        if (n > (UINT64_MAX - d) / radix) {
+            return -EOVERFLOW;
+        }
 
-  if (radix <= 62) {
-      // Assumption that the character set matches valid ranges for 2-62
-      err = bigint_set_str(x, str, radix);
-      FPE_DEBUG(debug_flag,gmp_printf("%s x %Zd\n", csu, x));
-  } else {
-      const int len = strlen(str);
+        n = n * radix + d;
+    }
 
-      // Alphabet is assumed to be \x01 - \xFF meaning the character integer value is related 
-      // the index in the alpha string so we can simply skip that portion of the logic.
+    if (m < len) {
+        uint64_t lo;
 
-      bigint_t m, a;
-      int i;
+        if (__u64_blk_get(&lo, num + m, len - m, radix)) {
+            return -EINVAL;
+        }
 
-      /* @n will be the numerical value of @str */
-      bigint_set_ui(x, 0);
+        n = n * __u64_blk_R(radix) + lo;
+    }
 
-      /*
-      * @m is a multiplier used to multiply each digit
-      * of the input into its correct position in @n
-      */
-      bigint_init(&m);
-      bigint_set_ui(&m, 1);
+    *x = n;
+    return 0;
+}
 
-      /*
-      * @a is a temporary value used
-      * to add each digit into @n
-      */
-      bigint_init(&a);
+int __u64_get_num(uint16_t * const num, const size_t len,
+                  const size_t radix, uint64_t x)
+{
+    size_t m = len;
 
-      for (i = 0; i < len; i++) {
-          size_t pos;
+    if (__u64_blk_supported(radix)) {
+        const uint64_t R = __u64_blk_R(radix);
 
-          /*
-          * determine index/position in the alphabet.
-          * if the character is not present the input
-          * is not valid.
-          */
-          pos = ((uint8_t)str[len - 1 - i]); // values 1 - 255 since we don't support 0 (null terminator)
+        if (__u64_blk_put(num, len, radix, R ? x % R : x)) {
+            return -EOVERFLOW;
+        }
 
-      /*
-        * multiply the digit into the correct position
-        * and add it to the result
-        */
-          bigint_mul_ui(&a, &m, pos - 1); // 0 - 254 (radix 255)
-          bigint_add(x, x, &a);
+        x = R ? x / R : 0;
+        m = (len > 16) ? len - 16 : 0;
+    }
 
-          bigint_mul_ui(&m, &m, radix);
-      }
+    /* fill from the right; the remaining places are zeros */
+    for (size_t i = m; i > 0; i--) {
+        num[i - 1] = x % radix;
+        x /= radix;
+    }
 
-      bigint_deinit(&a);
-      bigint_deinit(&m);
-  }
-  FPE_DEBUG(debug_flag,printf("END DEBUG %s err(%d)\n\n", csu, err));
-  return err;
+    return x ? -EOVERFLOW : 0;
 }
 
-/*
- * This function returns the number of bytes (that would have been)
- * written to the output string (if the length of the available space
- * is sufficient). not including a nul terminator. A nul terminator
- * is never written. In short, success is determined by the return value
- * being less than or equal to @len.
- */
-int __bigint_get_str(char * const str, const size_t len,
-                     const char * const alpha, const bigint_t * const _x)
+/* the number of bits in a digit of @radix, a power of 2 */
+static inline
+unsigned int __pow2_bits(const size_t radix)
 {
+    unsigned int k = 0;
 
-  static const char * const csu = "__bigint_get_str";
-  int debug_flag = 0;
-  const size_t rad = strlen(alpha);
-  int err = 0;
+    while (((size_t)1 << k) < radix) {
+        k++;
+    }
 
-  FPE_DEBUG(debug_flag,printf("START DEBUG %s rad(%d)\n", csu, rad));
+    return k;
+}
 
-  FPE_DEBUG(debug_flag,printf("DEBUG %s len(%d)\n", csu, len));
-  FPE_DEBUG(debug_flag,printf("DEBUG %s alpha(%s)\n", csu, alpha));
-  err = __bigint_get_str_radix(str, len, rad, _x);
-  FPE_DEBUG(debug_flag,gmp_printf("__bigint_get_str   _x %Zd\n", _x));
-  if (!err) {
-      err = map_characters(str, str, get_standard_bignum_radix(rad), alpha);
-  }
+int __bytes_set_num_pow2(uint8_t * const x, const size_t n,
+                         const uint16_t * const num, const size_t len,
+                         const size_t radix)
+{
+    const unsigned int k = __pow2_bits(radix);
 
-  FPE_DEBUG(debug_flag,printf("DEBUG %s err(%d)\n", csu, err));
-  FPE_DEBUG(debug_flag,printf("DEBUG %s s(%s)\n", csu, str));
-  return err;
+    /*
+     * the numerals are shifted into @acc from the least significant
+     * end of the array, and whole bytes are shifted out of it into
+     * @x from the least significant (last) byte toward the first. a
+     * numeral can be as wide as 16 bits, so more than a byte may be
+     * shifted out at a time
+     */
+    unsigned long acc = 0;
+    unsigned int bits = 0;
+    size_t j = n;
+
+    for (size_t i = len; i > 0; i--) {
+        if (num[i - 1] >= radix) {
+            return -EINVAL;
+        }
+
+        acc |= (unsigned long)num[i - 1] << bits;
+        bits += k;
+
+        while (bits >= 8) {
+            if (j == 0) {
+                return -EOVERFLOW;
+            }
+            x[--j] = acc;
+            acc >>= 8;
+            bits -= 8;
+        }
+    }
+
+    if (bits && acc) {
+        if (j == 0) {
+            return -EOVERFLOW;
+        }
+        x[--j] = acc;
+    }
+
+    memset(x, 0, j);
+
+    return 0;
 }
 
-int __bigint_get_str_radix(char * const str, const size_t len,
-                     const size_t radix, const bigint_t * const _x)
+void __bytes_get_num_pow2(uint16_t * const num, const size_t len,
+                          const size_t radix,
+                          const uint8_t * const x, const size_t n)
 {
+    const unsigned int k = __pow2_bits(radix);
+
+    unsigned long acc = 0;
+    unsigned int bits = 0;
+    size_t j = n;
 
-  static const char * const csu = "__bigint_get_str_radix";
-  int debug_flag = 0;
-  int err = 0;
+    /* the reverse of the above */
+    for (size_t i = len; i > 0; i--) {
+        while (bits < k) {
+            if (j > 0) {
+                acc |= (unsigned long)x[--j] << bits;
+            }
+            bits += 8;
+        }
 
-  FPE_DEBUG(debug_flag,printf("START FPE_DEBUG %s rad(%d)\n", csu, radix));
+        num[i - 1] = acc & (radix - 1);
+        acc >>= k;
+        bits -= k;
+    }
+}
 
-  if (radix <= 62) {
+#if defined(__SIZEOF_INT128__)
+/* reverse the order of @len numerals, which may be at most 32 */
+static inline
+void __num_rev32(uint16_t * const dst, const uint16_t * const src,
+                 const size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        dst[i] = src[len - 1 - i];
+    }
+}
 
-    err = bigint_get_str(str, len, radix, _x);
+int __u128_set_rnum(unsigned __int128 * const x,
+                    const uint16_t * const num, const size_t len,
+                    const size_t radix)
+{
+    const unsigned __int128 max = ~(unsigned __int128)0;
+    unsigned __int128 n = 0;
 
-  } else {
-    const char * const alpha = get_standard_bignum_radix(radix);
-    bigint_t x;
-    int i = 0;
     /*
-     * to convert the numerical value, repeatedly
-     * divide (storing the result and the remainder)
-     * @n by the desired radix of the output.
-     *
-     * the remainder is the current digit; the result
-     * of the division becomes the input to the next
-     * iteration
+     * up to 32 numerals can be converted as two blocks, in normal
+     * order, without any possibility of overflow
      */
+    if (__u64_blk_supported(radix) && len <= 32) {
+        const size_t m = (len > 16) ? len - 16 : 0;
+        const uint64_t R = __u64_blk_R(radix);
 
-    bigint_init(&x);
-    bigint_mul_ui(&x, _x, 1);
+        uint16_t rev[32];
+        uint64_t hi = 0, lo;
 
-    while (bigint_cmp_si(&x, 0) != 0) {
-        int r;
-
-        bigint_div_ui(&x, &r, &x, radix);
-        if (i < len) {
-            str[i] = alpha[r];
+        __num_rev32(rev, num, len);
+        if ((m && __u64_blk_get(&hi, rev, m, radix)) ||
+            __u64_blk_get(&lo, rev + m, len - m, radix)) {
+            return -EINVAL;
         }
-        i++;
+
+        *x = (R ? (unsigned __int128)hi * R : (unsigned __int128)hi << 64) + lo;
+        return 0;
     }
 
-    /* handle the case where the initial value was 0 */
-    if (!i) {
-        if (i < len) {
-            str[i] = alpha[0];
+    for (size_t i = len; i > 0; i--) {
+        const unsigned int d = num[i - 1];
+
+        if (d >= radix) {
+            return -EINVAL;
+        }
+        if (n > (max - d) / radix) {
+            return -EOVERFLOW;
         }
-        i++;
+
+        n = n * radix + d;
     }
-    // Make sure to set null terminator
-    str[i] = '\0';
-    if (i <= len) {
-        /*
-         * to simplify conversion from a number to a string,
-         * the output digits are stored in reverse order.
-         * reverse the final value so that the output is correct
-         */
-        ffx_revb(str, str, i);
+
+    *x = n;
+    return 0;
+}
+
+int __u128_get_rnum(uint16_t * const num, const size_t len,
+                    const size_t radix, unsigned __int128 x)
+{
+    if (__u64_blk_supported(radix) && len <= 32) {
+        const size_t m = (len > 16) ? len - 16 : 0;
+        const uint64_t R = __u64_blk_R(radix);
+        const unsigned __int128 hi = R ? x / R : x >> 64;
+
+        uint16_t blk[32];
+
+        /* the upper block must also fit into 16 numerals */
+        if ((R && hi >= R) ||
+            __u64_blk_put(blk, m, radix, (uint64_t)hi) ||
+            __u64_blk_put(blk + m, len - m, radix, (uint64_t)(R ? x % R : x))) {
+            return -EOVERFLOW;
+        }
+
+        __num_rev32(num, blk, len);
+        return 0;
     }
-    FPE_DEBUG(debug_flag,printf("DEBUG %s s(%s)\n", csu, str));
 
-    bigint_deinit(&x);
-    FPE_DEBUG(debug_flag,printf("DEBUG %s ret(%d)\n", csu, i));
-    if (!err && i > len) {
-        err = -ENOMEM;
+    /* least significant numeral first */
+    for (size_t i = 0; i < len; i++) {
+        num[i] = x % radix;
+        x /= radix;
     }
-  }
-  FPE_DEBUG(debug_flag,printf("END DEBUG %s err(%d) str(%s) \n\n", csu, err, str));
-  return err;
 
+    return x ? -EOVERFLOW : 0;
 }
+#endif
+
+void map_numerals_tbl_init(uint8_t in[256], uint8_t out[256],
+    const char * const alpha, const size_t radix, const int nocase)
+{
+    memset(in, 0, 256);
+    memset(out, 0, 256);
+
+    for (size_t i = 0; i < radix; i++) {
+        const uint8_t c = alpha[i];
 
-/* dst already exists and has null terminator */
+        /* the first occurrence of a repeated character wins */
+        if (!in[c]) {
+            in[c] = i + 1;
+        }
+        if (nocase && c >= 'a' && c <= 'z' && !in[c - 'a' + 'A']) {
+            in[c - 'a' + 'A'] = i + 1;
+        }
 
-int map_characters(char * const dst, const char * const src,
-    const char * const src_chars,
-    const char * const dst_chars) 
+        out[i] = c;
+    }
+}
+
+int map_numerals_from_tbl(uint16_t * const dst,
+    const char * const src, const size_t len,
+    const uint8_t tbl[256])
 {
-    const char * const csu = "map_characters";
-    int debug_flag = 0;
+    /*
+     * the vectorized version needs at least one full block, and
+     * it only pulls ahead of the simple loop after a couple
+     */
+    if (len >= 64 && ffx_map_avx2_supported()) {
+        return ffx_map_avx2_to_num(dst, src, len, tbl);
+    }
 
-    FPE_DEBUG(debug_flag,printf("%s src(%s) strlen(%d) src_chars (%s) len(%d) dst_chars(%s)\n", csu, src, strlen(src), src_chars, strlen(src_chars), dst_chars));
+    for (size_t i = 0; i < len; i++) {
+        const uint8_t d = tbl[(uint8_t)src[i]];
 
-    size_t len = strlen(src);
-    for (int i = 0; i < len; i++) {
-        char * pos = strchr(src_chars, src[i]);
-        FPE_DEBUG(debug_flag,printf("%s %d %c\n", csu, i, *pos));
-        if (!pos) {
-            FPE_DEBUG(debug_flag,printf("Unable to find %c \n", src[i]));
+        if (!d) {
             return -EINVAL;
         }
-        FPE_DEBUG(debug_flag,printf("%s %d %c\n", csu, i, *pos));
-        dst[i] = dst_chars[pos - src_chars];
+        dst[i] = d - 1;
     }
-    FPE_DEBUG(debug_flag,printf("%s dst(%s)\n", csu, dst));
+
     return 0;
 }
 
-int map_characters_from_u32(char * const dst, const uint8_t * const src,
-    const uint32_t * const src_chars,
-    const char * const dst_chars) 
+void map_numerals_to_tbl(char * const dst,
+    const uint16_t * const src, const size_t len,
+    const uint8_t tbl[256])
 {
-    int debug_flag = 0;
-    uint32_t * tmp = NULL;
-    size_t src_len = 0;
+    if (len >= 64 && ffx_map_avx2_supported()) {
+        ffx_map_avx2_from_num(dst, src, len, tbl);
+        return;
+    }
 
-    FPE_DEBUG(debug_flag,printf("src_chars (%S) len(%d)\n", src_chars, u32_strlen(src_chars)));
-    tmp = u8_to_u32(src, u8_strlen(src) + 1, NULL, &src_len);
-    FPE_DEBUG(debug_flag,printf("tmp (%S) len(%d) src_len(%d)\n", tmp, u32_strlen(tmp), src_len));
+    for (size_t i = 0; i < len; i++) {
+        dst[i] = tbl[src[i]];
+    }
+}
+
+static inline
+unsigned int map_u8_hash(const uint32_t uc, const unsigned int bits)
+{
+    return (uint32_t)(uc * 0x9e3779b1u) >> (32 - bits);
+}
 
-    for (int i = 0; i < src_len - 1; i++) {
-        uint32_t * pos = u32_strchr(src_chars, tmp[i]);
-        if (!pos) {
-            FPE_DEBUG(debug_flag,printf("Unable to find %c \n", src[i]));
-            free(tmp);
+/*
+ * decode the utf-8 character at @s, storing its code point in @uc.
+ * returns the number of bytes in the encoding or 0 if the encoding
+ * is not valid or would extend beyond the @avail bytes at @s
+ */
+static inline
+unsigned int map_u8_decode(const uint8_t * const s, const size_t avail,
+                           uint32_t * const uc)
+{
+    static const uint32_t min[] = { 0, 0, 0x80, 0x800, 0x10000 };
+    unsigned int len;
+    uint32_t c;
+
+    if (s[0] < 0x80) {
+        *uc = s[0];
+        return 1;
+    } else if (s[0] < 0xc0) {
+        return 0;
+    } else if (s[0] < 0xe0) {
+        len = 2;
+        c = s[0] & 0x1f;
+    } else if (s[0] < 0xf0) {
+        len = 3;
+        c = s[0] & 0x0f;
+    } else if (s[0] < 0xf8) {
+        len = 4;
+        c = s[0] & 0x07;
+    } else {
+        return 0;
+    }
+
+    if (len > avail) {
+        return 0;
+    }
+
+    for (unsigned int i = 1; i < len; i++) {
+        if ((s[i] & 0xc0) != 0x80) {
+            return 0;
+        }
+        c = (c << 6) | (s[i] & 0x3f);
+    }
+
+    /* overlong encodings, surrogates, and out of range */
+    if (c < min[len] ||
+        (c >= 0xd800 && c <= 0xdfff) ||
+        c > 0x10ffff) {
+        return 0;
+    }
+
+    *uc = c;
+    return len;
+}
+
+static inline
+unsigned int map_u8_encode(uint8_t * const s, const uint32_t uc)
+{
+    if (uc < 0x80) {
+        s[0] = uc;
+        return 1;
+    } else if (uc < 0x800) {
+        s[0] = 0xc0 | (uc >> 6);
+        s[1] = 0x80 | (uc & 0x3f);
+        return 2;
+    } else if (uc < 0x10000) {
+        s[0] = 0xe0 | (uc >> 12);
+        s[1] = 0x80 | ((uc >> 6) & 0x3f);
+        s[2] = 0x80 | (uc & 0x3f);
+        return 3;
+    }
+
+    s[0] = 0xf0 | (uc >> 18);
+    s[1] = 0x80 | ((uc >> 12) & 0x3f);
+    s[2] = 0x80 | ((uc >> 6) & 0x3f);
+    s[3] = 0x80 | (uc & 0x3f);
+    return 4;
+}
+
+/*
+ * the table has at least twice as many slots as there are
+ * characters in the alphabet, which keeps the probe sequences short
+ */
+int map_numerals_u8_tbl_init(struct map_u8_tbl * const tbl,
+    const uint32_t * const u32_chars)
+{
+    size_t radix = 0, slots;
+
+    while (u32_chars[radix]) {
+        radix++;
+    }
+    if (radix < 2 || radix > 65536) {
+        return -EINVAL;
+    }
+
+    tbl->radix = radix;
+    for (tbl->bits = 1; ((size_t)1 << tbl->bits) < 2 * radix; tbl->bits++) {
+    }
+    slots = (size_t)1 << tbl->bits;
+
+    tbl->in = malloc(slots * sizeof(*tbl->in));
+    tbl->out = malloc(radix * sizeof(*tbl->out));
+    if (!tbl->in || !tbl->out) {
+        map_numerals_u8_tbl_deinit(tbl);
+        return -ENOMEM;
+    }
+
+    for (size_t h = 0; h < slots; h++) {
+        tbl->in[h].uc = MAP_U8_EMPTY;
+    }
+
+    tbl->minlen = 4;
+    tbl->maxlen = 1;
+
+    for (size_t i = 0; i < radix; i++) {
+        unsigned int h;
+
+        if (u32_chars[i] > 0x10ffff) {
+            map_numerals_u8_tbl_deinit(tbl);
             return -EINVAL;
         }
-        dst[i] = dst_chars[pos - src_chars];
+
+        /*
+         * as with u32_strchr(), the first occurrence
+         * of a repeated character determines its value
+         */
+        for (h = map_u8_hash(u32_chars[i], tbl->bits);
+             tbl->in[h].uc != MAP_U8_EMPTY && tbl->in[h].uc != u32_chars[i];
+             h = (h + 1) & (slots - 1)) {
+        }
+        if (tbl->in[h].uc == MAP_U8_EMPTY) {
+            tbl->in[h].uc = u32_chars[i];
+            tbl->in[h].d = i;
+        }
+
+        tbl->out[i].len = map_u8_encode(tbl->out[i].s, u32_chars[i]);
+        if (tbl->out[i].len < tbl->minlen) {
+            tbl->minlen = tbl->out[i].len;
+        }
+        if (tbl->out[i].len > tbl->maxlen) {
+            tbl->maxlen = tbl->out[i].len;
+        }
     }
-    free(tmp);
+
     return 0;
 }
 
-int map_characters_to_u32(uint8_t * const dst, const char * const src,
-    const char * const src_chars,
-    const uint32_t * const dst_chars) 
+void map_numerals_u8_tbl_deinit(struct map_u8_tbl * const tbl)
 {
-    int res = 0;
-    int debug_flag = 0;
-    size_t src_len = strlen(src);
-    uint32_t * tmp = calloc(src_len + 1, sizeof(uint32_t));
+    free(tbl->in);
+    free(tbl->out);
+    tbl->in = NULL;
+    tbl->out = NULL;
+}
+
+int map_numerals_from_u8_tbl(uint16_t * const dst, size_t * const n,
+    const uint8_t * const src,
+    const struct map_u8_tbl * const tbl)
+{
+    const unsigned int mask = (1u << tbl->bits) - 1;
+    size_t i, j;
+
+    for (i = 0, j = 0; i < *n; j++) {
+        uint32_t uc;
+        unsigned int len, h;
 
-    FPE_DEBUG(debug_flag,printf("dst_chars (%S) len(%d)\n", dst_chars, u32_strlen(dst_chars)));
+        len = map_u8_decode(&src[i], *n - i, &uc);
+        if (!len) {
+            return -EINVAL;
+        }
+        i += len;
 
-    for (int i = 0; i < src_len ; i++) {
-        char * pos = strchr(src_chars, src[i]);
-        if (!pos) {
-            FPE_DEBUG(debug_flag,printf("Unable to find %c \n", src[i]));
-            free(tmp);
+        for (h = map_u8_hash(uc, tbl->bits);
+             tbl->in[h].uc != MAP_U8_EMPTY && tbl->in[h].uc != uc;
+             h = (h + 1) & mask) {
+        }
+        if (tbl->in[h].uc == MAP_U8_EMPTY) {
             return -EINVAL;
         }
-        tmp[i] = dst_chars[pos - src_chars];
+
+        dst[j] = tbl->in[h].d;
     }
-    uint8_t * x = u32_to_u8(tmp, src_len + 1, NULL, &src_len);
-    if (x) {
-        strcpy(dst, x);
-        free(x);
-    } else {
-        res = -ENOMEM;
+
+    *n = j;
+    return 0;
+}
+
+int map_numerals_to_u8_tbl(uint8_t * const dst, size_t * const len,
+    const uint16_t * const src, const size_t n,
+    const struct map_u8_tbl * const tbl)
+{
+    size_t j = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        if (src[i] >= tbl->radix) {
+            return -EINVAL;
+        }
+        if (*len - j < tbl->out[src[i]].len) {
+            return -ENOSPC;
+        }
+
+        memcpy(dst + j, tbl->out[src[i]].s, tbl->out[src[i]].len);
+        j += tbl->out[src[i]].len;
     }
-    free(tmp);
-    return res;
+
+    *len = j;
+    return 0;
 }
 
 const char * get_standard_bignum_radix(
@@ -510,5 +891,12 @@ const char * get_standard_bignum_radix(
     if (radix <= 62) {
         return radix62;
     }
+    /*
+     * there are no standard characters for a larger radix.
+     * texts in such a radix can only be handled as numerals
+     */
+    if (radix > 255) {
+        return NULL;
+    }
     return radix255;
 }
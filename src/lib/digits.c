@@ -0,0 +1,189 @@
+#include <ubiq/fpe/internal/digits.h>
+
+#include <errno.h>
+
+/*
+ * this file is compiled with the flags necessary to enable the
+ * sse4.1 instructions (see lib/CMakeLists.txt). nothing in here
+ * may be called unless ffx_digits_supported() says that the
+ * processor can execute them.
+ */
+#if defined(__SSE4_1__) && defined(__x86_64__)
+
+#include <smmintrin.h>
+
+int ffx_digits_supported(void)
+{
+    return __builtin_cpu_supports("sse4.1");
+}
+
+/*
+ * combine 16 decimal digit values (0 - 9), most significant
+ * first, into an integer. pairs of digits are combined into
+ * 16-bit values, then those into 4-digit, 32-bit values, and
+ * finally into two 8-digit values
+ */
+static inline
+uint64_t dec16_combine(const __m128i d)
+{
+    const __m128i t1 = _mm_maddubs_epi16(
+        d, _mm_set_epi8(1, 10, 1, 10, 1, 10, 1, 10,
+                        1, 10, 1, 10, 1, 10, 1, 10));
+    const __m128i t2 = _mm_madd_epi16(
+        t1, _mm_set_epi16(1, 100, 1, 100, 1, 100, 1, 100));
+    const __m128i t3 = _mm_packus_epi32(t2, t2);
+    const __m128i t4 = _mm_madd_epi16(
+        t3, _mm_set_epi16(1, 10000, 1, 10000, 1, 10000, 1, 10000));
+
+    return (uint64_t)(uint32_t)_mm_cvtsi128_si32(t4) * 100000000 +
+        (uint32_t)_mm_extract_epi32(t4, 1);
+}
+
+/*
+ * load 16 numerals as bytes. a numeral larger than 255 becomes
+ * 255, which is invalid in either radix. the pack saturates
+ * signed values, so the numerals are limited, unsigned, first
+ */
+static inline
+__m128i num16_load(const uint16_t * const num)
+{
+    const __m128i max = _mm_set1_epi16(0xff);
+
+    return _mm_packus_epi16(
+        _mm_min_epu16(_mm_loadu_si128((const __m128i *)num), max),
+        _mm_min_epu16(_mm_loadu_si128((const __m128i *)(num + 8)), max));
+}
+
+/* every byte must be between 0 and @max, unsigned */
+static inline
+int num16_valid(const __m128i d, const char max)
+{
+    return _mm_movemask_epi8(
+        _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(max)), d)) == 0xffff;
+}
+
+int ffx_digits_get_dec16(uint64_t * const x, const uint16_t * const num)
+{
+    const __m128i d = num16_load(num);
+
+    if (!num16_valid(d, 9)) {
+        return -EINVAL;
+    }
+
+    *x = dec16_combine(d);
+    return 0;
+}
+
+int ffx_digits_get_hex16(uint64_t * const x, const uint16_t * const num)
+{
+    __m128i v = num16_load(num);
+
+    if (!num16_valid(v, 15)) {
+        return -EINVAL;
+    }
+
+    /* pairs of digits become bytes, most significant first */
+    v = _mm_maddubs_epi16(v, _mm_set1_epi16(0x0110));
+    v = _mm_packus_epi16(v, v);
+
+    *x = __builtin_bswap64((uint64_t)_mm_cvtsi128_si64(v));
+    return 0;
+}
+
+/*
+ * split @x, which must be less than 10**8, into its digits, one
+ * per 16-bit lane, most significant first. the divisions are
+ * done by multiplying by fixed point reciprocals
+ */
+static inline
+__m128i dec8_split(const uint32_t x)
+{
+    const __m128i v = _mm_cvtsi32_si128(x);
+
+    /* abcd = x / 10000, efgh = x % 10000 */
+    const __m128i abcd = _mm_srli_epi64(
+        _mm_mul_epu32(v, _mm_set1_epi32(0xd1b71759)), 45);
+    const __m128i efgh = _mm_sub_epi32(
+        v, _mm_mul_epu32(abcd, _mm_set1_epi32(10000)));
+
+    /* [ abcd * 4 ] x 4, [ efgh * 4 ] x 4 */
+    const __m128i v1 = _mm_slli_epi64(_mm_unpacklo_epi16(abcd, efgh), 2);
+    const __m128i v2a = _mm_unpacklo_epi16(v1, v1);
+    const __m128i v2 = _mm_unpacklo_epi32(v2a, v2a);
+
+    /* [ a, ab, abc, abcd, e, ef, efg, efgh ] */
+    const __m128i v3 = _mm_mulhi_epu16(
+        v2, _mm_set_epi16((short)0x8000, 13108, 5243, 8389,
+                          (short)0x8000, 13108, 5243, 8389));
+    const __m128i v4 = _mm_mulhi_epu16(
+        v3, _mm_set_epi16((short)0x8000, 1 << 13, 1 << 11, 1 << 7,
+                          (short)0x8000, 1 << 13, 1 << 11, 1 << 7));
+
+    /* subtract 10 times the preceding lane: [ a, b, c, ... ] */
+    const __m128i v5 = _mm_slli_epi64(
+        _mm_mullo_epi16(v4, _mm_set1_epi16(10)), 16);
+
+    return _mm_sub_epi16(v4, v5);
+}
+
+void ffx_digits_put_dec16(uint16_t * const num, const uint64_t x)
+{
+    _mm_storeu_si128((__m128i *)num, dec8_split(x / 100000000));
+    _mm_storeu_si128((__m128i *)(num + 8), dec8_split(x % 100000000));
+}
+
+void ffx_digits_put_hex16(uint16_t * const num, const uint64_t x)
+{
+    const __m128i b = _mm_cvtsi64_si128((long long)__builtin_bswap64(x));
+    const __m128i m = _mm_set1_epi8(0x0f);
+
+    /* split each byte into two nibbles, most significant first */
+    const __m128i n = _mm_unpacklo_epi8(
+        _mm_and_si128(_mm_srli_epi16(b, 4), m), _mm_and_si128(b, m));
+
+    _mm_storeu_si128((__m128i *)num, _mm_cvtepu8_epi16(n));
+    _mm_storeu_si128((__m128i *)(num + 8),
+                     _mm_cvtepu8_epi16(_mm_srli_si128(n, 8)));
+}
+
+#else
+
+/*
+ * the library was built without sse4.1 support (or for a
+ * processor that doesn't have it), so numerals are converted
+ * one at a time.
+ */
+int ffx_digits_supported(void)
+{
+    return 0;
+}
+
+int ffx_digits_get_dec16(uint64_t * const x, const uint16_t * const num)
+{
+    (void)x;
+    (void)num;
+
+    return -EINVAL;
+}
+
+int ffx_digits_get_hex16(uint64_t * const x, const uint16_t * const num)
+{
+    (void)x;
+    (void)num;
+
+    return -EINVAL;
+}
+
+void ffx_digits_put_dec16(uint16_t * const num, const uint64_t x)
+{
+    (void)num;
+    (void)x;
+}
+
+void ffx_digits_put_hex16(uint16_t * const num, const uint64_t x)
+{
+    (void)num;
+    (void)x;
+}
+
+#endif
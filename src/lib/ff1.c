@@ -1,10 +1,9 @@
 #include <ubiq/fpe/ff1.h>
 #include <ubiq/fpe/internal/ffx.h>
+#include <ubiq/fpe/internal/pool.h>
 
 #include <arpa/inet.h>
 #include <stdlib.h>
-#include <math.h>
-#include <unistr.h>
 
 struct ff1_ctx
 {
@@ -85,205 +84,286 @@ void ff1_ctx_destroy(struct ff1_ctx * const ctx)
 }
 
 /*
- * The comments below reference the steps of the algorithm described here:
+ * the number of bytes in Q for a tweak of @t bytes and
+ * a numeral string of @b bytes (Step 6i)
+ */
+static inline
+unsigned int ff1_qlen(const size_t t, const unsigned int b)
+{
+    return ((t + b + 1 + 15) / 16) * 16;
+}
+
+/*
+ * Fill in the parts of P || Q (Steps 5 and 6i) that are the same
+ * in every round, and run the prf over the leading blocks of P || Q
+ * that consist only of those parts. The chaining value that results
+ * is stored in @C, and the number of bytes of P || Q covered by it
+ * is returned. Each round then continues the chain over the rest.
  *
- * https://nvlpubs.nist.gov/nistpubs/SpecialPublications/NIST.SP.800-38Gr1-draft.pdf
+ * @PQ must point to 16 + ff1_qlen(t, b) bytes
  */
 static
-int ff1_cipher(struct ff1_ctx * const ctx,
-               char * const Y,
-               const char * const _X,
-               const uint8_t * T, size_t t,
-               const int encrypt)
+unsigned int ff1_prf_prefix(struct ff1_ctx * const ctx,
+                            struct ffx_ws * const ws,
+                            uint8_t * const PQ, uint8_t * const C,
+                            const unsigned int n, const unsigned int b,
+                            const uint8_t * const T, const size_t t)
 {
-    const char * csu = "ff1_cipher";
-    int debug_flag = 0;
+    const unsigned int u = n / 2;
+    const unsigned int p = 16, q = ff1_qlen(t, b);
 
-    // Input character set may be non-standard or even UTF8.
+    uint8_t * const P = PQ;
+    uint8_t * const Q = PQ + p;
 
-    // Since we know the radix and custom radix character sets,
-    // We are going to map X to a standardized character set NOW, as long as radix is <= 255
-    
-    // We then convert back to the custom radix at the end.
-    // If radix <= 62, we can use built in big number processing, otherwise we need to use the radix mapping string
+    unsigned int k;
 
-    char * X = NULL;
+    /* Step 5 */
+    P[0] = 1;
+    P[1] = 2;
+    P[2] = 1;
+    P[3] = ctx->ffx.radix >> 16;
+    P[4] = ctx->ffx.radix >> 8;
+    P[5] = ctx->ffx.radix;
+    P[6] = 10;
+    P[7] = u;
+    *(uint32_t *)&P[8]  = htonl(n);
+    *(uint32_t *)&P[12] = htonl(t);
 
-    if (ctx->ffx.custom_radix_str) {
-        X = calloc(strlen(_X) + 1, sizeof(char));
-        map_characters(X, _X, ctx->ffx.custom_radix_str, get_standard_bignum_radix(ctx->ffx.radix));
-        FPE_DEBUG(debug_flag,printf("%s _X(%s) X(%s) radix(%s) std(%s) \n", csu, _X, X, ctx->ffx.custom_radix_str, get_standard_bignum_radix(ctx->ffx.radix)));
-    } else if (ctx->ffx.u32_custom_radix_str) {
-        X = calloc(u8_mbsnlen(_X, strlen(_X) + 1), sizeof(char));
-        map_characters_from_u32(X, _X, ctx->ffx.u32_custom_radix_str, get_standard_bignum_radix(ctx->ffx.radix));
-    } else {
-       X = strdup(_X);
+    /*
+     * Step 6i, partial
+     * these parts of @Q are static
+     */
+    memcpy(Q, T, t);
+    memset(Q + t, 0, q - (t + b + 1));
 
-    }
+    /*
+     * only the last b + 1 bytes of P || Q change from one round
+     * to the next. every block before the one containing the
+     * round number is the same in all rounds, so run the prf
+     * over those blocks once, here, and have each round continue
+     * the chain from the result. @k is the number of bytes covered
+     */
+    k = ((p + q - b - 1) / 16) * 16;
+    ffx_prf(&ctx->ffx, ws, C, P, k);
 
-    /* Step 1 */
-    const unsigned int n = strlen(X);
-    const unsigned int u = n / 2, v = n - u;
+    return k;
+}
 
-    /* Step 3, 4 */
-    const unsigned int b =
-        ((unsigned int)ceil(log2(ctx->ffx.radix) * v) + 7) / 8;
-    const unsigned int d = 4 * ((b + 3) / 4) + 4;
+/*
+ * the prf state for a prepared tweak and a particular text
+ * length: the chaining value over the static blocks of P || Q
+ * and the remaining bytes of P || Q, some of which are static
+ * and the rest of which are filled in during each round
+ */
+struct ff1_tweak_len
+{
+    unsigned int n;
+    uint8_t C[16];
+    uint8_t * W;
+    unsigned int len;
+};
 
-    const unsigned int p = 16;
-    const unsigned int r = ((d + 15) / 16) * 16;
+/*
+ * a tweak prepared for repeated use by ff1_tweak_prepare().
+ *
+ * the prf state for a given text length is computed the first
+ * time the tweak is used with that length and is kept for later
+ * calls with the same length.
+ */
+struct ff1_tweak
+{
+    const struct ff1_ctx * ctx;
 
     struct {
-        void * buf;
+        uint8_t * buf;
         size_t len;
-    } scratch;
+    } twk;
+
+    struct {
+        struct ff1_tweak_len * ent;
+        size_t cnt;
+    } lens;
+};
+
+/*
+ * find (or create) the prf state for texts of length @n
+ */
+static
+const struct ff1_tweak_len * ff1_tweak_len(struct ff1_ctx * const ctx,
+                                           struct ffx_ws * const ws,
+                                           struct ff1_tweak * const twk,
+                                           const unsigned int n,
+                                           const unsigned int b)
+{
+    const unsigned int p = 16, q = ff1_qlen(twk->twk.len, b);
+
+    struct ff1_tweak_len * ent;
+    uint8_t * PQ;
+    unsigned int k;
+
+    for (size_t i = 0; i < twk->lens.cnt; i++) {
+        if (twk->lens.ent[i].n == n) {
+            return &twk->lens.ent[i];
+        }
+    }
 
-    char * A, * B;
-    uint8_t * P, * Q, * R;
+    ent = realloc(twk->lens.ent, (twk->lens.cnt + 1) * sizeof(*ent));
+    if (!ent) {
+        return NULL;
+    }
+    twk->lens.ent = ent;
+    ent = &twk->lens.ent[twk->lens.cnt];
+
+    PQ = malloc(p + q);
+    if (!PQ) {
+        return NULL;
+    }
+
+    k = ff1_prf_prefix(ctx, ws, PQ, ent->C, n, b, twk->twk.buf, twk->twk.len);
 
-    unsigned int q;
+    ent->len = p + q - k;
+    ent->W = malloc(ent->len);
+    if (ent->W) {
+        memcpy(ent->W, PQ + k, ent->len);
+        ent->n = n;
+        twk->lens.cnt++;
+    } else {
+        ent = NULL;
+    }
 
-    bigint_t nA, nB, y, mU, mV;
+    OPENSSL_cleanse(PQ, p + q);
+    free(PQ);
+
+    return ent;
+}
 
+int ff1_tweak_prepare(struct ff1_ctx * const ctx,
+                      const uint8_t * T, size_t t,
+                      struct ff1_tweak ** const twk)
+{
     /* use the default tweak when none is supplied */
     if (T == NULL) {
         T = ctx->ffx.twk.buf;
         t = ctx->ffx.twk.len;
     }
 
-    /* check the text and tweak lengths */
-    if (n < ctx->ffx.txtlen.min ||
-        n > ctx->ffx.txtlen.max ||
-        t < ctx->ffx.twklen.min ||
+    /* check the tweak length */
+    if (t < ctx->ffx.twklen.min ||
         (ctx->ffx.twklen.max > 0 &&
          t > ctx->ffx.twklen.max)) {
-        free(X);
         return -EINVAL;
     }
 
-    /* the number of bytes in Q */
-    q = ((t + b + 1 + 15) / 16) * 16;
-
-    scratch.len = 2 * (v + 2) + p + q + r;
-    scratch.buf = malloc(scratch.len);
-    if (!scratch.buf) {
-        free(X);
+    *twk = malloc(sizeof(**twk) + t);
+    if (!*twk) {
         return -ENOMEM;
     }
 
-    bigint_init(&nA);
-    bigint_init(&nB);
-    bigint_init(&y);
-    bigint_init(&mU);
-    bigint_init(&mV);
+    (*twk)->ctx = ctx;
 
-    /*
-     * P, Q, and R at the front so that they are all 16-byte
-     * aligned. P and Q must remain adjacent since they are
-     * concatenated as part of the algorithm
-     */
-    P = scratch.buf;
-    Q = P + p;
-    R = Q + q;
-    A = R + r;
-    B = A + v + 2;
+    (*twk)->twk.buf = (uint8_t *)(*twk + 1);
+    (*twk)->twk.len = t;
+    memcpy((*twk)->twk.buf, T, t);
 
-    /* Step 2 */
-    if (encrypt) {
-        memcpy(A, X + 0, u); A[u] = '\0';
-        memcpy(B, X + u, v); B[v] = '\0';
-    } else {
-        memcpy(B, X + 0, u); B[u] = '\0';
-        memcpy(A, X + u, v); A[v] = '\0';
+    (*twk)->lens.ent = NULL;
+    (*twk)->lens.cnt = 0;
+
+    return 0;
+}
+
+void ff1_tweak_destroy(struct ff1_tweak * const twk)
+{
+    for (size_t i = 0; i < twk->lens.cnt; i++) {
+        OPENSSL_cleanse(twk->lens.ent[i].W, twk->lens.ent[i].len);
+        free(twk->lens.ent[i].W);
     }
+    OPENSSL_cleanse(twk->lens.ent, twk->lens.cnt * sizeof(*twk->lens.ent));
+    free(twk->lens.ent);
 
-    /* Step 5 */
-    P[0] = 1;
-    P[1] = 2;
-    P[2] = 1;
-    P[3] = ctx->ffx.radix >> 16;
-    P[4] = ctx->ffx.radix >> 8;
-    P[5] = ctx->ffx.radix;
-    P[6] = 10;
-    P[7] = u;
-    *(uint32_t *)&P[8]  = htonl(n);
-    *(uint32_t *)&P[12] = htonl(t);
+    /* see ffx_ctx_destroy() */
+    OPENSSL_cleanse(twk->twk.buf, twk->twk.len);
+    free(twk);
+}
 
-    /*
-     * Step 6i, partial
-     * these parts of @Q are static
-     */
-    memcpy(Q, T, t);
-    memset(Q + t, 0, q - (t + b + 1));
+/*
+ * Steps 6i (partial), 6ii, and 6iii of a single round.
+ *
+ * The caller stores NUM(B) into the last @b bytes of @W. This
+ * function fills in the round number, @i, runs the prf over @W,
+ * continuing from the chaining value @C, and expands the result
+ * to the @r bytes of @R.
+ */
+static
+void ff1_round_prf(struct ff1_ctx * const ctx,
+                   struct ffx_ws * const ws,
+                   uint8_t * const R, const unsigned int r,
+                   const uint8_t * const C,
+                   uint8_t * const W, const unsigned int w,
+                   const unsigned int b, const unsigned int i)
+{
+    /* Step 6i, partial */
+    W[w - b - 1] = i;
+
+    /* Step 6ii */
+    ffx_prf_iv(&ctx->ffx, ws, R, C, W, w);
 
     /*
-     * internally, we treat the string A and B as
-     * big integers for the duration of the algorithm.
-     * this speeds things up by avoiding having to
-     * convert back and forth.
-     * 
-     * set_str function will address custom radix charactersets 
-     * because mapping was performed above once
+     * Step 6iii:
+     * if r is greater than 16 (it will be a multiple of 16),
+     * fill the 2nd and subsequent blocks with the result
+     * of ciph(R ^ 1), ciph(R ^ 2), ...
      */
-    __bigint_set_str_radix(&nA, A, ctx->ffx.radix);
-    __bigint_set_str_radix(&nB, B, ctx->ffx.radix);
+    for (unsigned int j = 1; j < r / 16; j++) {
+        unsigned int * const rP =
+            (unsigned int *)&R[16 - sizeof(unsigned int)];
+        const unsigned int cj = htonl(j);
 
-    /* calculate radix**u and radix**v for use in the loop */
-    bigint_set_ui(&mU, ctx->ffx.radix);
-    bigint_pow_ui(&mU, &mU, u);
-    bigint_mul_ui(&mV, &mU, 1);
-    if (u != v) {
-        bigint_mul_ui(&mV, &mV, ctx->ffx.radix);
+        *rP ^= cj;
+        ffx_ciph(&ctx->ffx, ws, &R[j * 16], &R[0]);
+        *rP ^= cj;
     }
+}
+
+/*
+ * The Feistel rounds (Step 6) using big integers.
+ *
+ * internally, we treat the string A and B as
+ * big integers for the duration of the algorithm.
+ * this speeds things up by avoiding having to
+ * convert back and forth.
+ */
+static
+void ff1_rounds_bigint(struct ff1_ctx * const ctx,
+                       struct ffx_ws * const ws,
+                       const struct ffx_len * const len,
+                       uint8_t * const R, const unsigned int r,
+                       const uint8_t * const C,
+                       uint8_t * const W, const unsigned int w,
+                       bigint_t * const nA, bigint_t * const nB,
+                       bigint_t * const y,
+                       const int encrypt)
+{
+    const unsigned int b = len->b, d = len->d;
 
     for (unsigned int i = 0; i < 10; i++) {
         /* Step 6v */
-        bigint_t * const mX = ((i + !!encrypt) % 2) ? &mU : &mV;
-
-        uint8_t * numb;
-        size_t numc;
-
-        /* Step 6i, partial */
-        Q[q - b - 1] = encrypt ? i : (9 - i);
+        const bigint_t * const mX =
+            ((i + !!encrypt) % 2) ? &len->mU : &len->mV;
 
         /*
          * export the integer representing the string @B as
          * a byte array representation and store it into @Q
          */
-        numb = bigint_export(&nB, &numc);
-        if (b <= numc) {
-            memcpy(&Q[q - b], numb, b);
-        } else {
-            /* pad on the left with zeros, if needed */
-            memset(&Q[q - b], 0, b - numc);
-            memcpy(&Q[q - numc], numb, numc);
-        }
-        free(numb);
-
-        /* Step 6ii */
-        ffx_prf(&ctx->ffx, R, P, p + q);
+        bigint_export_fixed(nB, &W[w - b], b);
 
-        /*
-         * Step 6iii:
-         * if r is greater than 16 (it will be a multiple of 16),
-         * fill the 2nd and subsequent blocks with the result
-         * of ciph(R ^ 1), ciph(R ^ 2), ...
-         */
-        for (unsigned int j = 1; j < r / 16; j++) {
-            unsigned int * const rP =
-                (unsigned int *)&R[16 - sizeof(unsigned int)];
-            const unsigned int w = htonl(j);
-
-            *rP ^= w;
-            ffx_ciph(&ctx->ffx, &R[j * 16], &R[0]);
-            *rP ^= w;
-        }
+        /* Steps 6i - 6iii */
+        ff1_round_prf(ctx, ws, R, r, C, W, w, b, encrypt ? i : (9 - i));
 
         /*
          * Step 6iv
          * create an integer from the first @d bytes in @R
          */
-        bigint_import(&y, R, d);
+        bigint_import(y, R, d);
 
         /* Step 6vi */
         /*
@@ -291,16 +371,16 @@ int ff1_cipher(struct ff1_ctx * const ctx,
          * set @c to A +/- y
          */
         if (encrypt) {
-            bigint_add(&y, &nA, &y);
+            bigint_add(y, nA, y);
         } else {
-            bigint_sub(&y, &nA, &y);
+            bigint_sub(y, nA, y);
         }
         /* Step 6viii */
-        bigint_swap(&nA, &nB);
+        bigint_swap(nA, nB);
 
         /* Step 6ix, skipped Step 6vii */
         /* c = (A +/- y) mod radix**m */
-        bigint_mod(&nB, &y, mX);
+        bigint_mod(nB, y, mX);
 
         /*
          * the code above avoids converting the result
@@ -312,54 +392,1288 @@ int ff1_cipher(struct ff1_ctx * const ctx,
          * directly into nB as a big integer.
          */
     }
+}
 
-    /* convert the big integers back to strings */
-    // Optimized out Step 7 by going directly back to the buffer Y.  Needed 
-    // to change order of a couple operations due to null terminator 
-    // when re-assembling data
+/*
+ * The Feistel rounds (Step 6) for a radix that is a power of 2.
+ *
+ * radix**m is then 2**(m * log2(radix)), so reducing modulo radix**m
+ * is just a matter of discarding the upper bits. A and B are held as
+ * big endian byte arrays of @b bytes, which is exactly the form in
+ * which B is needed for Q, and the arithmetic is done a byte at a
+ * time, without any division. The arrays are exchanged, rather than
+ * copied, between rounds. The results are identical to those of
+ * ff1_rounds_bigint().
+ */
+static
+void ff1_rounds_pow2(struct ff1_ctx * const ctx,
+                     struct ffx_ws * const ws,
+                     const struct ffx_len * const len,
+                     uint8_t * const R, const unsigned int r,
+                     const uint8_t * const C,
+                     uint8_t * const W, const unsigned int w,
+                     uint8_t ** const nA, uint8_t ** const nB,
+                     const int encrypt)
+{
+    const unsigned int b = len->b, d = len->d;
+    const unsigned int k = ctx->ffx.radix_bits;
 
-    if (encrypt) {
-        ffx_str(Y, v + 2, u, ctx->ffx.radix, &nA);
-        ffx_str(Y+u, v + 2, v, ctx->ffx.radix, &nB);
-    } else {
-        ffx_str(Y, v + 2, u, ctx->ffx.radix, &nB);
-        ffx_str(Y+u, v + 2, v, ctx->ffx.radix, &nA);
+    for (unsigned int i = 0; i < 10; i++) {
+        /* Step 6v, the number of bits in radix**m */
+        const unsigned int mb =
+            k * (((i + !!encrypt) % 2) ? len->u : len->v);
+
+        uint8_t * const c = *nA;
+        unsigned int cy;
+
+        /* NUM(B), big endian, in the last @b bytes of @Q */
+        memcpy(&W[w - b], *nB, b);
+
+        /* Steps 6i - 6iii */
+        ff1_round_prf(ctx, ws, R, r, C, W, w, b, encrypt ? i : (9 - i));
+
+        /*
+         * Steps 6iv, 6vi and 6ix, skipped Step 6vii
+         * c = (A +/- NUM(R[0..d])) mod 2**mb
+         *
+         * d is greater than b, so only the last b of the
+         * first d bytes of R can affect the result. the
+         * carry (or borrow) out of the top byte is simply
+         * discarded, as are any bits beyond mb
+         */
+        cy = 0;
+        for (unsigned int j = 1; j <= b; j++) {
+            unsigned int x;
+
+            if (encrypt) {
+                x = c[b - j] + R[d - j] + cy;
+                cy = x >> 8;
+            } else {
+                x = c[b - j] + 0x100 - R[d - j] - cy;
+                cy = (x >> 8) ^ 1;
+            }
+
+            c[b - j] = x;
+        }
+
+        for (unsigned int j = mb / 8; j < b; j++) {
+            c[b - 1 - j] &= (j == mb / 8) ? (1u << (mb % 8)) - 1 : 0;
+        }
+
+        /* Step 6viii */
+        *nA = *nB;
+        *nB = c;
+    }
+}
+
+#if defined(__SIZEOF_INT128__)
+/*
+ * The Feistel rounds (Step 6) using native integers.
+ *
+ * This is only possible when radix**v fits into 64 bits. In that
+ * case, A and B always fit into 64 bits, b is at most 8, and d is
+ * at most 12, so y fits into 128 bits and can be reduced with a
+ * single native division. The results are identical to those of
+ * ff1_rounds_bigint().
+ *
+ * Each round is split in two around the prf, so that the rounds of
+ * several texts can be run in lockstep (see ff1_cipher_native_xn()):
+ * ff1_native_put() stores NUM(B), big endian, in the last @b bytes
+ * of @W, and ff1_native_step() does the rest of round @i, given the
+ * output, @R, of the prf.
+ */
+static inline
+void ff1_native_put(uint8_t * const W, const unsigned int w,
+                    const unsigned int b, const uint64_t nB)
+{
+    for (unsigned int j = 0; j < b; j++) {
+        W[w - 1 - j] = nB >> (8 * j);
     }
+}
 
-    /* Step 7 */
-    // strcpy(Y, A);
-    // strcat(Y, B);
+static inline
+void ff1_native_step(const struct ffx_len * const len,
+                     const unsigned int radix_bits,
+                     const uint8_t * const R, const unsigned int i,
+                     uint64_t * const nA, uint64_t * const nB,
+                     const int encrypt)
+{
+    /* Step 6v */
+    const uint64_t m = ((i + !!encrypt) % 2) ? len->nU : len->nV;
 
-     if (ctx->ffx.custom_radix_str) {
-        map_characters(Y, Y, get_standard_bignum_radix(ctx->ffx.radix), ctx->ffx.custom_radix_str);
-    } else if (ctx->ffx.u32_custom_radix_str) {
-        map_characters_to_u32((uint8_t*)Y, Y, get_standard_bignum_radix(ctx->ffx.radix), ctx->ffx.u32_custom_radix_str);
+    unsigned __int128 z;
+    uint64_t y, c;
+
+    /* Step 6iv */
+    z = 0;
+    for (unsigned int j = 0; j < len->d; j++) {
+        z = (z << 8) | R[j];
+    }
+    if (radix_bits) {
+        /* m is a power of 2 */
+        y = (uint64_t)z & (m - 1);
+    } else {
+        y = z % m;
     }
 
-    memset(scratch.buf, 0, scratch.len);
-    free(scratch.buf);
-    free(X);
-    bigint_deinit(&mV);
-    bigint_deinit(&mU);
-    bigint_deinit(&y);
-    bigint_deinit(&nB);
-    bigint_deinit(&nA);
+    /*
+     * Steps 6vi and 6ix, skipped Step 6vii
+     * c = (A +/- y) mod radix**m
+     *
+     * A and y are both less than m, so the sum or
+     * difference only needs a single correction
+     */
+    if (encrypt) {
+        c = (*nA >= m - y) ? *nA - (m - y) : *nA + y;
+    } else {
+        c = (*nA >= y) ? *nA - y : *nA + (m - y);
+    }
 
-    return 0;
+    /* Step 6viii */
+    *nA = *nB;
+    *nB = c;
 }
 
-int ff1_encrypt(struct ff1_ctx * const ctx,
-                char * const Y,
-                const char * const X,
-                const uint8_t * const T, const size_t t)
+static
+void ff1_rounds_native(struct ff1_ctx * const ctx,
+                       struct ffx_ws * const ws,
+                       const struct ffx_len * const len,
+                       uint8_t * const R, const unsigned int r,
+                       const uint8_t * const C,
+                       uint8_t * const W, const unsigned int w,
+                       uint64_t * const nA, uint64_t * const nB,
+                       const int encrypt)
 {
-    return ff1_cipher(ctx, Y, X, T, t, 1);
+    const unsigned int b = len->b;
+
+    for (unsigned int i = 0; i < 10; i++) {
+        ff1_native_put(W, w, b, *nB);
+
+        /* Steps 6i - 6iii */
+        ff1_round_prf(ctx, ws, R, r, C, W, w, b, encrypt ? i : (9 - i));
+
+        ff1_native_step(len, ctx->ffx.radix_bits, R, i, nA, nB, encrypt);
+    }
 }
+#endif
 
-int ff1_decrypt(struct ff1_ctx * const ctx,
-                char * const Y,
-                const char * const X,
-                const uint8_t * const T, const size_t t)
+/*
+ * The comments below reference the steps of the algorithm described here:
+ *
+ * https://nvlpubs.nist.gov/nistpubs/SpecialPublications/NIST.SP.800-38Gr1-draft.pdf
+ *
+ * If @num is set, @_X and @_Y are arrays of @_n numerals. Otherwise,
+ * @_X is a string of @_n bytes in the context's alphabet, which need
+ * not be terminated. If @ylen is NULL, @_Y receives a nul-terminated
+ * string. Otherwise, @_Y is a buffer of *@ylen bytes, which receives
+ * the string without a terminator, and *@ylen is set to its length.
+ */
+static
+int ff1_cipher_ws(struct ff1_ctx * const ctx, struct ffx_ws * const ws,
+                  void * const _Y, size_t * const ylen,
+                  const void * const _X, const size_t _n,
+                  const uint8_t * T, size_t t,
+                  struct ff1_tweak * const twk,
+                  const int num,
+                  const int encrypt)
+{
+    /*
+     * the algorithm works on the numerals of the text from start
+     * to finish. a string, whatever its alphabet, is translated to
+     * numerals (in a single pass over the input) at the front of the
+     * workspace, where the output numerals are also written, and the
+     * result is translated back (in a single pass) at the end. @X and
+     * @Y point to the numerals, either way
+     */
+    const uint16_t * X;
+    uint16_t * Y;
+    size_t m;
+
+    /* Step 1 */
+    size_t n;
+    unsigned int u, v;
+
+    /* Step 3, 4 */
+    unsigned int b, d;
+
+    const unsigned int p = 16;
+    unsigned int r;
+
+    const struct ffx_len * len;
+    struct ffx_len tmp;
+
+    struct {
+        uint8_t * buf;
+        size_t len;
+    } scratch;
+
+    uint8_t * W, * R;
+    uint8_t * A, * B;
+
+    const struct ff1_tweak_len * tl;
+    unsigned int q, w;
+    uint8_t C[16];
+
+    int res;
+
+    if (twk) {
+        /* the tweak was prepared for use with a different context */
+        if (twk->ctx != ctx) {
+            return -EINVAL;
+        }
+
+        T = twk->twk.buf;
+        t = twk->twk.len;
+    } else if (T == NULL) {
+        /* use the default tweak when none is supplied */
+        T = ctx->ffx.twk.buf;
+        t = ctx->ffx.twk.len;
+    }
+
+    /*
+     * the number of bytes in the input is an upper bound on the
+     * number of characters, rounded up to keep the rest of the
+     * scratch space, which follows the numerals, aligned.
+     */
+    m = 0;
+    res = 0;
+
+    n = _n;
+    if (num) {
+        X = _X;
+        Y = _Y;
+    } else {
+        uint16_t * M;
+
+        m = (n * sizeof(*M) + 15) & ~(size_t)15;
+        M = ffx_ws_reserve(ws, m);
+        if (!M) {
+            return -ENOMEM;
+        }
+
+        res = ffx_str_to_num(&ctx->ffx, M, &n, _X);
+        X = Y = M;
+
+        if (res) {
+            ffx_ws_clear(ws, m);
+            return res;
+        }
+    }
+
+    /* check the text and tweak lengths */
+    if (n < ctx->ffx.txtlen.min ||
+        n > ctx->ffx.txtlen.max ||
+        t < ctx->ffx.twklen.min ||
+        (ctx->ffx.twklen.max > 0 &&
+         t > ctx->ffx.twklen.max)) {
+        ffx_ws_clear(ws, m);
+        return -EINVAL;
+    }
+
+    /*
+     * Steps 1, 3, 4
+     * the lengths and moduli depend only on n
+     */
+    len = ffx_len_acquire(&ctx->ffx, n, &tmp);
+    u = len->u;
+    v = len->v;
+    b = len->b;
+    d = len->d;
+    r = ((d + 15) / 16) * 16;
+
+    /* the number of bytes in Q */
+    q = ff1_qlen(t, b);
+
+    /*
+     * with a prepared tweak, only the part of P || Q that
+     * follows the static blocks needs to be in scratch space.
+     * otherwise, all of P || Q is built (below) in scratch
+     */
+    tl = NULL;
+    w = p + q;
+    if (twk) {
+        tl = ff1_tweak_len(ctx, ws, twk, n, b);
+        if (!tl) {
+            ffx_ws_clear(ws, m);
+            ffx_len_release(len, &tmp);
+            return -ENOMEM;
+        }
+        w = tl->len;
+    }
+
+    /*
+     * all of the scratch space comes from the workspace.
+     * the numerals, if any, are preserved if it has to grow. the
+     * power of 2 engine needs b bytes each for NUM(A) and NUM(B)
+     */
+    scratch.len = m + w + r + 2 * b;
+    scratch.buf = ffx_ws_reserve(ws, scratch.len);
+    if (!scratch.buf) {
+        ffx_ws_clear(ws, m);
+        ffx_len_release(len, &tmp);
+        return -ENOMEM;
+    }
+    if (m) {
+        X = Y = (uint16_t *)scratch.buf;
+    }
+
+    /*
+     * P || Q (or its tail) and R at the front so that they
+     * are all 16-byte aligned.
+     */
+    W = scratch.buf + m;
+    R = W + w;
+    A = R + r;
+    B = A + b;
+
+    /*
+     * Steps 5 and 6i, partial
+     * @W is left pointing to the part of P || Q that
+     * must be run through the prf in each round
+     */
+    if (tl) {
+        memcpy(W, tl->W, w);
+        memcpy(C, tl->C, sizeof(C));
+    } else {
+        const unsigned int k = ff1_prf_prefix(ctx, ws, W, C, n, b, T, t);
+
+        W += k;
+        w -= k;
+    }
+
+#if defined(__SIZEOF_INT128__)
+    if (len->native) {
+        uint64_t nA, nB;
+
+        /*
+         * Step 2
+         * the halves of the input are converted directly
+         * to integers; they aren't needed as strings
+         */
+        if (encrypt) {
+            res = __u64_set_num(&nA, X + 0, u, ctx->ffx.radix);
+            if (!res) {
+                res = __u64_set_num(&nB, X + u, v, ctx->ffx.radix);
+            }
+        } else {
+            res = __u64_set_num(&nB, X + 0, u, ctx->ffx.radix);
+            if (!res) {
+                res = __u64_set_num(&nA, X + u, v, ctx->ffx.radix);
+            }
+        }
+
+        if (!res) {
+            ff1_rounds_native(ctx, ws, len, R, r, C, W, w, &nA, &nB, encrypt);
+
+            /*
+             * convert the integers back to numerals directly
+             * into the output (Step 7)
+             */
+            if (encrypt) {
+                __u64_get_num(Y + 0, u, ctx->ffx.radix, nA);
+                __u64_get_num(Y + u, v, ctx->ffx.radix, nB);
+            } else {
+                __u64_get_num(Y + 0, u, ctx->ffx.radix, nB);
+                __u64_get_num(Y + u, v, ctx->ffx.radix, nA);
+            }
+        }
+    } else
+#endif
+    if (ctx->ffx.radix_bits) {
+        uint8_t * nA = A;
+        uint8_t * nB = B;
+
+        /* Step 2 */
+        if (encrypt) {
+            res = __bytes_set_num_pow2(nA, b, X + 0, u, ctx->ffx.radix);
+            if (!res) {
+                res = __bytes_set_num_pow2(nB, b, X + u, v, ctx->ffx.radix);
+            }
+        } else {
+            res = __bytes_set_num_pow2(nB, b, X + 0, u, ctx->ffx.radix);
+            if (!res) {
+                res = __bytes_set_num_pow2(nA, b, X + u, v, ctx->ffx.radix);
+            }
+        }
+
+        if (!res) {
+            ff1_rounds_pow2(ctx, ws, len, R, r, C, W, w, &nA, &nB, encrypt);
+
+            /* Step 7 */
+            if (encrypt) {
+                __bytes_get_num_pow2(Y + 0, u, ctx->ffx.radix, nA, b);
+                __bytes_get_num_pow2(Y + u, v, ctx->ffx.radix, nB, b);
+            } else {
+                __bytes_get_num_pow2(Y + 0, u, ctx->ffx.radix, nB, b);
+                __bytes_get_num_pow2(Y + u, v, ctx->ffx.radix, nA, b);
+            }
+        }
+    } else {
+        /*
+         * the big integers are part of the workspace
+         * and retain their storage between operations
+         */
+        bigint_t * const nA = &ws->a;
+        bigint_t * const nB = &ws->b;
+        bigint_t * const y = &ws->y;
+
+        /* Step 2 */
+        if (encrypt) {
+            res = __bigint_set_num(nA, X + 0, u, ctx->ffx.radix,
+                                   &len->pw, ws->dc);
+            if (!res) {
+                res = __bigint_set_num(nB, X + u, v, ctx->ffx.radix,
+                                       &len->pw, ws->dc);
+            }
+        } else {
+            res = __bigint_set_num(nB, X + 0, u, ctx->ffx.radix,
+                                   &len->pw, ws->dc);
+            if (!res) {
+                res = __bigint_set_num(nA, X + u, v, ctx->ffx.radix,
+                                       &len->pw, ws->dc);
+            }
+        }
+
+        if (!res) {
+            ff1_rounds_bigint(ctx, ws, len, R, r, C, W, w, nA, nB, y,
+                              encrypt);
+
+            /*
+             * Step 7
+             * the integers aren't needed after this, so they
+             * can be consumed by the conversion
+             */
+            if (encrypt) {
+                __bigint_get_num_consume(Y + 0, u, ctx->ffx.radix,
+                                         nA, &len->pw, ws->dc);
+                __bigint_get_num_consume(Y + u, v, ctx->ffx.radix,
+                                         nB, &len->pw, ws->dc);
+            } else {
+                __bigint_get_num_consume(Y + 0, u, ctx->ffx.radix,
+                                         nB, &len->pw, ws->dc);
+                __bigint_get_num_consume(Y + u, v, ctx->ffx.radix,
+                                         nA, &len->pw, ws->dc);
+            }
+        }
+    }
+
+    if (res || num) {
+        /* invalid input or nothing to translate */
+    } else if (ylen) {
+        res = ffx_num_to_buf(&ctx->ffx, _Y, ylen, Y, n);
+    } else {
+        res = ffx_num_to_str(&ctx->ffx, _Y, Y, n);
+    }
+
+    ffx_ws_clear(ws, scratch.len);
+    memset(C, 0, sizeof(C));
+    ffx_len_release(len, &tmp);
+
+    return res;
+}
+
+/*
+ * the context is shared, so each operation borrows a workspace from
+ * the context's pool for its duration. see ffx_ws_acquire()
+ */
+static
+int ff1_cipher(struct ff1_ctx * const ctx,
+               void * const _Y, size_t * const ylen,
+               const void * const _X, const size_t _n,
+               const uint8_t * T, size_t t,
+               struct ff1_tweak * const twk,
+               const int num,
+               const int encrypt)
+{
+    struct ffx_ws * const ws = ffx_ws_acquire(&ctx->ffx);
+    int res = -ENOMEM;
+
+    if (ws) {
+        res = ff1_cipher_ws(ctx, ws, _Y, ylen, _X, _n, T, t, twk,
+                            num, encrypt);
+        ffx_ws_release(&ctx->ffx, ws);
+    }
+
+    return res;
+}
+
+#if defined(__SIZEOF_INT128__)
+/*
+ * ff1_native_step() followed by ff1_native_put() for the @cnt texts
+ * of ff1_cipher_native_xn(). the arithmetic is done for several texts
+ * at once with the vector instructions, if available, when the moduli
+ * fit into 32 bits, e.g. for texts of up to 19 decimal digits
+ */
+static inline
+void ff1_native_step_xn(const struct ff1_ctx * const ctx,
+                        const struct ffx_len * const len,
+                        const uint8_t * const * const R, const unsigned int i,
+                        uint64_t * const nA, uint64_t * const nB,
+                        uint8_t * const * const W,
+                        const unsigned int w, const unsigned int b,
+                        const size_t cnt,
+                        const int encrypt)
+{
+    /* Step 6v */
+    const uint64_t m = ((i + !!encrypt) % 2) ? len->nU : len->nV;
+
+    /* nU is never larger than nV */
+    if (len->nV < ((uint64_t)1 << 32)) {
+        if (ctx->ffx.avx512) {
+            ffx_round_avx512_xn(cnt, nA, nB, R, len->d, m, encrypt,
+                                W, w - b, b);
+            return;
+        } else if (ctx->ffx.avx2) {
+            ffx_round_avx2_xn(cnt, nA, nB, R, len->d, m, encrypt,
+                              W, w - b, b);
+            return;
+        }
+    }
+
+    for (size_t k = 0; k < cnt; k++) {
+        ff1_native_step(len, ctx->ffx.radix_bits, R[k], i,
+                        &nA[k], &nB[k], encrypt);
+        ff1_native_put(W[k], w, b, nB[k]);
+    }
+}
+#endif
+
+/*
+ * FF1 for @cnt (at most FFX_AES_LANES) texts at once. The texts are
+ * all @xlen bytes long and use the prepared tweak @twk. Their rounds
+ * are run in lockstep, and the prf is run for all of them with a
+ * single call to ffx_prf_xn() in each round, so that the aes
+ * encryptions of the different texts overlap.
+ *
+ * This is only done for texts short enough for the native integer
+ * engine, where the prf is most of the work. If @ylen is 0, @Y[k]
+ * receives a nul-terminated string. Otherwise, each @Y[k] is a
+ * buffer of @ylen bytes, which receives the string without a
+ * terminator, as for ff1_cipher_ws().
+ *
+ * Returns 0 if all of the texts were processed. Otherwise, some of
+ * the texts can't be processed together (for example, because one
+ * of them is invalid), and the caller must process them one at a
+ * time, which also determines the error for each one.
+ */
+static
+int ff1_cipher_native_xn(struct ff1_ctx * const ctx, struct ffx_ws * const ws,
+                         struct ff1_tweak * const twk,
+                         char * const * const Y, const size_t ylen,
+                         const char * const * const X, const size_t xlen,
+                         const size_t cnt,
+                         const int encrypt)
+{
+#if defined(__SIZEOF_INT128__)
+    const unsigned int radix = ctx->ffx.radix;
+
+    uint8_t * W[FFX_AES_LANES], * R[FFX_AES_LANES];
+    const uint8_t * C[FFX_AES_LANES];
+    uint64_t nA[FFX_AES_LANES] = { 0 }, nB[FFX_AES_LANES] = { 0 };
+
+    const struct ffx_len * len;
+    struct ffx_len tmp;
+
+    const struct ff1_tweak_len * tl;
+
+    struct {
+        uint8_t * buf;
+        size_t len;
+    } scratch;
+    size_t m, n;
+    unsigned int u, v, b, w;
+
+    int res;
+
+    if (twk->ctx != ctx ||
+        twk->twk.len < ctx->ffx.twklen.min ||
+        (ctx->ffx.twklen.max > 0 && twk->twk.len > ctx->ffx.twklen.max)) {
+        return -EINVAL;
+    }
+
+    /*
+     * the numerals of each text are at the front of the workspace,
+     * @m bytes apart, followed by P || Q (the part that changes from
+     * round to round) and R for each text
+     */
+    m = (xlen * sizeof(uint16_t) + 15) & ~(size_t)15;
+    scratch.len = cnt * m;
+    scratch.buf = ffx_ws_reserve(ws, scratch.len);
+    if (!scratch.buf) {
+        return -ENOMEM;
+    }
+
+    n = 0;
+    res = 0;
+    for (size_t k = 0; !res && k < cnt; k++) {
+        size_t nk = xlen;
+
+        res = ffx_str_to_num(
+            &ctx->ffx, (uint16_t *)(scratch.buf + k * m), &nk, X[k]);
+        if (!res && k > 0 && nk != n) {
+            res = -EINVAL;
+        }
+        n = nk;
+    }
+    if (!res && (n < ctx->ffx.txtlen.min || n > ctx->ffx.txtlen.max)) {
+        res = -EINVAL;
+    }
+    if (res) {
+        ffx_ws_clear(ws, scratch.len);
+        return res;
+    }
+
+    len = ffx_len_acquire(&ctx->ffx, n, &tmp);
+    u = len->u;
+    v = len->v;
+    b = len->b;
+
+    tl = NULL;
+    if (len->native) {
+        tl = ff1_tweak_len(ctx, ws, twk, n, b);
+    }
+    if (!tl) {
+        ffx_ws_clear(ws, scratch.len);
+        ffx_len_release(len, &tmp);
+        return -EAGAIN;
+    }
+    w = tl->len;
+
+    /* for the native engine, d is at most 12, so R is a single block */
+    scratch.len = cnt * (m + w + 16);
+    scratch.buf = ffx_ws_reserve(ws, scratch.len);
+    if (!scratch.buf) {
+        ffx_ws_clear(ws, cnt * m);
+        ffx_len_release(len, &tmp);
+        return -ENOMEM;
+    }
+
+    /* Steps 2 and 5, and the static parts of P || Q */
+    for (size_t k = 0; !res && k < cnt; k++) {
+        const uint16_t * const Xk = (uint16_t *)(scratch.buf + k * m);
+
+        W[k] = scratch.buf + cnt * m + k * w;
+        R[k] = scratch.buf + cnt * (m + w) + k * 16;
+        C[k] = tl->C;
+
+        memcpy(W[k], tl->W, w);
+
+        if (encrypt) {
+            res = __u64_set_num(&nA[k], Xk + 0, u, radix);
+            if (!res) {
+                res = __u64_set_num(&nB[k], Xk + u, v, radix);
+            }
+        } else {
+            res = __u64_set_num(&nB[k], Xk + 0, u, radix);
+            if (!res) {
+                res = __u64_set_num(&nA[k], Xk + u, v, radix);
+            }
+        }
+    }
+
+    /*
+     * Step 6, as in ff1_rounds_native(). NUM(B) is stored for the
+     * first round here and, for the rest, as part of the round before
+     */
+    for (size_t k = 0; !res && k < cnt; k++) {
+        ff1_native_put(W[k], w, b, nB[k]);
+    }
+    for (unsigned int i = 0; !res && i < 10; i++) {
+        for (size_t k = 0; k < cnt; k++) {
+            W[k][w - b - 1] = encrypt ? i : (9 - i);
+        }
+
+        ffx_prf_xn(&ctx->ffx, ws, cnt,
+                   R, C, (const uint8_t * const *)W, w);
+
+        ff1_native_step_xn(ctx, len, (const uint8_t * const *)R, i,
+                           nA, nB, W, w, b, cnt, encrypt);
+    }
+
+    /* Step 7 */
+    for (size_t k = 0; !res && k < cnt; k++) {
+        uint16_t * const Yk = (uint16_t *)(scratch.buf + k * m);
+
+        if (encrypt) {
+            __u64_get_num(Yk + 0, u, radix, nA[k]);
+            __u64_get_num(Yk + u, v, radix, nB[k]);
+        } else {
+            __u64_get_num(Yk + 0, u, radix, nB[k]);
+            __u64_get_num(Yk + u, v, radix, nA[k]);
+        }
+
+        if (ylen) {
+            size_t yl = ylen;
+
+            res = ffx_num_to_buf(&ctx->ffx, Y[k], &yl, Yk, n);
+        } else {
+            res = ffx_num_to_str(&ctx->ffx, Y[k], Yk, n);
+        }
+    }
+
+    ffx_ws_clear(ws, scratch.len);
+    memset(nA, 0, sizeof(nA));
+    memset(nB, 0, sizeof(nB));
+    ffx_len_release(len, &tmp);
+
+    return res;
+#else
+    (void)ctx;
+    (void)ws;
+    (void)twk;
+    (void)Y;
+    (void)ylen;
+    (void)X;
+    (void)xlen;
+    (void)cnt;
+    (void)encrypt;
+
+    return -EAGAIN;
+#endif
+}
+
+/*
+ * whether texts of @xlen bytes may be processed by
+ * ff1_cipher_native_xn(). if the number of numerals can't be known
+ * without decoding the texts, the answer is left to that function
+ */
+static
+int ff1_native_len(struct ff1_ctx * const ctx, const size_t xlen)
+{
+    const struct ffx_len * len;
+    struct ffx_len tmp;
+    size_t n;
+    int native;
+
+    n = ffx_input_len(&ctx->ffx, xlen);
+    if (n == 0) {
+        return 1;
+    }
+
+    /* the texts are invalid, which is reported for each of them */
+    if (n < ctx->ffx.txtlen.min || n > ctx->ffx.txtlen.max) {
+        return 0;
+    }
+
+    len = ffx_len_acquire(&ctx->ffx, n, &tmp);
+    native = len->native;
+    ffx_len_release(len, &tmp);
+
+    return native;
+}
+
+int ff1_encrypt(struct ff1_ctx * const ctx,
+                char * const Y,
+                const char * const X,
+                const uint8_t * const T, const size_t t)
+{
+    return ff1_cipher(ctx, Y, NULL, X, strlen(X), T, t, NULL, 0, 1);
+}
+
+int ff1_decrypt(struct ff1_ctx * const ctx,
+                char * const Y,
+                const char * const X,
+                const uint8_t * const T, const size_t t)
+{
+    return ff1_cipher(ctx, Y, NULL, X, strlen(X), T, t, NULL, 0, 0);
+}
+
+int ff1_encrypt_prepared(struct ff1_ctx * const ctx,
+                         char * const Y,
+                         const char * const X,
+                         struct ff1_tweak * const twk)
+{
+    return ff1_cipher(ctx, Y, NULL, X, strlen(X), NULL, 0, twk, 0, 1);
+}
+
+int ff1_decrypt_prepared(struct ff1_ctx * const ctx,
+                         char * const Y,
+                         const char * const X,
+                         struct ff1_tweak * const twk)
+{
+    return ff1_cipher(ctx, Y, NULL, X, strlen(X), NULL, 0, twk, 0, 0);
+}
+
+int ff1_encrypt_numerals(struct ff1_ctx * const ctx,
+                         uint16_t * const Y,
+                         const uint16_t * const X, const size_t n,
+                         const uint8_t * const T, const size_t t)
+{
+    return ff1_cipher(ctx, Y, NULL, X, n, T, t, NULL, 1, 1);
+}
+
+int ff1_decrypt_numerals(struct ff1_ctx * const ctx,
+                         uint16_t * const Y,
+                         const uint16_t * const X, const size_t n,
+                         const uint8_t * const T, const size_t t)
+{
+    return ff1_cipher(ctx, Y, NULL, X, n, T, t, NULL, 1, 0);
+}
+
+int ff1_encrypt_len(struct ff1_ctx * const ctx,
+                    char * const Y, size_t * const ylen,
+                    const char * const X, const size_t xlen,
+                    const uint8_t * const T, const size_t t)
+{
+    return ff1_cipher(ctx, Y, ylen, X, xlen, T, t, NULL, 0, 1);
+}
+
+int ff1_decrypt_len(struct ff1_ctx * const ctx,
+                    char * const Y, size_t * const ylen,
+                    const char * const X, const size_t xlen,
+                    const uint8_t * const T, const size_t t)
+{
+    return ff1_cipher(ctx, Y, ylen, X, xlen, T, t, NULL, 0, 0);
+}
+
+size_t ff1_output_len(const struct ff1_ctx * const ctx, const size_t xlen)
+{
+    return ffx_output_len(&ctx->ffx, xlen);
+}
+
+/* the record at position @i of a batch; see ff1_cipher_batch_ws() */
+static
+int ff1_cipher_batch_one(struct ff1_ctx * const ctx, struct ffx_ws * const ws,
+                         struct ff1_tweak ** const dflt,
+                         char * const * const Y,
+                         const char * const * const X,
+                         const size_t * const Xlen,
+                         const uint8_t * const * const T,
+                         const size_t * const Tlen,
+                         const size_t i,
+                         const int encrypt)
+{
+    size_t n;
+    int err;
+
+    if (!Y[i] || !X[i]) {
+        return -EINVAL;
+    }
+
+    n = Xlen ? Xlen[i] : strlen(X[i]);
+
+    if (T && T[i]) {
+        err = -EINVAL;
+        if (Tlen) {
+            err = ff1_cipher_ws(ctx, ws, Y[i], NULL, X[i], n,
+                                T[i], Tlen[i], NULL, 0, encrypt);
+        }
+    } else {
+        err = 0;
+        if (!*dflt) {
+            err = ff1_tweak_prepare(ctx, NULL, 0, dflt);
+        }
+        if (!err) {
+            err = ff1_cipher_ws(ctx, ws, Y[i], NULL, X[i], n,
+                                NULL, 0, *dflt, 0, encrypt);
+        }
+    }
+
+    return err;
+}
+
+/*
+ * the records of a batch from @lo up to @hi, using the workspace @ws.
+ * the default tweak is prepared, into @dflt, the first time a record
+ * needs it, so that its prf state is computed once per length for
+ * all of the records processed with the same @dflt
+ */
+static
+int ff1_cipher_batch_ws(struct ff1_ctx * const ctx, struct ffx_ws * const ws,
+                        struct ff1_tweak ** const dflt,
+                        char * const * const Y,
+                        const char * const * const X,
+                        const size_t * const Xlen,
+                        const uint8_t * const * const T,
+                        const size_t * const Tlen,
+                        const size_t lo, const size_t hi,
+                        int * const status,
+                        const int encrypt)
+{
+    const unsigned int lanes = ffx_prf_lanes(&ctx->ffx);
+
+    struct ffx_bucket * B;
+    size_t k, fail;
+    int res;
+
+    /*
+     * the records that use the default tweak are bucketed by
+     * length, so that records of the same length can be processed
+     * together (see ff1_cipher_native_xn()) wherever they are in
+     * the batch. all other records are processed individually, as
+     * are all of the records if there's no benefit to bucketing or
+     * if the space for the buckets can't be allocated
+     */
+    B = NULL;
+    if (lanes > 1 && hi - lo > 1) {
+        B = ffx_ws_buckets(ws, hi - lo);
+    }
+
+    fail = SIZE_MAX;
+    res = 0;
+
+    k = 0;
+    for (size_t i = lo; i < hi; i++) {
+        if (B && Y[i] && X[i] && !(T && T[i])) {
+            B[k].n = Xlen ? Xlen[i] : strlen(X[i]);
+            B[k].i = i;
+            k++;
+        } else {
+            ffx_bucket_status(
+                status, i,
+                ff1_cipher_batch_one(ctx, ws, dflt, Y, X, Xlen, T, Tlen, i,
+                                     encrypt),
+                &fail, &res);
+        }
+    }
+
+    if (k > 1) {
+        ffx_bucket_sort(B, k);
+    }
+
+    for (size_t i = 0; i < k;) {
+        /*
+         * the records of a bucket are processed as many at a time as
+         * the prf can handle, falling back to one at a time for any
+         * group that can't be processed together
+         */
+        size_t j = i + 1;
+
+        while (j < k && j - i < lanes && B[j].n == B[i].n) {
+            j++;
+        }
+
+        if (j - i > 1 && ff1_native_len(ctx, B[i].n) &&
+            (*dflt || ff1_tweak_prepare(ctx, NULL, 0, dflt) == 0)) {
+            char * Yp[FFX_AES_LANES];
+            const char * Xp[FFX_AES_LANES];
+
+            for (size_t l = i; l < j; l++) {
+                Yp[l - i] = Y[B[l].i];
+                Xp[l - i] = X[B[l].i];
+            }
+
+            if (ff1_cipher_native_xn(ctx, ws, *dflt, Yp, 0, Xp, B[i].n,
+                                     j - i, encrypt) == 0) {
+                for (; i < j; i++) {
+                    ffx_bucket_status(status, B[i].i, 0, &fail, &res);
+                }
+                continue;
+            }
+        }
+
+        for (; i < j; i++) {
+            ffx_bucket_status(
+                status, B[i].i,
+                ff1_cipher_batch_one(ctx, ws, dflt, Y, X, Xlen, T, Tlen,
+                                     B[i].i, encrypt),
+                &fail, &res);
+        }
+    }
+
+    return res;
+}
+
+static
+int ff1_cipher_batch(struct ff1_ctx * const ctx,
+                     char * const * const Y,
+                     const char * const * const X,
+                     const size_t * const Xlen,
+                     const uint8_t * const * const T,
+                     const size_t * const Tlen,
+                     const size_t cnt,
+                     int * const status,
+                     const int encrypt)
+{
+    /*
+     * one workspace and default tweak are used for all of the
+     * records, and the cached lengths and the key schedule carry
+     * over between them
+     */
+    struct ff1_tweak * dflt = NULL;
+    struct ffx_ws * ws;
+    int res;
+
+    ws = ffx_ws_acquire(&ctx->ffx);
+    if (!ws) {
+        return -ENOMEM;
+    }
+
+    res = ff1_cipher_batch_ws(ctx, ws, &dflt, Y, X, Xlen, T, Tlen,
+                              0, cnt, status, encrypt);
+
+    if (dflt) {
+        ff1_tweak_destroy(dflt);
+    }
+    ffx_ws_release(&ctx->ffx, ws);
+
+    return res;
+}
+
+int ff1_encrypt_batch(struct ff1_ctx * const ctx,
+                      char * const * const Y,
+                      const char * const * const X,
+                      const size_t * const Xlen,
+                      const uint8_t * const * const T,
+                      const size_t * const Tlen,
+                      const size_t cnt,
+                      int * const status)
+{
+    return ff1_cipher_batch(ctx, Y, X, Xlen, T, Tlen, cnt, status, 1);
+}
+
+int ff1_decrypt_batch(struct ff1_ctx * const ctx,
+                      char * const * const Y,
+                      const char * const * const X,
+                      const size_t * const Xlen,
+                      const uint8_t * const * const T,
+                      const size_t * const Tlen,
+                      const size_t cnt,
+                      int * const status)
+{
+    return ff1_cipher_batch(ctx, Y, X, Xlen, T, Tlen, cnt, status, 0);
+}
+
+/*
+ * the parameters of a batch run by a pool and the state of each of
+ * the pool's workers. each worker has its own workspace and default
+ * tweak, acquired when the worker processes its first records
+ */
+struct ff1_batch
+{
+    struct ff1_ctx * ctx;
+    char * const * Y;
+    const char * const * X;
+    const size_t * Xlen;
+    const uint8_t * const * T;
+    const size_t * Tlen;
+    int * status;
+    int encrypt;
+};
+
+struct ff1_batch_worker
+{
+    struct ffx_ws * ws;
+    struct ff1_tweak * dflt;
+};
+
+static
+int ff1_batch_run(void * const _b, void * const _w,
+                  const size_t lo, const size_t hi)
+{
+    const struct ff1_batch * const b = _b;
+    struct ff1_batch_worker * const w = _w;
+
+    if (!w->ws) {
+        w->ws = ffx_ws_acquire(&b->ctx->ffx);
+        if (!w->ws) {
+            for (size_t i = lo; b->status && i < hi; i++) {
+                b->status[i] = -ENOMEM;
+            }
+            return -ENOMEM;
+        }
+    }
+
+    return ff1_cipher_batch_ws(b->ctx, w->ws, &w->dflt,
+                               b->Y, b->X, b->Xlen, b->T, b->Tlen,
+                               lo, hi, b->status, b->encrypt);
+}
+
+static
+void ff1_batch_fini(void * const _b, void * const _w)
+{
+    const struct ff1_batch * const b = _b;
+    struct ff1_batch_worker * const w = _w;
+
+    if (w->dflt) {
+        ff1_tweak_destroy(w->dflt);
+    }
+    if (w->ws) {
+        ffx_ws_release(&b->ctx->ffx, w->ws);
+    }
+}
+
+static
+int ff1_cipher_batch_mt(struct ff1_ctx * const ctx,
+                        struct fpe_pool * const pool,
+                        char * const * const Y,
+                        const char * const * const X,
+                        const size_t * const Xlen,
+                        const uint8_t * const * const T,
+                        const size_t * const Tlen,
+                        const size_t cnt,
+                        int * const status,
+                        const int encrypt)
+{
+    struct ff1_batch b = {
+        ctx, Y, X, Xlen, T, Tlen, status, encrypt,
+    };
+    const struct ffx_pool_job job = {
+        ff1_batch_run, ff1_batch_fini, &b, sizeof(struct ff1_batch_worker),
+    };
+
+    if (!pool) {
+        return ff1_cipher_batch(ctx, Y, X, Xlen, T, Tlen, cnt, status,
+                                encrypt);
+    }
+
+    return ffx_pool_run(pool, &job, cnt);
+}
+
+int ff1_encrypt_batch_mt(struct ff1_ctx * const ctx,
+                         struct fpe_pool * const pool,
+                         char * const * const Y,
+                         const char * const * const X,
+                         const size_t * const Xlen,
+                         const uint8_t * const * const T,
+                         const size_t * const Tlen,
+                         const size_t cnt,
+                         int * const status)
+{
+    return ff1_cipher_batch_mt(ctx, pool, Y, X, Xlen, T, Tlen, cnt, status,
+                               1);
+}
+
+int ff1_decrypt_batch_mt(struct ff1_ctx * const ctx,
+                         struct fpe_pool * const pool,
+                         char * const * const Y,
+                         const char * const * const X,
+                         const size_t * const Xlen,
+                         const uint8_t * const * const T,
+                         const size_t * const Tlen,
+                         const size_t cnt,
+                         int * const status)
+{
+    return ff1_cipher_batch_mt(ctx, pool, Y, X, Xlen, T, Tlen, cnt, status,
+                               0);
+}
+
+static
+int ff1_cipher_strided(struct ff1_ctx * const ctx,
+                       char * const Y, const size_t ystride,
+                       const char * const X, const size_t xstride,
+                       const size_t width, const size_t cnt,
+                       const uint8_t * const T, const size_t t,
+                       int * const status,
+                       const int encrypt)
+{
+    struct ff1_tweak * twk;
+    struct ffx_ws * ws;
+
+    unsigned int lanes;
+    int res;
+
+    /*
+     * the output must be the same number of bytes as the input,
+     * which is only guaranteed for single-byte alphabets
+     */
+    if (ctx->ffx.u8_map || ctx->ffx.radix > 255) {
+        return -EINVAL;
+    }
+
+    /*
+     * with a single-byte alphabet, the width is the number of
+     * numerals, so a width that's out of range fails every field.
+     * it's rejected here, before it can take a slot in the cache
+     * of length parameters
+     */
+    if (width < ctx->ffx.txtlen.min || width > ctx->ffx.txtlen.max) {
+        return -EINVAL;
+    }
+
+    /*
+     * every field has the same length, so the tweak's prf state
+     * and the length-dependent parameters are computed once, by
+     * the first field, and found in their caches by the rest
+     */
+    res = ff1_tweak_prepare(ctx, T, t, &twk);
+    if (res) {
+        return res;
+    }
+
+    ws = ffx_ws_acquire(&ctx->ffx);
+    if (!ws) {
+        ff1_tweak_destroy(twk);
+        return -ENOMEM;
+    }
+
+    /*
+     * fields too long for the native engine are all processed
+     * one at a time, without first being decoded for a group
+     */
+    lanes = ffx_prf_lanes(&ctx->ffx);
+    if (lanes > 1 && !ff1_native_len(ctx, width)) {
+        lanes = 1;
+    }
+
+    for (size_t i = 0; i < cnt;) {
+        /*
+         * fields are processed in groups, as many at a time as the
+         * prf can handle, falling back to one at a time for a group
+         * that contains an invalid field
+         */
+        const size_t j = (cnt - i > lanes) ? i + lanes : cnt;
+
+        if (j - i > 1) {
+            char * Yp[FFX_AES_LANES];
+            const char * Xp[FFX_AES_LANES];
+
+            for (size_t k = 0; k < j - i; k++) {
+                Yp[k] = Y + (i + k) * ystride;
+                Xp[k] = X + (i + k) * xstride;
+            }
+
+            if (ff1_cipher_native_xn(ctx, ws, twk, Yp, width, Xp, width,
+                                     j - i, encrypt) == 0) {
+                for (; status && i < j; i++) {
+                    status[i] = 0;
+                }
+                i = j;
+                continue;
+            }
+        }
+
+        for (; i < j; i++) {
+            size_t n = width;
+            int err;
+
+            err = ff1_cipher_ws(ctx, ws, Y + i * ystride, &n,
+                                X + i * xstride, width, NULL, 0, twk, 0,
+                                encrypt);
+
+            if (status) {
+                status[i] = err;
+            }
+            if (err && !res) {
+                res = err;
+            }
+        }
+    }
+
+    ffx_ws_release(&ctx->ffx, ws);
+    ff1_tweak_destroy(twk);
+
+    return res;
+}
+
+int ff1_encrypt_strided(struct ff1_ctx * const ctx,
+                        char * const Y, const size_t ystride,
+                        const char * const X, const size_t xstride,
+                        const size_t width, const size_t cnt,
+                        const uint8_t * const T, const size_t t,
+                        int * const status)
+{
+    return ff1_cipher_strided(ctx, Y, ystride, X, xstride, width, cnt,
+                              T, t, status, 1);
+}
+
+int ff1_decrypt_strided(struct ff1_ctx * const ctx,
+                        char * const Y, const size_t ystride,
+                        const char * const X, const size_t xstride,
+                        const size_t width, const size_t cnt,
+                        const uint8_t * const T, const size_t t,
+                        int * const status)
 {
-    return ff1_cipher(ctx, Y, X, T, t, 0);
+    return ff1_cipher_strided(ctx, Y, ystride, X, xstride, width, cnt,
+                              T, t, status, 0);
 }
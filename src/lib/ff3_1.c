@@ -1,18 +1,28 @@
+#include <ubiq/fpe/ff3_1.h>
 #include <ubiq/fpe/internal/ffx.h>
+#include <ubiq/fpe/internal/pool.h>
 
 #include <arpa/inet.h>
 #include <stdlib.h>
 #include <math.h>
+#include <unistr.h>
 
 struct ff3_1_ctx
 {
     struct ffx_ctx ffx;
 };
 
-int ff3_1_ctx_create(struct ff3_1_ctx ** const ctx,
-                     const uint8_t * const keybuf, const size_t keylen,
-                     const uint8_t * const twkbuf,
-                     const unsigned int radix)
+/*
+ * the key is reversed before it is expanded. @custom_radix_str
+ * may be NULL, in which case the standard character set for the
+ * radix is used
+ */
+static
+int ff3_1_ctx_init(struct ff3_1_ctx ** const ctx,
+                   const uint8_t * const keybuf, const size_t keylen,
+                   const uint8_t * const twkbuf,
+                   const unsigned int radix,
+                   const uint8_t * const custom_radix_str)
 {
     /*
      * maxlen for ff3-1:
@@ -25,33 +35,90 @@ int ff3_1_ctx_create(struct ff3_1_ctx ** const ctx,
      * = 4 * 48 / log2(radix)
      * = 192 / log2(radix)
      */
-    const size_t maxtxtlen = (double)192 / log2(radix);
+    size_t maxtxtlen;
+    uint8_t * kb;
     int res;
 
-    res = -EINVAL;
-    if (twkbuf) {
-        uint8_t * const kb = malloc(keylen);
+    /* the tweak is required, and the radix can't exceed 2**16 */
+    if (!twkbuf || radix < 2 || radix > 65536) {
+        return -EINVAL;
+    }
+    maxtxtlen = (double)192 / log2(radix);
 
-        res = -ENOMEM;
-        if (kb) {
-            ffx_revb(kb, keybuf, keylen);
+    kb = malloc(keylen);
+    if (!kb) {
+        return -ENOMEM;
+    }
 
-            res = ffx_ctx_create(
-                (void **)ctx,
-                sizeof(struct ff3_1_ctx), offsetof(struct ff3_1_ctx, ffx),
-                kb, keylen,
-                twkbuf, 7,
-                maxtxtlen,
-                7, 7,
-                radix);
+    ffx_revb(kb, keybuf, keylen);
 
-            free(kb);
-        }
+    if (custom_radix_str) {
+        res = ffx_ctx_create_custom_radix_str(
+            (void **)ctx,
+            sizeof(struct ff3_1_ctx), offsetof(struct ff3_1_ctx, ffx),
+            kb, keylen,
+            twkbuf, 7,
+            maxtxtlen,
+            7, 7,
+            custom_radix_str);
+    } else {
+        res = ffx_ctx_create(
+            (void **)ctx,
+            sizeof(struct ff3_1_ctx), offsetof(struct ff3_1_ctx, ffx),
+            kb, keylen,
+            twkbuf, 7,
+            maxtxtlen,
+            7, 7,
+            radix);
     }
 
+    OPENSSL_cleanse(kb, keylen);
+    free(kb);
+
     return res;
 }
 
+int ff3_1_ctx_create(struct ff3_1_ctx ** const ctx,
+                     const uint8_t * const keybuf, const size_t keylen,
+                     const uint8_t * const twkbuf,
+                     const unsigned int radix)
+{
+    /*
+     * the interface only accepts strings in the standard character
+     * sets, which don't exist for a radix larger than 255
+     */
+    if (radix > 255) {
+        return -EINVAL;
+    }
+
+    return ff3_1_ctx_init(ctx, keybuf, keylen, twkbuf, radix, NULL);
+}
+
+int ff3_1_ctx_create_custom_radix(struct ff3_1_ctx ** const ctx,
+                                  const uint8_t * const keybuf,
+                                  const size_t keylen,
+                                  const uint8_t * const twkbuf,
+                                  const uint8_t * const custom_radix_str)
+{
+    const size_t len = strlen((const char *)custom_radix_str);
+    /* the radix is the number of (utf-8) characters in the alphabet */
+    const size_t radix = u8_mbsnlen(custom_radix_str, len);
+    const char * const std = get_standard_bignum_radix(radix);
+
+    /*
+     * as with ff1, an alphabet that is the standard character
+     * set for its radix is treated as such
+     */
+    if (std && radix == len &&
+        strncmp(std, (const char *)custom_radix_str, len) == 0) {
+        return ff3_1_ctx_init(ctx, keybuf, keylen, twkbuf, radix, NULL);
+    }
+
+    return ff3_1_ctx_init(
+        ctx, keybuf, keylen, twkbuf,
+        radix > 65536 ? 0 : radix, custom_radix_str);
+}
+
 void ff3_1_ctx_destroy(struct ff3_1_ctx * const ctx)
 {
     ffx_ctx_destroy((void *)ctx, offsetof(struct ff3_1_ctx, ffx));
@@ -62,165 +129,420 @@ void ff3_1_ctx_destroy(struct ff3_1_ctx * const ctx)
  *
  * https://nvlpubs.nist.gov/nistpubs/SpecialPublications/NIST.SP.800-38Gr1-draft.pdf
  */
-static
-int ff3_1_cipher(struct ff3_1_ctx * const ctx,
-                 char * const Y,
-                 const char * const X,
-                 const uint8_t * T /* T is always 56 bits */,
-                 const int encrypt)
+
+#if defined(__SIZEOF_INT128__)
+/*
+ * Steps 2 - 5 using native integers.
+ *
+ * This is only possible when radix**u fits into 128 bits, which,
+ * given the maximum text length, is always the case. Rather than
+ * reversing the halves of the text and converting them back and
+ * forth between numerals and integers in each round, A and B are
+ * held as NUM(REV(A)) and NUM(REV(B)) for the duration, since
+ * those are the only values ever needed. The results are identical
+ * to those of ff3_1_cipher_bigint().
+ *
+ * ff3_1_wide_put() builds the (reversed) input to the cipher for
+ * round @i, and ff3_1_wide_step() does the rest of the round,
+ * given the output of the cipher in @P.
+ */
+static inline
+void ff3_1_wide_put(uint8_t * const P, const uint8_t Tw[2][4],
+                    const unsigned int i, const unsigned __int128 nB,
+                    const int encrypt)
 {
-    /* Step 1 */
-    const unsigned int n = strlen(X);
-    const unsigned int v = n / 2, u = n - v;
+    /* Step 4i */
+    const uint8_t * const W = Tw[(i + !!encrypt) % 2];
 
-    struct {
-        void * buf;
-        size_t len;
-    } scratch;
+    unsigned __int128 x;
 
-    uint8_t P[16];
-    uint8_t Tw[2][4];
+    /* Step 4ii */
+    /* W ^ i */
+    memcpy(P, W, 4);
+    P[3] ^= encrypt ? i : (7 - i);
+    /*
+     * NUM(REV(B)) as 12 bytes, big endian. for lengths at the
+     * limit, the value may need more than 12 bytes, in which
+     * case the most significant 12 are used, as the big integer
+     * implementation does
+     */
+    x = nB;
+    while (x >> 96) {
+        x >>= 8;
+    }
+    for (unsigned int j = 0; j < 12; j++) {
+        P[15 - j] = x >> (8 * j);
+    }
 
-    char * A, * B, * C;
+    /* Step 4iii, up to the cipher */
+    ffx_revb(P, P, 16);
+}
 
-    bigint_t y, c;
+static inline
+void ff3_1_wide_step(const struct ffx_len * const len,
+                     const unsigned int radix_bits,
+                     const uint8_t * const P, const unsigned int i,
+                     unsigned __int128 * const nA,
+                     unsigned __int128 * const nB,
+                     const int encrypt)
+{
+    const unsigned __int128 m =
+        ((i + !!encrypt) % 2) ? len->wV : len->wU;
 
-    /* use the default tweak if none is given */
-    if (!T) {
-        T = ctx->ffx.twk.buf;
+    unsigned __int128 y, c;
+
+    /*
+     * Step 4iv
+     * S = REVB(P), and y = NUM(S), so P is
+     * simply read in little endian order
+     */
+    y = 0;
+    for (unsigned int j = 16; j > 0; j--) {
+        y = (y << 8) | P[j - 1];
+    }
+    if (radix_bits) {
+        /* m is a power of 2 */
+        y &= m - 1;
+    } else {
+        y %= m;
     }
 
-    /* check the text length */
-    if (n < ctx->ffx.txtlen.min ||
-        n > ctx->ffx.txtlen.max) {
-        return -EINVAL;
+    /*
+     * Step 4v, Step 4vi skipped
+     * c = (NUM(REV(A)) +/- y) mod radix**m
+     *
+     * NUM(REV(C)), which is all that is needed
+     * in the next round, is just c, itself
+     */
+    if (encrypt) {
+        c = (*nA >= m - y) ? *nA - (m - y) : *nA + y;
+    } else {
+        c = (*nA >= y) ? *nA - y : *nA + (m - y);
     }
 
-    bigint_init(&y);
-    bigint_init(&c);
+    /* Step 4vii */
+    *nA = *nB;
+    /* Step 4viii */
+    *nB = c;
+}
 
-    scratch.len = 3 * (u + 2);
-    scratch.buf = malloc(scratch.len);
-    if (!scratch.buf) {
-        bigint_deinit(&c);
-        bigint_deinit(&y);
-        return -ENOMEM;
-    }
+static
+int ff3_1_cipher_wide(struct ff3_1_ctx * const ctx,
+                      struct ffx_ws * const ws,
+                      const struct ffx_len * const len,
+                      uint16_t * const Y,
+                      const uint16_t * const X,
+                      const uint8_t Tw[2][4],
+                      const int encrypt)
+{
+    const unsigned int radix = ctx->ffx.radix;
+    /* u and v are swapped relative to ff1 */
+    const unsigned int v = len->u, u = len->v;
 
-    A = scratch.buf;
-    B = A + u + 2;
-    C = B + u + 2;
+    unsigned __int128 nA, nB;
+    uint8_t P[16];
+    int res;
 
     /* Step 2 */
     if (encrypt) {
-        memcpy(A, X + 0, u); A[u] = '\0';
-        memcpy(B, X + u, v); B[v] = '\0';
+        res = __u128_set_rnum(&nA, X + 0, u, radix);
+        if (!res) {
+            res = __u128_set_rnum(&nB, X + u, v, radix);
+        }
     } else {
-        memcpy(B, X + 0, u); B[u] = '\0';
-        memcpy(A, X + u, v); A[v] = '\0';
+        res = __u128_set_rnum(&nB, X + 0, u, radix);
+        if (!res) {
+            res = __u128_set_rnum(&nA, X + u, v, radix);
+        }
     }
 
-    /* Step 3 */
-    memcpy(&Tw[0][0], &T[0], 3);
-    Tw[0][3] = T[3] & 0xf0;
+    if (res) {
+        return res;
+    }
 
-    memcpy(&Tw[1][0], &T[4], 3);
-    Tw[1][3] = (T[3] & 0x0f) << 4;
+    for (unsigned int i = 0; i < 8; i++) {
+        ff3_1_wide_put(P, Tw, i, nB, encrypt);
+        ffx_ciph(&ctx->ffx, ws, P, P);
+        ff3_1_wide_step(len, ctx->ffx.radix_bits, P, i, &nA, &nB, encrypt);
+    }
+
+    /* Step 5 */
+    if (encrypt) {
+        __u128_get_rnum(Y + 0, u, radix, nA);
+        __u128_get_rnum(Y + u, v, radix, nB);
+    } else {
+        __u128_get_rnum(Y + 0, u, radix, nB);
+        __u128_get_rnum(Y + u, v, radix, nA);
+    }
+
+    memset(P, 0, sizeof(P));
+
+    return 0;
+}
+#endif
+
+/*
+ * Steps 2 - 5 using big integers
+ *
+ * @S must point to space for 3 * u numerals. the halves of
+ * the text aren't terminated, so their lengths are tracked
+ * alongside them.
+ */
+static
+int ff3_1_cipher_bigint(struct ff3_1_ctx * const ctx,
+                        struct ffx_ws * const ws,
+                        const struct ffx_len * const len,
+                        uint16_t * const Y,
+                        const uint16_t * const X,
+                        const uint8_t Tw[2][4],
+                        uint16_t * const S,
+                        const int encrypt)
+{
+    /* u and v are swapped relative to ff1 */
+    const unsigned int v = len->u, u = len->v;
+
+    uint8_t P[16];
+
+    uint16_t * A, * B, * C;
+    unsigned int la, lb;
+
+    /*
+     * the big integers are part of the workspace
+     * and retain their storage between operations
+     */
+    bigint_t * const y = &ws->y;
+    bigint_t * const c = &ws->a;
+
+    A = S;
+    B = A + u;
+    C = B + u;
+
+    /* Step 2 */
+    if (encrypt) {
+        memcpy(A, X + 0, u * sizeof(*A)); la = u;
+        memcpy(B, X + u, v * sizeof(*B)); lb = v;
+    } else {
+        memcpy(B, X + 0, u * sizeof(*B)); lb = u;
+        memcpy(A, X + u, v * sizeof(*A)); la = v;
+    }
 
     for (unsigned int i = 0; i < 8; i++) {
         /* Step 4i */
         const uint8_t * const W = Tw[(i + !!encrypt) % 2];
         const unsigned int m = ((i + !!encrypt) % 2) ? u : v;
-
-        uint8_t * numb;
-        size_t numc;
+        const bigint_t * const mX = (m == len->u) ? &len->mU : &len->mV;
 
         /* Step 4ii */
         /* W ^ i */
         memcpy(P, W, 4);
         P[3] ^= encrypt ? i : (7 - i);
         /*
-         * reverse @B and convert numeral string to integer
-         * which is then exported to a number as a byte array
+         * reverse @B and convert the numerals to an integer
+         * which is then exported to a number as a byte array,
+         * zero padded on the left, if necessary
          */
-        ffx_revs(C, B);
-        bigint_set_str(&c, C, ctx->ffx.radix);
-        numb = bigint_export(&c, &numc);
-        if (12 <= numc) {
-            memcpy(&P[4], numb, 12);
-        } else {
-            /* zero pad on left, if necessary */
-            memset(&P[4], 0, 12 - numc);
-            memcpy(&P[4 + (12 - numc)], numb, numc);
-        }
-        free(numb);
+        ffx_revu16(C, B, lb);
+        __bigint_set_num(c, C, lb, ctx->ffx.radix, &len->pw, ws->dc);
+        bigint_export_fixed(c, &P[4], 12);
 
         /* Step 4iii */
         ffx_revb(P, P, sizeof(P));
-        ffx_ciph(&ctx->ffx, P, P);
+        ffx_ciph(&ctx->ffx, ws, P, P);
         ffx_revb(P, P, sizeof(P));
 
         /* Step 4iv */
-        bigint_import(&y, P, sizeof(P));
+        bigint_import(y, P, sizeof(P));
 
         /* Step 4v */
         /*
          * set c to the reversal of A converted
          * to an integer under the radix
          */
-        ffx_revs(C, A);
-        bigint_set_str(&c, C, ctx->ffx.radix);
+        ffx_revu16(C, A, la);
+        __bigint_set_num(c, C, la, ctx->ffx.radix, &len->pw, ws->dc);
         /* c = rev(A) +/- y */
         if (encrypt) {
-            bigint_add(&c, &c, &y);
+            bigint_add(c, c, y);
         } else {
-            bigint_sub(&c, &c, &y);
+            bigint_sub(c, c, y);
         }
-        /* now set @y to radix**m */
-        bigint_set_ui(&y, ctx->ffx.radix);
-        bigint_pow_ui(&y, &y, m);
         /* c = (rev(A) +/- y) mod radix**m */
-        bigint_mod(&c, &c, &y);
+        bigint_mod(c, c, mX);
 
         /* Step 4vi */
-        ffx_str(C, u + 2, m, ctx->ffx.radix, &c);
-        ffx_revs(C, C);
+        __bigint_get_num_consume(C, m, ctx->ffx.radix, c,
+                                 &len->pw, ws->dc);
+        ffx_revu16(C, C, m);
 
         {
-            char * const tmp = A;
+            uint16_t * const tmp = A;
             /* Step 4vii */
-            A = B;
+            A = B; la = lb;
             /* Step 4viii */
-            B = C;
+            B = C; lb = m;
             C = tmp;
         }
     }
 
     /* Step 5 */
     if (encrypt) {
-        strcpy(Y, A);
-        strcat(Y, B);
+        memcpy(Y + 0, A, la * sizeof(*Y));
+        memcpy(Y + la, B, lb * sizeof(*Y));
     } else {
-        strcpy(Y, B);
-        strcat(Y, A);
+        memcpy(Y + 0, B, lb * sizeof(*Y));
+        memcpy(Y + lb, A, la * sizeof(*Y));
     }
 
-    memset(scratch.buf, 0, scratch.len);
-    free(scratch.buf);
     memset(P, 0, sizeof(P));
 
-    bigint_deinit(&c);
-    bigint_deinit(&y);
-
     return 0;
 }
 
+/* Step 3 */
+static inline
+void ff3_1_tweak_split(uint8_t Tw[2][4], const uint8_t * const T)
+{
+    memcpy(&Tw[0][0], &T[0], 3);
+    Tw[0][3] = T[3] & 0xf0;
+
+    memcpy(&Tw[1][0], &T[4], 3);
+    Tw[1][3] = (T[3] & 0x0f) << 4;
+}
+
+/*
+ * @_X is a string of @_n bytes, which need not be terminated. If
+ * @ylen is NULL, @_Y receives a nul-terminated string. Otherwise, @_Y
+ * is a buffer of *@ylen bytes, which receives the string without a
+ * terminator, and *@ylen is set to its length.
+ */
+static
+int ff3_1_cipher_ws(struct ff3_1_ctx * const ctx, struct ffx_ws * const ws,
+                    char * const _Y, size_t * const ylen,
+                    const char * const _X, const size_t _n,
+                    const uint8_t * T /* T is always 56 bits */,
+                    const int encrypt)
+{
+    /* Step 1 */
+    size_t n = _n;
+
+    const struct ffx_len * len;
+    struct ffx_len tmp;
+
+    uint8_t Tw[2][4];
+
+    struct {
+        uint8_t * buf;
+        size_t len;
+    } scratch;
+    size_t m;
+    uint16_t * X;
+
+    int res;
+
+    /* use the default tweak if none is given */
+    if (!T) {
+        T = ctx->ffx.twk.buf;
+    }
+
+    /*
+     * the text is translated to numerals, at the front of the
+     * workspace, in a single pass. the algorithm works on those
+     * from start to finish, writing its output over them, and the
+     * result is translated back in a single pass at the end
+     */
+    m = (n * sizeof(*X) + 15) & ~(size_t)15;
+    X = ffx_ws_reserve(ws, m);
+    if (!X) {
+        return -ENOMEM;
+    }
+
+    res = ffx_str_to_num(&ctx->ffx, X, &n, _X);
+    if (res) {
+        ffx_ws_clear(ws, m);
+        return res;
+    }
+
+    /* check the text length */
+    if (n < ctx->ffx.txtlen.min ||
+        n > ctx->ffx.txtlen.max) {
+        ffx_ws_clear(ws, m);
+        return -EINVAL;
+    }
+
+    len = ffx_len_acquire(&ctx->ffx, n, &tmp);
+
+    /*
+     * the big integer implementation needs space for
+     * three (the larger of the) halves of the text
+     */
+    scratch.len = m;
+#if defined(__SIZEOF_INT128__)
+    if (!len->wide)
+#endif
+    {
+        scratch.len += 3 * len->v * sizeof(*X);
+    }
+
+    scratch.buf = ffx_ws_reserve(ws, scratch.len);
+    if (!scratch.buf) {
+        ffx_ws_clear(ws, m);
+        ffx_len_release(len, &tmp);
+        return -ENOMEM;
+    }
+    X = (uint16_t *)scratch.buf;
+
+    /* Step 3 */
+    ff3_1_tweak_split(Tw, T);
+
+#if defined(__SIZEOF_INT128__)
+    if (len->wide) {
+        res = ff3_1_cipher_wide(ctx, ws, len, X, X, Tw, encrypt);
+    } else
+#endif
+    {
+        res = ff3_1_cipher_bigint(
+            ctx, ws, len, X, X, Tw, (uint16_t *)(scratch.buf + m), encrypt);
+    }
+
+    if (res) {
+        /* invalid input */
+    } else if (ylen) {
+        res = ffx_num_to_buf(&ctx->ffx, _Y, ylen, X, n);
+    } else {
+        res = ffx_num_to_str(&ctx->ffx, _Y, X, n);
+    }
+
+    ffx_ws_clear(ws, scratch.len);
+    ffx_len_release(len, &tmp);
+
+    return res;
+}
+
+/* see ff1_cipher() */
+static
+int ff3_1_cipher(struct ff3_1_ctx * const ctx,
+                 char * const _Y, size_t * const ylen,
+                 const char * const _X, const size_t _n,
+                 const uint8_t * T /* T is always 56 bits */,
+                 const int encrypt)
+{
+    struct ffx_ws * const ws = ffx_ws_acquire(&ctx->ffx);
+    int res = -ENOMEM;
+
+    if (ws) {
+        res = ff3_1_cipher_ws(ctx, ws, _Y, ylen, _X, _n, T, encrypt);
+        ffx_ws_release(&ctx->ffx, ws);
+    }
+
+    return res;
+}
+
 int ff3_1_encrypt(struct ff3_1_ctx * const ctx,
                   char * const Y,
                   const char * const X,
                   const uint8_t * const T /* T is always 56 bits */)
 {
-    return ff3_1_cipher(ctx, Y, X, T, 1);
+    return ff3_1_cipher(ctx, Y, NULL, X, strlen(X), T, 1);
 }
 
 int ff3_1_decrypt(struct ff3_1_ctx * const ctx,
@@ -228,5 +550,580 @@ int ff3_1_decrypt(struct ff3_1_ctx * const ctx,
                   const char * const X,
                   const uint8_t * const T /* T is always 56 bits */)
 {
-    return ff3_1_cipher(ctx, Y, X, T, 0);
+    return ff3_1_cipher(ctx, Y, NULL, X, strlen(X), T, 0);
+}
+
+int ff3_1_encrypt_len(struct ff3_1_ctx * const ctx,
+                      char * const Y, size_t * const ylen,
+                      const char * const X, const size_t xlen,
+                      const uint8_t * const T /* T is always 56 bits */)
+{
+    return ff3_1_cipher(ctx, Y, ylen, X, xlen, T, 1);
+}
+
+int ff3_1_decrypt_len(struct ff3_1_ctx * const ctx,
+                      char * const Y, size_t * const ylen,
+                      const char * const X, const size_t xlen,
+                      const uint8_t * const T /* T is always 56 bits */)
+{
+    return ff3_1_cipher(ctx, Y, ylen, X, xlen, T, 0);
+}
+
+size_t ff3_1_output_len(const struct ff3_1_ctx * const ctx,
+                        const size_t xlen)
+{
+    return ffx_output_len(&ctx->ffx, xlen);
+}
+
+/*
+ * FF3-1 for @cnt (at most FFX_AES_LANES) texts at once, in the manner
+ * of ff1_cipher_native_xn(). The texts are all @xlen bytes long, and
+ * @T[k] is the tweak for @X[k] or NULL for the default. If @ylen is
+ * 0, @Y[k] receives a nul-terminated string. Otherwise, it receives
+ * the string, without a terminator, in a buffer of @ylen bytes.
+ *
+ * Returns 0 if all of the texts were processed. Otherwise, the
+ * caller must process them one at a time.
+ */
+static
+int ff3_1_cipher_wide_xn(struct ff3_1_ctx * const ctx,
+                         struct ffx_ws * const ws,
+                         char * const * const Y, const size_t ylen,
+                         const char * const * const X, const size_t xlen,
+                         const uint8_t * const * const T,
+                         const size_t cnt,
+                         const int encrypt)
+{
+#if defined(__SIZEOF_INT128__)
+    static const uint8_t zero[16] = { 0 };
+
+    const unsigned int radix = ctx->ffx.radix;
+
+    uint8_t * P[FFX_AES_LANES];
+    const uint8_t * Z[FFX_AES_LANES];
+    uint8_t Tw[FFX_AES_LANES][2][4];
+    unsigned __int128 nA[FFX_AES_LANES], nB[FFX_AES_LANES];
+
+    const struct ffx_len * len;
+    struct ffx_len tmp;
+
+    struct {
+        uint8_t * buf;
+        size_t len;
+    } scratch;
+    size_t m, n;
+    unsigned int u, v;
+
+    int res;
+
+    /* the numerals of each text, @m bytes apart, followed by each P */
+    m = (xlen * sizeof(uint16_t) + 15) & ~(size_t)15;
+    scratch.len = cnt * (m + 16);
+    scratch.buf = ffx_ws_reserve(ws, scratch.len);
+    if (!scratch.buf) {
+        return -ENOMEM;
+    }
+
+    n = 0;
+    res = 0;
+    for (size_t k = 0; !res && k < cnt; k++) {
+        size_t nk = xlen;
+
+        res = ffx_str_to_num(
+            &ctx->ffx, (uint16_t *)(scratch.buf + k * m), &nk, X[k]);
+        if (!res && k > 0 && nk != n) {
+            res = -EINVAL;
+        }
+        n = nk;
+    }
+    if (!res && (n < ctx->ffx.txtlen.min || n > ctx->ffx.txtlen.max)) {
+        res = -EINVAL;
+    }
+    if (res) {
+        ffx_ws_clear(ws, scratch.len);
+        return res;
+    }
+
+    len = ffx_len_acquire(&ctx->ffx, n, &tmp);
+    if (!len->wide) {
+        ffx_ws_clear(ws, scratch.len);
+        ffx_len_release(len, &tmp);
+        return -EAGAIN;
+    }
+
+    /* u and v are swapped relative to ff1 */
+    v = len->u;
+    u = len->v;
+
+    /* Steps 2 and 3 */
+    for (size_t k = 0; !res && k < cnt; k++) {
+        const uint16_t * const Xk = (uint16_t *)(scratch.buf + k * m);
+
+        P[k] = scratch.buf + cnt * m + k * 16;
+        Z[k] = zero;
+
+        ff3_1_tweak_split(Tw[k], (T && T[k]) ? T[k] : ctx->ffx.twk.buf);
+
+        if (encrypt) {
+            res = __u128_set_rnum(&nA[k], Xk + 0, u, radix);
+            if (!res) {
+                res = __u128_set_rnum(&nB[k], Xk + u, v, radix);
+            }
+        } else {
+            res = __u128_set_rnum(&nB[k], Xk + 0, u, radix);
+            if (!res) {
+                res = __u128_set_rnum(&nA[k], Xk + u, v, radix);
+            }
+        }
+    }
+
+    /*
+     * Step 4, as in ff3_1_cipher_wide(). with a zero iv, the
+     * prf of a single block is just the cipher
+     */
+    for (unsigned int i = 0; !res && i < 8; i++) {
+        for (size_t k = 0; k < cnt; k++) {
+            ff3_1_wide_put(P[k], Tw[k], i, nB[k], encrypt);
+        }
+
+        ffx_prf_xn(&ctx->ffx, ws, cnt,
+                   P, Z, (const uint8_t * const *)P, 16);
+
+        for (size_t k = 0; k < cnt; k++) {
+            ff3_1_wide_step(len, ctx->ffx.radix_bits, P[k], i,
+                            &nA[k], &nB[k], encrypt);
+        }
+    }
+
+    /* Step 5 */
+    for (size_t k = 0; !res && k < cnt; k++) {
+        uint16_t * const Yk = (uint16_t *)(scratch.buf + k * m);
+
+        if (encrypt) {
+            __u128_get_rnum(Yk + 0, u, radix, nA[k]);
+            __u128_get_rnum(Yk + u, v, radix, nB[k]);
+        } else {
+            __u128_get_rnum(Yk + 0, u, radix, nB[k]);
+            __u128_get_rnum(Yk + u, v, radix, nA[k]);
+        }
+
+        if (ylen) {
+            size_t yl = ylen;
+
+            res = ffx_num_to_buf(&ctx->ffx, Y[k], &yl, Yk, n);
+        } else {
+            res = ffx_num_to_str(&ctx->ffx, Y[k], Yk, n);
+        }
+    }
+
+    ffx_ws_clear(ws, scratch.len);
+    memset(nA, 0, sizeof(nA));
+    memset(nB, 0, sizeof(nB));
+    memset(Tw, 0, sizeof(Tw));
+    ffx_len_release(len, &tmp);
+
+    return res;
+#else
+    (void)ctx;
+    (void)ws;
+    (void)Y;
+    (void)ylen;
+    (void)X;
+    (void)xlen;
+    (void)T;
+    (void)cnt;
+    (void)encrypt;
+
+    return -EAGAIN;
+#endif
+}
+
+/*
+ * whether texts of @xlen bytes may be processed by
+ * ff3_1_cipher_wide_xn(), as for ff1_native_len()
+ */
+static
+int ff3_1_wide_len(struct ff3_1_ctx * const ctx, const size_t xlen)
+{
+    const struct ffx_len * len;
+    struct ffx_len tmp;
+    size_t n;
+    int wide;
+
+    n = ffx_input_len(&ctx->ffx, xlen);
+    if (n == 0) {
+        return 1;
+    }
+
+    if (n < ctx->ffx.txtlen.min || n > ctx->ffx.txtlen.max) {
+        return 0;
+    }
+
+    len = ffx_len_acquire(&ctx->ffx, n, &tmp);
+    wide = len->wide;
+    ffx_len_release(len, &tmp);
+
+    return wide;
+}
+
+/* the record at position @i of a batch */
+static
+int ff3_1_cipher_batch_one(struct ff3_1_ctx * const ctx,
+                           struct ffx_ws * const ws,
+                           char * const * const Y,
+                           const char * const * const X,
+                           const size_t * const Xlen,
+                           const uint8_t * const * const T,
+                           const size_t i,
+                           const int encrypt)
+{
+    if (!Y[i] || !X[i]) {
+        return -EINVAL;
+    }
+
+    return ff3_1_cipher_ws(ctx, ws, Y[i], NULL, X[i],
+                           Xlen ? Xlen[i] : strlen(X[i]),
+                           T ? T[i] : NULL, encrypt);
+}
+
+/*
+ * the records of a batch from @lo up to @hi, using the workspace @ws.
+ * see ff1_cipher_batch_ws(). records are bucketed by length, whatever
+ * their tweaks
+ */
+static
+int ff3_1_cipher_batch_ws(struct ff3_1_ctx * const ctx,
+                          struct ffx_ws * const ws,
+                          char * const * const Y,
+                          const char * const * const X,
+                          const size_t * const Xlen,
+                          const uint8_t * const * const T,
+                          const size_t lo, const size_t hi,
+                          int * const status,
+                          const int encrypt)
+{
+    const unsigned int lanes = ffx_prf_lanes(&ctx->ffx);
+
+    struct ffx_bucket * B;
+    size_t k, fail;
+    int res;
+
+    B = NULL;
+    if (lanes > 1 && hi - lo > 1) {
+        B = ffx_ws_buckets(ws, hi - lo);
+    }
+
+    fail = SIZE_MAX;
+    res = 0;
+
+    k = 0;
+    for (size_t i = lo; i < hi; i++) {
+        if (B && Y[i] && X[i]) {
+            B[k].n = Xlen ? Xlen[i] : strlen(X[i]);
+            B[k].i = i;
+            k++;
+        } else {
+            ffx_bucket_status(
+                status, i,
+                ff3_1_cipher_batch_one(ctx, ws, Y, X, Xlen, T, i, encrypt),
+                &fail, &res);
+        }
+    }
+
+    if (k > 1) {
+        ffx_bucket_sort(B, k);
+    }
+
+    for (size_t i = 0; i < k;) {
+        size_t j = i + 1;
+
+        while (j < k && j - i < lanes && B[j].n == B[i].n) {
+            j++;
+        }
+
+        if (j - i > 1 && ff3_1_wide_len(ctx, B[i].n)) {
+            char * Yp[FFX_AES_LANES];
+            const char * Xp[FFX_AES_LANES];
+            const uint8_t * Tp[FFX_AES_LANES];
+
+            for (size_t l = i; l < j; l++) {
+                Yp[l - i] = Y[B[l].i];
+                Xp[l - i] = X[B[l].i];
+                Tp[l - i] = T ? T[B[l].i] : NULL;
+            }
+
+            if (ff3_1_cipher_wide_xn(ctx, ws, Yp, 0, Xp, B[i].n, Tp,
+                                     j - i, encrypt) == 0) {
+                for (; i < j; i++) {
+                    ffx_bucket_status(status, B[i].i, 0, &fail, &res);
+                }
+                continue;
+            }
+        }
+
+        for (; i < j; i++) {
+            ffx_bucket_status(
+                status, B[i].i,
+                ff3_1_cipher_batch_one(ctx, ws, Y, X, Xlen, T, B[i].i,
+                                       encrypt),
+                &fail, &res);
+        }
+    }
+
+    return res;
+}
+
+static
+int ff3_1_cipher_batch(struct ff3_1_ctx * const ctx,
+                       char * const * const Y,
+                       const char * const * const X,
+                       const size_t * const Xlen,
+                       const uint8_t * const * const T,
+                       const size_t cnt,
+                       int * const status,
+                       const int encrypt)
+{
+    /*
+     * one workspace is used for all of the records, and the cached
+     * lengths and the key schedule carry over between them
+     */
+    struct ffx_ws * ws;
+    int res;
+
+    ws = ffx_ws_acquire(&ctx->ffx);
+    if (!ws) {
+        return -ENOMEM;
+    }
+
+    res = ff3_1_cipher_batch_ws(ctx, ws, Y, X, Xlen, T, 0, cnt, status,
+                                encrypt);
+
+    ffx_ws_release(&ctx->ffx, ws);
+
+    return res;
+}
+
+int ff3_1_encrypt_batch(struct ff3_1_ctx * const ctx,
+                        char * const * const Y,
+                        const char * const * const X,
+                        const size_t * const Xlen,
+                        const uint8_t * const * const T,
+                        const size_t cnt,
+                        int * const status)
+{
+    return ff3_1_cipher_batch(ctx, Y, X, Xlen, T, cnt, status, 1);
+}
+
+int ff3_1_decrypt_batch(struct ff3_1_ctx * const ctx,
+                        char * const * const Y,
+                        const char * const * const X,
+                        const size_t * const Xlen,
+                        const uint8_t * const * const T,
+                        const size_t cnt,
+                        int * const status)
+{
+    return ff3_1_cipher_batch(ctx, Y, X, Xlen, T, cnt, status, 0);
+}
+
+/* see ff1_cipher_batch_mt() */
+struct ff3_1_batch
+{
+    struct ff3_1_ctx * ctx;
+    char * const * Y;
+    const char * const * X;
+    const size_t * Xlen;
+    const uint8_t * const * T;
+    int * status;
+    int encrypt;
+};
+
+struct ff3_1_batch_worker
+{
+    struct ffx_ws * ws;
+};
+
+static
+int ff3_1_batch_run(void * const _b, void * const _w,
+                    const size_t lo, const size_t hi)
+{
+    const struct ff3_1_batch * const b = _b;
+    struct ff3_1_batch_worker * const w = _w;
+
+    if (!w->ws) {
+        w->ws = ffx_ws_acquire(&b->ctx->ffx);
+        if (!w->ws) {
+            for (size_t i = lo; b->status && i < hi; i++) {
+                b->status[i] = -ENOMEM;
+            }
+            return -ENOMEM;
+        }
+    }
+
+    return ff3_1_cipher_batch_ws(b->ctx, w->ws, b->Y, b->X, b->Xlen, b->T,
+                                 lo, hi, b->status, b->encrypt);
+}
+
+static
+void ff3_1_batch_fini(void * const _b, void * const _w)
+{
+    const struct ff3_1_batch * const b = _b;
+    struct ff3_1_batch_worker * const w = _w;
+
+    if (w->ws) {
+        ffx_ws_release(&b->ctx->ffx, w->ws);
+    }
+}
+
+static
+int ff3_1_cipher_batch_mt(struct ff3_1_ctx * const ctx,
+                          struct fpe_pool * const pool,
+                          char * const * const Y,
+                          const char * const * const X,
+                          const size_t * const Xlen,
+                          const uint8_t * const * const T,
+                          const size_t cnt,
+                          int * const status,
+                          const int encrypt)
+{
+    struct ff3_1_batch b = {
+        ctx, Y, X, Xlen, T, status, encrypt,
+    };
+    const struct ffx_pool_job job = {
+        ff3_1_batch_run, ff3_1_batch_fini,
+        &b, sizeof(struct ff3_1_batch_worker),
+    };
+
+    if (!pool) {
+        return ff3_1_cipher_batch(ctx, Y, X, Xlen, T, cnt, status, encrypt);
+    }
+
+    return ffx_pool_run(pool, &job, cnt);
+}
+
+int ff3_1_encrypt_batch_mt(struct ff3_1_ctx * const ctx,
+                           struct fpe_pool * const pool,
+                           char * const * const Y,
+                           const char * const * const X,
+                           const size_t * const Xlen,
+                           const uint8_t * const * const T,
+                           const size_t cnt,
+                           int * const status)
+{
+    return ff3_1_cipher_batch_mt(ctx, pool, Y, X, Xlen, T, cnt, status, 1);
+}
+
+int ff3_1_decrypt_batch_mt(struct ff3_1_ctx * const ctx,
+                           struct fpe_pool * const pool,
+                           char * const * const Y,
+                           const char * const * const X,
+                           const size_t * const Xlen,
+                           const uint8_t * const * const T,
+                           const size_t cnt,
+                           int * const status)
+{
+    return ff3_1_cipher_batch_mt(ctx, pool, Y, X, Xlen, T, cnt, status, 0);
+}
+
+static
+int ff3_1_cipher_strided(struct ff3_1_ctx * const ctx,
+                         char * const Y, const size_t ystride,
+                         const char * const X, const size_t xstride,
+                         const size_t width, const size_t cnt,
+                         const uint8_t * const T,
+                         int * const status,
+                         const int encrypt)
+{
+    struct ffx_ws * ws;
+
+    const uint8_t * Tp[FFX_AES_LANES];
+    unsigned int lanes;
+    int res = 0;
+
+    /* see ff1_cipher_strided() */
+    if (ctx->ffx.u8_map || ctx->ffx.radix > 255) {
+        return -EINVAL;
+    }
+    if (width < ctx->ffx.txtlen.min || width > ctx->ffx.txtlen.max) {
+        return -EINVAL;
+    }
+
+    ws = ffx_ws_acquire(&ctx->ffx);
+    if (!ws) {
+        return -ENOMEM;
+    }
+
+    /* see ff1_cipher_strided() */
+    lanes = ffx_prf_lanes(&ctx->ffx);
+    if (lanes > 1 && !ff3_1_wide_len(ctx, width)) {
+        lanes = 1;
+    }
+
+    for (unsigned int k = 0; k < FFX_AES_LANES; k++) {
+        Tp[k] = T;
+    }
+
+    for (size_t i = 0; i < cnt;) {
+        /* see ff1_cipher_strided() */
+        const size_t j = (cnt - i > lanes) ? i + lanes : cnt;
+
+        if (j - i > 1) {
+            char * Yp[FFX_AES_LANES];
+            const char * Xp[FFX_AES_LANES];
+
+            for (size_t k = 0; k < j - i; k++) {
+                Yp[k] = Y + (i + k) * ystride;
+                Xp[k] = X + (i + k) * xstride;
+            }
+
+            if (ff3_1_cipher_wide_xn(ctx, ws, Yp, width, Xp, width,
+                                     Tp, j - i, encrypt) == 0) {
+                for (; status && i < j; i++) {
+                    status[i] = 0;
+                }
+                i = j;
+                continue;
+            }
+        }
+
+        for (; i < j; i++) {
+            size_t n = width;
+            int err;
+
+            err = ff3_1_cipher_ws(ctx, ws, Y + i * ystride, &n,
+                                  X + i * xstride, width, T, encrypt);
+
+            if (status) {
+                status[i] = err;
+            }
+            if (err && !res) {
+                res = err;
+            }
+        }
+    }
+
+    ffx_ws_release(&ctx->ffx, ws);
+
+    return res;
+}
+
+int ff3_1_encrypt_strided(struct ff3_1_ctx * const ctx,
+                          char * const Y, const size_t ystride,
+                          const char * const X, const size_t xstride,
+                          const size_t width, const size_t cnt,
+                          const uint8_t * const T,
+                          int * const status)
+{
+    return ff3_1_cipher_strided(ctx, Y, ystride, X, xstride, width, cnt,
+                                T, status, 1);
+}
+
+int ff3_1_decrypt_strided(struct ff3_1_ctx * const ctx,
+                          char * const Y, const size_t ystride,
+                          const char * const X, const size_t xstride,
+                          const size_t width, const size_t cnt,
+                          const uint8_t * const T,
+                          int * const status)
+{
+    return ff3_1_cipher_strided(ctx, Y, ystride, X, xstride, width, cnt,
+                                T, status, 0);
 }
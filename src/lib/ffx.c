@@ -1,6 +1,7 @@
 #include <ubiq/fpe/internal/ffx.h>
 
 #include <math.h>
+#include <stdlib.h>
 #include <unistr.h>
 #include <uniwidth.h>
 #include <wchar.h>
@@ -37,12 +38,12 @@ int ffx_ctx_create(void ** const _ctx,
         return -EINVAL;
     }
 
-    // /*
-    //  * FF1 and FF3-1 support a radix up to 65536, but the
-    //  * implementation becomes increasingly difficult and
-    //  * less useful in practice after the limits below.
-    //  */
-    if (radix < 2 || radix > 255) {
+    /*
+     * FF1 and FF3-1 support a radix up to 65536. texts in a radix
+     * larger than 255 can't be represented in the standard character
+     * sets, though, and are handled internally as arrays of numerals
+     */
+    if (radix < 2 || radix > 65536) {
         return -EINVAL;
     }
 
@@ -88,8 +89,21 @@ int ffx_ctx_create(void ** const _ctx,
             static const uint8_t IV[16] = { 0 };
 
             ctx->radix = radix;
+            ctx->radix_bits = 0;
+            if ((radix & (radix - 1)) == 0) {
+                while ((1u << ctx->radix_bits) < radix) {
+                    ctx->radix_bits++;
+                }
+            }
             ctx->custom_radix_str = NULL;
             ctx->u32_custom_radix_str = NULL;
+            memset(&ctx->map, 0, sizeof(ctx->map));
+            if (radix <= 255) {
+                map_numerals_tbl_init(
+                    ctx->map.in, ctx->map.out,
+                    get_standard_bignum_radix(radix), radix, radix <= 36);
+            }
+            ctx->u8_map = NULL;
 
             ctx->txtlen.min = mintxtlen;
             ctx->txtlen.max = maxtxtlen;
@@ -101,6 +115,11 @@ int ffx_ctx_create(void ** const _ctx,
             ctx->twk.len = twklen;
             memcpy(ctx->twk.buf, twkbuf, twklen);
 
+            ctx->lens.cnt = 0;
+
+            pthread_mutex_init(&ctx->lock, NULL);
+            ctx->ws = NULL;
+
             /*
              * allocate and initialize the EVP with the key. the
              * IV is a constant string of 0's for both ff1 and ff3-1
@@ -108,10 +127,30 @@ int ffx_ctx_create(void ** const _ctx,
             EVP_EncryptInit_ex(ctx->evp, ciph, NULL, keybuf, IV);
             /* don't do any padding */
             EVP_CIPHER_CTX_set_padding(ctx->evp, 0);
+
+            /*
+             * the native implementation is preferred as it avoids
+             * the evp bookkeeping on every call to the prf. the
+             * evp context is kept regardless as a fallback (and
+             * is copied into each workspace, as they're created)
+             */
+            ctx->aesni = ffx_aesni_supported();
+            ctx->vaes = 0;
+            if (ctx->aesni) {
+                ffx_aesni_expand(&ctx->aes, keybuf, keylen);
+                ctx->vaes = ffx_vaes_supported();
+            } else {
+                memset(&ctx->aes, 0, sizeof(ctx->aes));
+            }
+
+            ctx->avx2 = ffx_round_avx2_supported();
+            ctx->avx512 = ffx_round_avx512_supported();
         } else {
             free(*_ctx);
             return -ENOMEM;
         }
+    } else {
+        return -ENOMEM;
     }
 
     return 0;
@@ -137,8 +176,18 @@ int ffx_ctx_create_custom_radix_str(void ** const _ctx,
         // If the radix string contains multibyte values, then create the u32_version
         // else simply use the custom radix string.
         if (radix_len == radix_u8_mbsnlen) {
+            /* only possible if the alphabet repeats characters */
+            if (ctx->radix > 255) {
+                ffx_ctx_destroy(*_ctx, off);
+                return -EINVAL;
+            }
+
             ctx->custom_radix_str = strdup(custom_radix_str);
             ctx->u32_custom_radix_str = NULL;
+
+            map_numerals_tbl_init(
+                ctx->map.in, ctx->map.out,
+                (const char *)custom_radix_str, ctx->radix, 0);
         } else {
             uint32_t * tmp = NULL;
             size_t lengthp = 0;
@@ -146,26 +195,388 @@ int ffx_ctx_create_custom_radix_str(void ** const _ctx,
             tmp = u8_to_u32(custom_radix_str, u8_strlen(custom_radix_str) + 1, NULL, &lengthp);
             if (tmp != NULL) {
                 ctx->u32_custom_radix_str = tmp;
+
+                ctx->u8_map = malloc(sizeof(*ctx->u8_map));
+                if (ctx->u8_map) {
+                    x = map_numerals_u8_tbl_init(ctx->u8_map, tmp);
+                    if (x) {
+                        free(ctx->u8_map);
+                        ctx->u8_map = NULL;
+                    }
+                } else {
+                    x = -ENOMEM;
+                }
+            } else {
+                x = -ENOMEM;
             }
         }
+
+        if (x) {
+            ffx_ctx_destroy(*_ctx, off);
+        }
     }
     return x;
 
 }
 
+static
+void ffx_ws_destroy(struct ffx_ws * const ws);
+
 void ffx_ctx_destroy(void * const _ctx, const size_t off)
 {
     struct ffx_ctx * const ctx = (void *)((uint8_t *)_ctx + off);
     EVP_CIPHER_CTX_free(ctx->evp);
+    /*
+     * the context is about to be freed, which allows the compiler
+     * to drop a memset() of it. OPENSSL_cleanse() can't be dropped
+     */
+    OPENSSL_cleanse(&ctx->aes, sizeof(ctx->aes));
+    for (unsigned int i = 0; i < ctx->lens.cnt; i++) {
+        __bigint_pow_deinit(&ctx->lens.ent[i].pw);
+        bigint_deinit(&ctx->lens.ent[i].mV);
+        bigint_deinit(&ctx->lens.ent[i].mU);
+    }
+    while (ctx->ws) {
+        struct ffx_ws * const ws = ctx->ws;
+
+        ctx->ws = ws->next;
+        ffx_ws_destroy(ws);
+    }
+    pthread_mutex_destroy(&ctx->lock);
     if (ctx->custom_radix_str) {
         free(ctx->custom_radix_str);
     }
     if (ctx->u32_custom_radix_str) {
         free(ctx->u32_custom_radix_str);
     }
+    if (ctx->u8_map) {
+        map_numerals_u8_tbl_deinit(ctx->u8_map);
+        free(ctx->u8_map);
+    }
     free(_ctx);
 }
 
+static
+void ffx_len_init(struct ffx_len * const len,
+                  const unsigned int n, const unsigned int radix)
+{
+    len->n = n;
+    len->u = n / 2;
+    len->v = n - len->u;
+
+    bigint_init(&len->mU);
+    bigint_init(&len->mV);
+
+    bigint_set_ui(&len->mV, radix);
+    bigint_pow_ui(&len->mV, &len->mV, len->v);
+
+    /*
+     * FF1, Step 3: b = ceil(ceil(v * log2(radix)) / 8)
+     *
+     * ceil(log2(x)) is the number of bits needed to represent
+     * x - 1 (for x > 1), so the computation can be done exactly,
+     * in integers, rather than with floating point. mU is used
+     * temporarily to hold radix**v - 1.
+     */
+    bigint_sub_ui(&len->mU, &len->mV, 1);
+    len->b = (bigint_sizeinbase(&len->mU, 2) + 7) / 8;
+
+    bigint_set_ui(&len->mU, radix);
+    bigint_pow_ui(&len->mU, &len->mU, len->u);
+
+    len->native = (bigint_sizeinbase(&len->mV, 2) <= 64);
+    len->nU = len->nV = 0;
+    if (len->native) {
+        len->nU = bigint_get_u64(&len->mU);
+        len->nV = bigint_get_u64(&len->mV);
+    }
+
+#if defined(__SIZEOF_INT128__)
+    len->wide = (bigint_sizeinbase(&len->mV, 2) <= 128);
+    len->wU = len->wV = 0;
+    if (len->wide) {
+        len->wU = bigint_get_u128(&len->mU);
+        len->wV = bigint_get_u128(&len->mV);
+    }
+#endif
+
+    /* FF1, Step 4 */
+    len->d = 4 * ((len->b + 3) / 4) + 4;
+
+    /* neither half is longer than v numerals */
+    __bigint_pow_init(&len->pw, len->v, radix);
+}
+
+/*
+ * Returns the length-dependent parameters for texts of length
+ * @n. If the parameters are not already cached by the context,
+ * they are computed and added to the cache. If the cache is full,
+ * they are computed into @tmp instead.
+ *
+ * The caller must pass the returned pointer and @tmp to
+ * ffx_len_release() when the parameters are no longer needed.
+ *
+ * Entries are added to the cache under the context's lock and
+ * are complete before the count is (atomically) updated to
+ * include them, so lookups of cached lengths don't need the lock.
+ */
+const struct ffx_len * ffx_len_acquire(struct ffx_ctx * const ctx,
+                                       const unsigned int n,
+                                       struct ffx_len * const tmp)
+{
+    struct ffx_len * len;
+    unsigned int cnt, i;
+
+    cnt = __atomic_load_n(&ctx->lens.cnt, __ATOMIC_ACQUIRE);
+    for (i = 0; i < cnt; i++) {
+        if (ctx->lens.ent[i].n == n) {
+            return &ctx->lens.ent[i];
+        }
+    }
+
+    len = tmp;
+    if (cnt < FFX_LEN_CACHE) {
+        pthread_mutex_lock(&ctx->lock);
+
+        /* another thread may have added entries in the meantime */
+        for (cnt = ctx->lens.cnt; i < cnt; i++) {
+            if (ctx->lens.ent[i].n == n) {
+                pthread_mutex_unlock(&ctx->lock);
+                return &ctx->lens.ent[i];
+            }
+        }
+
+        if (cnt < FFX_LEN_CACHE) {
+            len = &ctx->lens.ent[cnt];
+            ffx_len_init(len, n, ctx->radix);
+            __atomic_store_n(&ctx->lens.cnt, cnt + 1, __ATOMIC_RELEASE);
+        }
+
+        pthread_mutex_unlock(&ctx->lock);
+    }
+
+    if (len == tmp) {
+        ffx_len_init(len, n, ctx->radix);
+    }
+
+    return len;
+}
+
+void ffx_len_release(const struct ffx_len * const len,
+                     struct ffx_len * const tmp)
+{
+    if (len == tmp) {
+        __bigint_pow_deinit(&tmp->pw);
+        bigint_deinit(&tmp->mV);
+        bigint_deinit(&tmp->mU);
+    }
+}
+
+static
+void ffx_ws_destroy(struct ffx_ws * const ws)
+{
+    EVP_CIPHER_CTX_free(ws->evp);
+    OPENSSL_cleanse(ws->mem.buf, ws->mem.len);
+    free(ws->mem.buf);
+    free(ws->bkt.buf);
+    for (unsigned int i = 0; i < BIGINT_POW_MAX; i++) {
+        bigint_deinit(&ws->dc[i]);
+    }
+    bigint_deinit(&ws->y);
+    bigint_deinit(&ws->b);
+    bigint_deinit(&ws->a);
+    free(ws);
+}
+
+struct ffx_ws * ffx_ws_acquire(struct ffx_ctx * const ctx)
+{
+    struct ffx_ws * ws;
+
+    pthread_mutex_lock(&ctx->lock);
+    ws = ctx->ws;
+    if (ws) {
+        ctx->ws = ws->next;
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    if (!ws) {
+        ws = malloc(sizeof(*ws));
+        if (ws) {
+            ws->evp = EVP_CIPHER_CTX_new();
+            if (!ws->evp || !EVP_CIPHER_CTX_copy(ws->evp, ctx->evp)) {
+                EVP_CIPHER_CTX_free(ws->evp);
+                free(ws);
+                return NULL;
+            }
+
+            ws->mem.buf = NULL;
+            ws->mem.len = 0;
+            ws->bkt.buf = NULL;
+            ws->bkt.cnt = 0;
+            bigint_init(&ws->a);
+            bigint_init(&ws->b);
+            bigint_init(&ws->y);
+            for (unsigned int i = 0; i < BIGINT_POW_MAX; i++) {
+                bigint_init(&ws->dc[i]);
+            }
+        }
+    }
+
+    return ws;
+}
+
+void ffx_ws_release(struct ffx_ctx * const ctx, struct ffx_ws * const ws)
+{
+    pthread_mutex_lock(&ctx->lock);
+    ws->next = ctx->ws;
+    ctx->ws = ws;
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+/*
+ * returns a pointer to at least @len bytes of scratch space from
+ * the workspace, or NULL if the space can't be allocated. the
+ * space is only allocated if the workspace is smaller than @len,
+ * in which case, the previous contents are moved to the new space.
+ * pointers into the workspace must be recomputed after this call
+ */
+void * ffx_ws_reserve(struct ffx_ws * const ws, const size_t len)
+{
+    if (ws->mem.len < len) {
+        uint8_t * const buf = malloc(len);
+
+        if (!buf) {
+            return NULL;
+        }
+
+        if (ws->mem.len) {
+            memcpy(buf, ws->mem.buf, ws->mem.len);
+        }
+        OPENSSL_cleanse(ws->mem.buf, ws->mem.len);
+        free(ws->mem.buf);
+
+        ws->mem.buf = buf;
+        ws->mem.len = len;
+    }
+
+    return ws->mem.buf;
+}
+
+/*
+ * erase the first @len bytes of the workspace, which
+ * must be no larger than the space most recently reserved
+ */
+void ffx_ws_clear(struct ffx_ws * const ws, const size_t len)
+{
+    if (len) {
+        memset(ws->mem.buf, 0, len);
+    }
+}
+
+/*
+ * returns space for @cnt buckets from the workspace, or NULL if the
+ * space can't be allocated. like ffx_ws_reserve(), the space only
+ * grows, but the previous contents are not preserved
+ */
+struct ffx_bucket * ffx_ws_buckets(struct ffx_ws * const ws, const size_t cnt)
+{
+    if (ws->bkt.cnt < cnt) {
+        struct ffx_bucket * const buf = malloc(cnt * sizeof(*buf));
+
+        if (!buf) {
+            return NULL;
+        }
+
+        free(ws->bkt.buf);
+        ws->bkt.buf = buf;
+        ws->bkt.cnt = cnt;
+    }
+
+    return ws->bkt.buf;
+}
+
+int ffx_str_to_num(const struct ffx_ctx * const ctx,
+                   uint16_t * const dst, size_t * const n,
+                   const char * const src)
+{
+    if (ctx->u8_map) {
+        return map_numerals_from_u8_tbl(
+            dst, n, (const uint8_t *)src, ctx->u8_map);
+    }
+
+    /*
+     * without a custom alphabet, there are no characters
+     * to represent the digits of a radix larger than 255
+     */
+    if (ctx->radix > 255) {
+        return -EINVAL;
+    }
+
+    return map_numerals_from_tbl(dst, src, *n, ctx->map.in);
+}
+
+int ffx_num_to_buf(const struct ffx_ctx * const ctx,
+                   char * const dst, size_t * const len,
+                   const uint16_t * const src, const size_t n)
+{
+    if (ctx->u8_map) {
+        return map_numerals_to_u8_tbl(
+            (uint8_t *)dst, len, src, n, ctx->u8_map);
+    }
+
+    if (*len < n) {
+        return -ENOSPC;
+    }
+
+    map_numerals_to_tbl(dst, src, n, ctx->map.out);
+    *len = n;
+
+    return 0;
+}
+
+int ffx_num_to_str(const struct ffx_ctx * const ctx,
+                   char * const dst,
+                   const uint16_t * const src, const size_t n)
+{
+    /* the caller guarantees that there is enough space */
+    size_t len = SIZE_MAX;
+    int res;
+
+    res = ffx_num_to_buf(ctx, dst, &len, src, n);
+    if (!res) {
+        dst[len] = '\0';
+    }
+
+    return res;
+}
+
+size_t ffx_output_len(const struct ffx_ctx * const ctx, const size_t len)
+{
+    /*
+     * the input has at most len / minlen characters, and
+     * each of the output characters is at most maxlen bytes
+     */
+    if (ctx->u8_map) {
+        return (len / ctx->u8_map->minlen) * ctx->u8_map->maxlen;
+    }
+
+    return len;
+}
+
+size_t ffx_input_len(const struct ffx_ctx * const ctx, const size_t len)
+{
+    if (ctx->u8_map) {
+        if (ctx->u8_map->minlen != ctx->u8_map->maxlen ||
+            len % ctx->u8_map->minlen != 0) {
+            return 0;
+        }
+
+        return len / ctx->u8_map->minlen;
+    }
+
+    return len;
+}
+
 /*
  * reverse a sequence of bytes. @dst and @src may be
  * equal but may not overlap, otherwise
@@ -192,21 +603,17 @@ uint8_t * ffx_revb(uint8_t * const dst,
     return dst;
 }
 
-uint32_t * ffx_revu32(uint32_t * const dst,
-                   const uint32_t * const src, const size_t len)
+uint16_t * ffx_revu16(uint16_t * const dst,
+                      const uint16_t * const src, const size_t len)
 {
     size_t i;
 
     for (i = 0; i < len / 2; i++) {
-        const uint32_t t = src[i];
+        const uint16_t t = src[i];
         dst[i] = src[(len - 1) - i];
         dst[(len - 1)- i] = t;
     }
 
-    /*
-     * if length is odd, there will be a byte in the
-     * middle untouched by the loop above
-     */
     if (len % 2) {
         dst[i] = src[i];
     }
@@ -214,53 +621,6 @@ uint32_t * ffx_revu32(uint32_t * const dst,
     return dst;
 }
 
-
-/*
- * convert a (big) integer, @n, to a string in the radix, @r,
- * with a length, @m. The caller must supply the space pointed
- * to by @str, and the number of bytes pointed to by @str is
- * indicated by @len, which must be at least @m + 2. (The
- * underlying number library sometimes overestimates the space
- * required to represent the string. The +2 includes 1 byte
- * for this overestimation and 1 byte for the nul terminator.)
- *
- * If, after conversion, the number of bytes necessary to
- * represent the @n is larger than @m, the function fails. if
- * the number of bytes is less than @m, the string is zero-padded
- * to the left.
- *
- * the function returns 0 on success
- */
-int ffx_str(char * const str, const size_t len,
-            const unsigned int m, const unsigned int r,
-            const bigint_t * const n)
-{
-    int res;
-
-    // TODO - this should be based on call to get zeroth character of std radix string for radix value
-    char c = '0';
-    if (r > 62) {
-        c = '\x01';
-    }
-
-    res = -EINVAL;
-    if (bigint_cmp_si(n, 0) >= 0) {
-        res = __bigint_get_str_radix(str, len, r, n);
-        if (res == 0) {
-            const size_t len = strlen(str);
-
-            if (len < m) {
-                memmove(str + (m - len), str, len + 1);
-                memset(str, c, m - len);
-            } else if (len > m) {
-                res = -EOVERFLOW;
-            }
-        }
-    }
-
-    return res;
-}
-
 /*
  * perform an aes-cbc encryption (with an IV of 0) of @src using
  * the supplied @ctx, storing the last block of output into @dst.
@@ -269,9 +629,26 @@ int ffx_str(char * const str, const size_t len,
  * location but may not overlap, otherwise. @dst must point to a
  * location at least 16 bytes long
  */
-int ffx_prf(struct ffx_ctx * const ctx,
+int ffx_prf(const struct ffx_ctx * const ctx, struct ffx_ws * const ws,
             uint8_t * const dst,
             const uint8_t * const src, const size_t len)
+{
+    static const uint8_t IV[16] = { 0 };
+
+    return ffx_prf_iv(ctx, ws, dst, IV, src, len);
+}
+
+/*
+ * same as ffx_prf() except that the encryption chains from the
+ * 16-byte block pointed to by @iv rather than from 0. This allows
+ * the caller to encrypt a common prefix once and then continue the
+ * chain from the output of that encryption. @len may be 0, in which
+ * case @iv is copied to @dst. @dst may point to the same location
+ * as @iv
+ */
+int ffx_prf_iv(const struct ffx_ctx * const ctx, struct ffx_ws * const ws,
+               uint8_t * const dst, const uint8_t * const iv,
+               const uint8_t * const src, const size_t len)
 {
     EVP_CIPHER_CTX * evp;
     int dstl;
@@ -280,13 +657,23 @@ int ffx_prf(struct ffx_ctx * const ctx,
         return -EINVAL;
     }
 
+    if (len == 0) {
+        memmove(dst, iv, 16);
+        return 0;
+    }
+
+    if (ctx->aesni) {
+        ffx_aesni_cbcmac(&ctx->aes, dst, iv, src, len);
+        return 0;
+    }
+
     /*
-     * the key was already set into the context. we can just
-     * copy the initialized structure into this new one
-     * to avoid the overhead of initialization every time
+     * the key was already set into the context. only the iv
+     * needs to be (re)set, which also resets the state left
+     * over from any previous use of the context
      */
-    evp = EVP_CIPHER_CTX_new();
-    EVP_CIPHER_CTX_copy(evp, ctx->evp);
+    evp = ws->evp;
+    EVP_EncryptInit_ex(evp, NULL, NULL, NULL, iv);
 
     /*
      * this function only returns the last encrypted block,
@@ -304,7 +691,6 @@ int ffx_prf(struct ffx_ctx * const ctx,
      * however, the output length parameter must still be valid
      */
     EVP_EncryptFinal_ex(evp, NULL, &dstl);
-    EVP_CIPHER_CTX_free(evp);
 
     return 0;
 }
@@ -316,8 +702,67 @@ int ffx_prf(struct ffx_ctx * const ctx,
  * @src and @dst must each be 16 bytes long. @src and @dst may
  * point to the same location or otherwise overlap
  */
-int ffx_ciph(struct ffx_ctx * const ctx,
+int ffx_ciph(const struct ffx_ctx * const ctx, struct ffx_ws * const ws,
              uint8_t * const dst, const uint8_t * const src)
 {
-    return ffx_prf(ctx, dst, src, 16);
+    return ffx_prf(ctx, ws, dst, src, 16);
+}
+
+/*
+ * the aes instructions take several cycles to produce a result but
+ * can start a new one every cycle or two, so a single chain leaves
+ * the processor mostly idle. 4 chains are enough to cover the latency
+ * of the aes-ni instructions; the vector instructions process 4
+ * blocks at a time, and 4 registers' worth of those are used
+ */
+unsigned int ffx_prf_lanes(const struct ffx_ctx * const ctx)
+{
+    if (ctx->aesni) {
+        return ctx->vaes ? FFX_AES_LANES : 4;
+    }
+
+    return 1;
+}
+
+int ffx_prf_xn(const struct ffx_ctx * const ctx, struct ffx_ws * const ws,
+               const unsigned int n,
+               uint8_t * const * const dst,
+               const uint8_t * const * const iv,
+               const uint8_t * const * const src, const size_t len)
+{
+    if (len % 16 || n > FFX_AES_LANES) {
+        return -EINVAL;
+    }
+
+    if (ctx->aesni) {
+        if (ctx->vaes) {
+            ffx_vaes_cbcmac_xn(&ctx->aes, n, dst, iv, src, len);
+        } else {
+            ffx_aesni_cbcmac_xn(&ctx->aes, n, dst, iv, src, len);
+        }
+        return 0;
+    }
+
+    for (unsigned int i = 0; i < n; i++) {
+        ffx_prf_iv(ctx, ws, dst[i], iv[i], src[i], len);
+    }
+
+    return 0;
+}
+
+static
+int ffx_bucket_cmp(const void * const _a, const void * const _b)
+{
+    const struct ffx_bucket * const a = _a, * const b = _b;
+
+    if (a->n != b->n) {
+        return (a->n < b->n) ? -1 : 1;
+    }
+
+    return (a->i < b->i) ? -1 : (a->i > b->i);
+}
+
+void ffx_bucket_sort(struct ffx_bucket * const B, const size_t cnt)
+{
+    qsort(B, cnt, sizeof(*B), ffx_bucket_cmp);
 }
@@ -0,0 +1,172 @@
+#include <ubiq/fpe/internal/map.h>
+
+#include <errno.h>
+
+/*
+ * this file is compiled with the flags necessary to enable the
+ * avx2 instructions (see lib/CMakeLists.txt). nothing in here
+ * may be called unless ffx_map_avx2_supported() says that the
+ * processor can execute them.
+ */
+#if defined(__AVX2__)
+
+#include <immintrin.h>
+
+int ffx_map_avx2_supported(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+/*
+ * the 256-byte table is treated as 16 rows of 16 bytes, one for
+ * each value of the upper nibble of a character. only the rows
+ * that contain anything need to be consulted; characters in the
+ * others aren't in the alphabet and map to 0, anyway. returns a
+ * mask of the rows that do
+ */
+static inline
+unsigned int map_rows(const uint8_t tbl[256])
+{
+    unsigned int rows = 0;
+
+    for (unsigned int h = 0; h < 16; h++) {
+        const __m128i row = _mm_loadu_si128((const __m128i *)&tbl[16 * h]);
+
+        if (!_mm_testz_si128(row, row)) {
+            rows |= 1u << h;
+        }
+    }
+
+    return rows;
+}
+
+/*
+ * translate 32 characters. each row is looked up with the lower
+ * nibble of every character. the xor and the saturating add leave
+ * the lower nibble (and a clear upper bit) only in those characters
+ * whose upper nibble selects the row. all of the others get the
+ * upper bit set, which causes the shuffle to produce 0 for them.
+ */
+static inline
+__m256i map_32(const uint8_t tbl[256], unsigned int rows, const __m256i s)
+{
+    const __m256i k = _mm256_set1_epi8(0x70);
+    __m256i d = _mm256_setzero_si256();
+
+    for (; rows; rows &= rows - 1) {
+        const unsigned int h = __builtin_ctz(rows);
+        const __m256i row = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128((const __m128i *)&tbl[16 * h]));
+        const __m256i idx = _mm256_adds_epu8(
+            _mm256_xor_si256(s, _mm256_set1_epi8((char)(h << 4))), k);
+
+        d = _mm256_or_si256(d, _mm256_shuffle_epi8(row, idx));
+    }
+
+    return d;
+}
+
+static inline
+__m256i map_load(const char * const src)
+{
+    return _mm256_loadu_si256((const __m256i *)src);
+}
+
+static inline
+int map_invalid(const __m256i d)
+{
+    return _mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(d, _mm256_setzero_si256())) != 0;
+}
+
+/*
+ * the position of the block of 32 that starts at @i. the last
+ * block is moved back so that it ends at @len, overlapping the
+ * one before it. the source and destination are never the same
+ * for the conversions below, so that is harmless
+ */
+static inline
+size_t map_block(const size_t i, const size_t len)
+{
+    return (i + 32 <= len) ? i : len - 32;
+}
+
+int ffx_map_avx2_to_num(uint16_t * const dst,
+                        const char * const src, const size_t len,
+                        const uint8_t tbl[256])
+{
+    const unsigned int rows = map_rows(tbl);
+
+    for (size_t i = 0; i < len; i += 32) {
+        const size_t j = map_block(i, len);
+        __m256i d = map_32(tbl, rows, map_load(&src[j]));
+
+        if (map_invalid(d)) {
+            return -EINVAL;
+        }
+        d = _mm256_sub_epi8(d, _mm256_set1_epi8(1));
+
+        _mm256_storeu_si256((__m256i *)&dst[j],
+                            _mm256_cvtepu8_epi16(_mm256_castsi256_si128(d)));
+        _mm256_storeu_si256((__m256i *)&dst[j + 16],
+                            _mm256_cvtepu8_epi16(_mm256_extracti128_si256(d, 1)));
+    }
+
+    return 0;
+}
+
+void ffx_map_avx2_from_num(char * const dst,
+                           const uint16_t * const src, const size_t len,
+                           const uint8_t tbl[256])
+{
+    const unsigned int rows = map_rows(tbl);
+
+    for (size_t i = 0; i < len; i += 32) {
+        const size_t j = map_block(i, len);
+
+        /* the pack works within each half; the permute restores order */
+        const __m256i n = _mm256_permute4x64_epi64(
+            _mm256_packus_epi16(
+                _mm256_loadu_si256((const __m256i *)&src[j]),
+                _mm256_loadu_si256((const __m256i *)&src[j + 16])),
+            0xd8);
+
+        _mm256_storeu_si256((__m256i *)&dst[j], map_32(tbl, rows, n));
+    }
+}
+
+#else
+
+/*
+ * the library was built without avx2 support (or for a
+ * processor that doesn't have it), so characters are
+ * mapped one at a time.
+ */
+int ffx_map_avx2_supported(void)
+{
+    return 0;
+}
+
+int ffx_map_avx2_to_num(uint16_t * const dst,
+                        const char * const src, const size_t len,
+                        const uint8_t tbl[256])
+{
+    (void)dst;
+    (void)src;
+    (void)len;
+    (void)tbl;
+
+    return -EINVAL;
+}
+
+void ffx_map_avx2_from_num(char * const dst,
+                           const uint16_t * const src, const size_t len,
+                           const uint8_t tbl[256])
+{
+    (void)dst;
+    (void)src;
+    (void)len;
+    (void)tbl;
+}
+
+#endif
@@ -0,0 +1,377 @@
+/* for cpu affinity */
+#define _GNU_SOURCE
+
+#include <ubiq/fpe/internal/pool.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * the largest number of records in a chunk. chunks are taken from
+ * the queues one at a time, under a lock, so they must be large
+ * enough to make the locking insignificant, but small enough that
+ * the chunks left at the end of a batch can be spread evenly
+ */
+#define FFX_POOL_CHUNK  256
+
+/*
+ * each worker has a queue of chunks, a contiguous range, [lo, hi),
+ * of chunk numbers. the worker takes chunks from the front of its
+ * own queue and, when that is empty, from the back of the others'.
+ * @fail is the lowest numbered chunk processed by the worker that
+ * had a failure, and @err is that failure
+ */
+struct ffx_pool_queue
+{
+    struct fpe_pool * pool;
+    unsigned int id;
+
+    pthread_mutex_t lock;
+    size_t lo, hi;
+
+    size_t fail;
+    int err;
+
+    void * state;
+};
+
+struct fpe_pool
+{
+    /*
+     * @lock protects the fields that describe the current batch,
+     * which the workers wait on @work to change. the caller waits
+     * on @done for the workers to finish with the batch
+     */
+    pthread_mutex_t lock;
+    pthread_cond_t work, done;
+    /* held by the caller for the duration of a batch */
+    pthread_mutex_t batch;
+
+    unsigned int nthreads;
+    pthread_t * thr;
+    struct ffx_pool_queue * q;
+
+    const struct ffx_pool_job * job;
+    size_t cnt, chunk;
+    /* incremented for each batch */
+    unsigned long gen;
+    unsigned int busy;
+    int stop;
+};
+
+/*
+ * take the next chunk from the worker's own queue or,
+ * failing that, from another worker's queue. returns
+ * 0 if there are no chunks left
+ */
+static
+int ffx_pool_take(struct fpe_pool * const pool,
+                  struct ffx_pool_queue * const q, size_t * const c)
+{
+    int res = 0;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->lo < q->hi) {
+        *c = q->lo++;
+        res = 1;
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    for (unsigned int i = 1; !res && i < pool->nthreads; i++) {
+        struct ffx_pool_queue * const v =
+            &pool->q[(q->id + i) % pool->nthreads];
+
+        pthread_mutex_lock(&v->lock);
+        if (v->lo < v->hi) {
+            *c = --v->hi;
+            res = 1;
+        }
+        pthread_mutex_unlock(&v->lock);
+    }
+
+    return res;
+}
+
+static
+void * ffx_pool_worker(void * const _q)
+{
+    struct ffx_pool_queue * const q = _q;
+    struct fpe_pool * const pool = q->pool;
+
+    unsigned long gen = 0;
+
+    for (;;) {
+        const struct ffx_pool_job * job;
+        size_t c;
+
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->stop && pool->gen == gen) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        if (pool->stop) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        gen = pool->gen;
+        job = pool->job;
+        pthread_mutex_unlock(&pool->lock);
+
+        while (ffx_pool_take(pool, q, &c)) {
+            const size_t lo = c * pool->chunk;
+            const size_t hi =
+                (pool->cnt - lo > pool->chunk) ? lo + pool->chunk : pool->cnt;
+            const int err = job->run(job->arg, q->state, lo, hi);
+
+            if (err && c < q->fail) {
+                q->fail = c;
+                q->err = err;
+            }
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return NULL;
+}
+
+int ffx_pool_run(struct fpe_pool * const pool,
+                 const struct ffx_pool_job * const job, const size_t cnt)
+{
+    const unsigned int n = pool->nthreads;
+
+    uint8_t * state;
+    size_t nchunks, fail;
+    int res;
+
+    if (cnt == 0) {
+        return 0;
+    }
+
+    /* calloc() may return NULL for a 0-length request */
+    state = calloc(n, job->len ? job->len : 1);
+    if (!state) {
+        return -ENOMEM;
+    }
+
+    pthread_mutex_lock(&pool->batch);
+
+    /*
+     * about 16 chunks per worker, so that there are
+     * chunks left to be stolen near the end of the batch
+     */
+    pool->chunk = (cnt + 16 * n - 1) / (16 * n);
+    if (pool->chunk > FFX_POOL_CHUNK) {
+        pool->chunk = FFX_POOL_CHUNK;
+    }
+    nchunks = (cnt + pool->chunk - 1) / pool->chunk;
+
+    for (unsigned int i = 0; i < n; i++) {
+        struct ffx_pool_queue * const q = &pool->q[i];
+
+        q->lo = nchunks * i / n;
+        q->hi = nchunks * (i + 1) / n;
+        q->fail = SIZE_MAX;
+        q->err = 0;
+        q->state = state + i * job->len;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->job = job;
+    pool->cnt = cnt;
+    pool->busy = n;
+    pool->gen++;
+    pthread_cond_broadcast(&pool->work);
+    while (pool->busy) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pool->job = NULL;
+    pthread_mutex_unlock(&pool->lock);
+
+    res = 0;
+    fail = SIZE_MAX;
+    for (unsigned int i = 0; i < n; i++) {
+        struct ffx_pool_queue * const q = &pool->q[i];
+
+        if (q->fail < fail) {
+            fail = q->fail;
+            res = q->err;
+        }
+
+        job->fini(job->arg, q->state);
+        q->state = NULL;
+    }
+
+    pthread_mutex_unlock(&pool->batch);
+
+    memset(state, 0, n * job->len);
+    free(state);
+
+    return res;
+}
+
+/*
+ * stop and wait for the first @n workers, which
+ * must be waiting for work or already gone
+ */
+static
+void ffx_pool_stop(struct fpe_pool * const pool, const unsigned int n)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (unsigned int i = 0; i < n; i++) {
+        pthread_join(pool->thr[i], NULL);
+    }
+}
+
+static
+void ffx_pool_free(struct fpe_pool * const pool)
+{
+    for (unsigned int i = 0; i < pool->nthreads; i++) {
+        pthread_mutex_destroy(&pool->q[i].lock);
+    }
+    free(pool->q);
+    free(pool->thr);
+
+    pthread_mutex_destroy(&pool->batch);
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->lock);
+
+    free(pool);
+}
+
+#if defined(__linux__)
+/* the number of the @n-th processor in @cpus */
+static
+unsigned int ffx_pool_cpu(const cpu_set_t * const cpus, unsigned int n)
+{
+    unsigned int i;
+
+    for (i = 0; i < CPU_SETSIZE; i++) {
+        if (CPU_ISSET(i, cpus) && n-- == 0) {
+            break;
+        }
+    }
+
+    return i;
+}
+#endif
+
+int fpe_pool_create(struct fpe_pool ** const _pool,
+                    unsigned int nthreads, const unsigned int flags)
+{
+    struct fpe_pool * pool;
+    pthread_attr_t attr;
+    int res;
+
+#if defined(__linux__)
+    cpu_set_t cpus;
+    unsigned int ncpus;
+#endif
+
+    if (flags & ~FPE_POOL_PIN) {
+        return -EINVAL;
+    }
+
+#if defined(__linux__)
+    if (flags & FPE_POOL_PIN) {
+        if (sched_getaffinity(0, sizeof(cpus), &cpus) != 0) {
+            return -errno;
+        }
+        ncpus = CPU_COUNT(&cpus);
+    }
+#else
+    if (flags & FPE_POOL_PIN) {
+        return -ENOTSUP;
+    }
+#endif
+
+    if (nthreads == 0) {
+        const long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+        nthreads = (n > 0) ? n : 1;
+    }
+
+    pool = malloc(sizeof(*pool));
+    if (!pool) {
+        return -ENOMEM;
+    }
+
+    pool->nthreads = nthreads;
+    pool->thr = calloc(nthreads, sizeof(*pool->thr));
+    pool->q = calloc(nthreads, sizeof(*pool->q));
+    if (!pool->thr || !pool->q) {
+        free(pool->q);
+        free(pool->thr);
+        free(pool);
+        return -ENOMEM;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pthread_mutex_init(&pool->batch, NULL);
+
+    pool->job = NULL;
+    pool->cnt = pool->chunk = 0;
+    pool->gen = 0;
+    pool->busy = 0;
+    pool->stop = 0;
+
+    for (unsigned int i = 0; i < nthreads; i++) {
+        pool->q[i].pool = pool;
+        pool->q[i].id = i;
+        pthread_mutex_init(&pool->q[i].lock, NULL);
+    }
+
+    res = 0;
+    for (unsigned int i = 0; !res && i < nthreads; i++) {
+        pthread_attr_init(&attr);
+
+#if defined(__linux__)
+        if (flags & FPE_POOL_PIN) {
+            cpu_set_t set;
+
+            CPU_ZERO(&set);
+            CPU_SET(ffx_pool_cpu(&cpus, i % ncpus), &set);
+            res = -pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+        }
+#endif
+
+        if (!res) {
+            res = -pthread_create(
+                &pool->thr[i], &attr, ffx_pool_worker, &pool->q[i]);
+        }
+        pthread_attr_destroy(&attr);
+
+        if (res) {
+            ffx_pool_stop(pool, i);
+        }
+    }
+
+    if (res) {
+        ffx_pool_free(pool);
+        return res;
+    }
+
+    *_pool = pool;
+    return 0;
+}
+
+void fpe_pool_destroy(struct fpe_pool * const pool)
+{
+    ffx_pool_stop(pool, pool->nthreads);
+    ffx_pool_free(pool);
+}
@@ -0,0 +1,200 @@
+#include <ubiq/fpe/internal/round.h>
+
+#include <string.h>
+
+/*
+ * this file is compiled with the flags necessary to enable the
+ * avx2 instructions (see lib/CMakeLists.txt). nothing in here
+ * may be called unless ffx_round_avx2_supported() says that the
+ * processor can execute them.
+ */
+#if defined(__AVX2__)
+
+#include <immintrin.h>
+
+int ffx_round_avx2_supported(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+/*
+ * the 32-bit word at offset @off of @R[k] through @R[k + 3], big
+ * endian, in the lanes of a register. texts beyond @n repeat the
+ * last one. the words are inserted directly into the register;
+ * assembling them in memory defeats store forwarding
+ */
+static inline
+uint32_t round_word(const uint8_t * const * const R,
+                    const unsigned int k, const unsigned int n,
+                    const unsigned int off)
+{
+    uint32_t w;
+
+    memcpy(&w, &R[(k < n) ? k : n - 1][off], sizeof(w));
+
+    return w;
+}
+
+static inline
+__m128i round_words(const uint8_t * const * const R,
+                    const unsigned int k, const unsigned int n,
+                    const unsigned int off)
+{
+    const __m128i swap = _mm_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    __m128i v;
+
+    v = _mm_cvtsi32_si128(round_word(R, k + 0, n, off));
+    v = _mm_insert_epi32(v, round_word(R, k + 1, n, off), 1);
+    v = _mm_insert_epi32(v, round_word(R, k + 2, n, off), 2);
+    v = _mm_insert_epi32(v, round_word(R, k + 3, n, off), 3);
+
+    return _mm_shuffle_epi8(v, swap);
+}
+
+static inline
+__m256i round_load(const uint8_t * const * const R,
+                   const unsigned int k, const unsigned int n,
+                   const unsigned int off)
+{
+    return _mm256_cvtepu32_epi64(round_words(R, k, n, off));
+}
+
+/*
+ * convert the (nonnegative) integers, less than 2**52,
+ * in the lanes of @v to doubles and back
+ */
+static inline
+__m256d round_to_pd(const __m256i v)
+{
+    const __m256d magic = _mm256_set1_pd(4503599627370496.0); /* 2**52 */
+
+    return _mm256_sub_pd(
+        _mm256_castsi256_pd(
+            _mm256_or_si256(v, _mm256_castpd_si256(magic))), magic);
+}
+
+static inline
+__m256i round_from_pd(const __m256d v)
+{
+    const __m256d magic = _mm256_set1_pd(4503599627370496.0);
+
+    return _mm256_xor_si256(
+        _mm256_castpd_si256(_mm256_add_pd(v, magic)),
+        _mm256_castpd_si256(magic));
+}
+
+void ffx_round_avx2_xn(const unsigned int n,
+                       uint64_t * const A, uint64_t * const B,
+                       const uint8_t * const * const R, const unsigned int d,
+                       const uint64_t m, const int add,
+                       uint8_t * const * const W, const size_t off,
+                       const unsigned int b)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i vm = _mm256_set1_epi64x(m);
+    const __m256i vm1 = _mm256_set1_epi64x(m - 1);
+    const __m256d inv = _mm256_set1_pd(1.0 / (double)m);
+    const __m256d qmax = _mm256_set1_pd(4294967295.0);
+    const __m256d w32 = _mm256_set1_pd(4294967296.0);
+    /* the low 4 bytes of each lane, reversed */
+    const __m256i swap = _mm256_setr_epi8(
+        3, 2, 1, 0, -1, -1, -1, -1, 11, 10, 9, 8, -1, -1, -1, -1,
+        3, 2, 1, 0, -1, -1, -1, -1, 11, 10, 9, 8, -1, -1, -1, -1);
+
+    for (unsigned int k = 0; k < n; k += 4) {
+        __m256i a, c, y;
+        uint32_t be[8];
+
+        /*
+         * y = NUM(R) mod m, a word at a time, from the most
+         * significant: y = (y * 2**32 + word) mod m. since y is
+         * less than m, the quotient is less than 2**32, and the
+         * quotient estimated in double precision is off by no more
+         * than 1, which the comparisons at the end correct
+         */
+        y = zero;
+        for (unsigned int j = 0; j < d; j += 4) {
+            const __m256i l = round_load(R, k, n, j);
+            const __m256i x = _mm256_or_si256(_mm256_slli_epi64(y, 32), l);
+
+            __m256d q;
+            __m256i r, t;
+
+            q = _mm256_add_pd(_mm256_mul_pd(round_to_pd(y), w32),
+                              round_to_pd(l));
+            q = _mm256_min_pd(_mm256_floor_pd(_mm256_mul_pd(q, inv)), qmax);
+
+            r = _mm256_sub_epi64(x, _mm256_mul_epu32(round_from_pd(q), vm));
+
+            t = _mm256_cmpgt_epi64(zero, r);
+            r = _mm256_add_epi64(r, _mm256_and_si256(t, vm));
+            t = _mm256_cmpgt_epi64(r, vm1);
+            y = _mm256_sub_epi64(r, _mm256_and_si256(t, vm));
+        }
+
+        /* c = (A +/- y) mod m */
+        a = _mm256_loadu_si256((const __m256i *)&A[k]);
+        if (add) {
+            c = _mm256_add_epi64(a, y);
+            c = _mm256_sub_epi64(
+                c, _mm256_and_si256(_mm256_cmpgt_epi64(c, vm1), vm));
+        } else {
+            c = _mm256_sub_epi64(a, y);
+            c = _mm256_add_epi64(
+                c, _mm256_and_si256(_mm256_cmpgt_epi64(zero, c), vm));
+        }
+
+        _mm256_storeu_si256(
+            (__m256i *)&A[k], _mm256_loadu_si256((const __m256i *)&B[k]));
+        _mm256_storeu_si256((__m256i *)&B[k], c);
+
+        /* NUM(B), the last @b bytes of each reversed word */
+        _mm256_storeu_si256(
+            (__m256i *)be,
+            _mm256_permutevar8x32_epi32(
+                _mm256_shuffle_epi8(c, swap),
+                _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7)));
+        for (unsigned int j = 0; j < 4 && k + j < n; j++) {
+            const uint8_t * const s = (const uint8_t *)&be[j] + 4 - b;
+
+            for (unsigned int l = 0; l < b; l++) {
+                W[k + j][off + l] = s[l];
+            }
+        }
+    }
+}
+
+#else
+
+/*
+ * the library was built without avx2 support (or for a
+ * processor that doesn't have it), so the rounds are
+ * done one text at a time
+ */
+int ffx_round_avx2_supported(void)
+{
+    return 0;
+}
+
+void ffx_round_avx2_xn(const unsigned int n,
+                       uint64_t * const A, uint64_t * const B,
+                       const uint8_t * const * const R, const unsigned int d,
+                       const uint64_t m, const int add,
+                       uint8_t * const * const W, const size_t off,
+                       const unsigned int b)
+{
+    (void)n;
+    (void)A;
+    (void)B;
+    (void)R;
+    (void)d;
+    (void)m;
+    (void)add;
+    (void)W;
+    (void)off;
+    (void)b;
+}
+
+#endif
@@ -0,0 +1,169 @@
+#include <ubiq/fpe/internal/round.h>
+
+#include <string.h>
+
+/*
+ * this file is compiled with the flags necessary to enable the
+ * avx-512 instructions (see lib/CMakeLists.txt). nothing in here
+ * may be called unless ffx_round_avx512_supported() says that the
+ * processor can execute them.
+ */
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+
+#include <immintrin.h>
+
+int ffx_round_avx512_supported(void)
+{
+    return __builtin_cpu_supports("avx512f") &&
+        __builtin_cpu_supports("avx512dq");
+}
+
+/* see round_words() in round.c */
+static inline
+uint32_t round512_word(const uint8_t * const * const R,
+                       const unsigned int k, const unsigned int n,
+                       const unsigned int off)
+{
+    uint32_t w;
+
+    memcpy(&w, &R[(k < n) ? k : n - 1][off], sizeof(w));
+
+    return w;
+}
+
+static inline
+__m128i round512_words(const uint8_t * const * const R,
+                       const unsigned int k, const unsigned int n,
+                       const unsigned int off)
+{
+    const __m128i swap = _mm_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    __m128i v;
+
+    v = _mm_cvtsi32_si128(round512_word(R, k + 0, n, off));
+    v = _mm_insert_epi32(v, round512_word(R, k + 1, n, off), 1);
+    v = _mm_insert_epi32(v, round512_word(R, k + 2, n, off), 2);
+    v = _mm_insert_epi32(v, round512_word(R, k + 3, n, off), 3);
+
+    return _mm_shuffle_epi8(v, swap);
+}
+
+static inline
+__m512i round512_load(const uint8_t * const * const R,
+                      const unsigned int k, const unsigned int n,
+                      const unsigned int off)
+{
+    return _mm512_cvtepu32_epi64(
+        _mm256_inserti128_si256(
+            _mm256_castsi128_si256(round512_words(R, k, n, off)),
+            round512_words(R, k + 4, n, off), 1));
+}
+
+void ffx_round_avx512_xn(const unsigned int n,
+                         uint64_t * const A, uint64_t * const B,
+                         const uint8_t * const * const R, const unsigned int d,
+                         const uint64_t m, const int add,
+                         uint8_t * const * const W, const size_t off,
+                         const unsigned int b)
+{
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i vm = _mm512_set1_epi64(m);
+    const __m512d inv = _mm512_set1_pd(1.0 / (double)m);
+    const __m512d qmax = _mm512_set1_pd(4294967295.0);
+    /* the 4 bytes of each 32-bit lane, reversed */
+    const __m256i swap = _mm256_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    for (unsigned int k = 0; k < n; k += 8) {
+        const __mmask8 lanes = (n - k >= 8) ? 0xff : (1u << (n - k)) - 1;
+
+        __m512i a, c, y;
+        uint32_t be[8];
+
+        /* see ffx_round_avx2_xn() */
+        y = zero;
+        for (unsigned int j = 0; j < d; j += 4) {
+            const __m512i x = _mm512_or_si512(
+                _mm512_slli_epi64(y, 32), round512_load(R, k, n, j));
+
+            __m512d q;
+            __m512i r;
+
+            q = _mm512_mul_pd(_mm512_cvtepu64_pd(x), inv);
+            q = _mm512_min_pd(
+                _mm512_roundscale_pd(
+                    q, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC), qmax);
+
+            r = _mm512_sub_epi64(
+                x, _mm512_mul_epu32(_mm512_cvttpd_epu64(q), vm));
+
+            r = _mm512_mask_add_epi64(
+                r, _mm512_cmplt_epi64_mask(r, zero), r, vm);
+            y = _mm512_mask_sub_epi64(
+                r, _mm512_cmpge_epi64_mask(r, vm), r, vm);
+        }
+
+        /* c = (A +/- y) mod m */
+        a = _mm512_maskz_loadu_epi64(lanes, &A[k]);
+        if (add) {
+            c = _mm512_add_epi64(a, y);
+            c = _mm512_mask_sub_epi64(
+                c, _mm512_cmpge_epi64_mask(c, vm), c, vm);
+        } else {
+            c = _mm512_sub_epi64(a, y);
+            c = _mm512_mask_add_epi64(
+                c, _mm512_cmplt_epi64_mask(c, zero), c, vm);
+        }
+
+        _mm512_mask_storeu_epi64(
+            &A[k], lanes, _mm512_maskz_loadu_epi64(lanes, &B[k]));
+        _mm512_mask_storeu_epi64(&B[k], lanes, c);
+
+        /* NUM(B), the last @b bytes of each reversed word */
+        _mm256_storeu_si256(
+            (__m256i *)be,
+            _mm256_shuffle_epi8(_mm512_cvtepi64_epi32(c), swap));
+        for (unsigned int j = 0; j < 8 && k + j < n; j++) {
+            const uint8_t * const s = (const uint8_t *)&be[j] + 4 - b;
+
+            for (unsigned int l = 0; l < b; l++) {
+                W[k + j][off + l] = s[l];
+            }
+        }
+    }
+}
+
+#else
+
+/*
+ * the library was built without avx-512 support (or for a
+ * processor that doesn't have it), so the avx2 version, if
+ * any, is used
+ */
+int ffx_round_avx512_supported(void)
+{
+    return 0;
+}
+
+void ffx_round_avx512_xn(const unsigned int n,
+                         uint64_t * const A, uint64_t * const B,
+                         const uint8_t * const * const R, const unsigned int d,
+                         const uint64_t m, const int add,
+                         uint8_t * const * const W, const size_t off,
+                         const unsigned int b)
+{
+    (void)n;
+    (void)A;
+    (void)B;
+    (void)R;
+    (void)d;
+    (void)m;
+    (void)add;
+    (void)W;
+    (void)off;
+    (void)b;
+}
+
+#endif
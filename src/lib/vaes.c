@@ -0,0 +1,157 @@
+#include <ubiq/fpe/internal/aes.h>
+
+#include <openssl/crypto.h>
+
+#include <string.h>
+
+/*
+ * this file is compiled with the flags necessary to enable the
+ * vector aes and avx-512 instructions (see lib/CMakeLists.txt).
+ * nothing in here may be called unless ffx_vaes_supported() says
+ * that the processor can execute them.
+ */
+#if defined(__VAES__) && defined(__AVX512F__)
+
+#include <immintrin.h>
+
+int ffx_vaes_supported(void)
+{
+    return __builtin_cpu_supports("vaes") &&
+        __builtin_cpu_supports("avx512f");
+}
+
+/*
+ * gather the 16-byte blocks at offset @off of chains @k through
+ * @k + 3 into the lanes of a register. chains beyond @n repeat
+ * the last one
+ */
+static inline
+__m512i vaes_load(const uint8_t * const * const p,
+                  const unsigned int k, const unsigned int n,
+                  const size_t off)
+{
+#define VAES_CHAIN(J)   (const __m128i *)&p[(k + J < n) ? k + J : n - 1][off]
+    __m512i v;
+
+    v = _mm512_castsi128_si512(_mm_loadu_si128(VAES_CHAIN(0)));
+    v = _mm512_inserti32x4(v, _mm_loadu_si128(VAES_CHAIN(1)), 1);
+    v = _mm512_inserti32x4(v, _mm_loadu_si128(VAES_CHAIN(2)), 2);
+    v = _mm512_inserti32x4(v, _mm_loadu_si128(VAES_CHAIN(3)), 3);
+#undef VAES_CHAIN
+
+    return v;
+}
+
+static inline
+void vaes_store(uint8_t * const * const p,
+                const unsigned int k, const unsigned int n,
+                const __m512i v)
+{
+    uint8_t b[64];
+
+    _mm512_storeu_si512(b, v);
+    for (unsigned int j = 0; j < 4 && k + j < n; j++) {
+        memcpy(p[k + j], &b[16 * j], 16);
+    }
+}
+
+/*
+ * @z registers' worth (4 chains each) of chains, starting with
+ * chain @k. @z is a constant at each call site, so that the
+ * loops over the registers are unrolled, and the chains stay
+ * in registers throughout
+ */
+static inline __attribute__((always_inline))
+void vaes_cbcmac(const __m512i * const rk, const unsigned int nr,
+                 const unsigned int z, const unsigned int k,
+                 const unsigned int n,
+                 uint8_t * const * const dst,
+                 const uint8_t * const * const iv,
+                 const uint8_t * const * const src,
+                 const size_t len)
+{
+    __m512i c[4];
+
+    for (unsigned int i = 0; i < z; i++) {
+        c[i] = vaes_load(iv, k + 4 * i, n, 0);
+    }
+
+    for (size_t off = 0; off < len; off += 16) {
+        for (unsigned int i = 0; i < z; i++) {
+            c[i] = _mm512_ternarylogic_epi64(
+                c[i], vaes_load(src, k + 4 * i, n, off), rk[0], 0x96);
+        }
+        for (unsigned int j = 1; j < nr; j++) {
+            for (unsigned int i = 0; i < z; i++) {
+                c[i] = _mm512_aesenc_epi128(c[i], rk[j]);
+            }
+        }
+        for (unsigned int i = 0; i < z; i++) {
+            c[i] = _mm512_aesenclast_epi128(c[i], rk[nr]);
+        }
+    }
+
+    for (unsigned int i = 0; i < z; i++) {
+        vaes_store(dst, k + 4 * i, n, c[i]);
+    }
+}
+
+void ffx_vaes_cbcmac_xn(const struct ffx_aes * const aes,
+                        const unsigned int n,
+                        uint8_t * const * const dst,
+                        const uint8_t * const * const iv,
+                        const uint8_t * const * const src,
+                        const size_t len)
+{
+    const unsigned int nr = aes->nr;
+    __m512i rk[15];
+
+    /* each round key is repeated in all four lanes */
+    for (unsigned int i = 0; i <= nr; i++) {
+        rk[i] = _mm512_broadcast_i32x4(
+            _mm_loadu_si128((const __m128i *)aes->rk[i]));
+    }
+
+    /*
+     * as few registers are used as will hold the chains. the
+     * results of any repeated chains are discarded. see vaes_load()
+     */
+    if (n > 8) {
+        vaes_cbcmac(rk, nr, 4, 0, n, dst, iv, src, len);
+    } else if (n > 4) {
+        vaes_cbcmac(rk, nr, 2, 0, n, dst, iv, src, len);
+    } else if (n > 0) {
+        vaes_cbcmac(rk, nr, 1, 0, n, dst, iv, src, len);
+    }
+
+    OPENSSL_cleanse(rk, sizeof(rk));
+}
+
+#else
+
+/*
+ * the library was built without support for the vector
+ * aes instructions (or for a processor that doesn't have
+ * them), so chains are processed by the aes-ni version
+ */
+int ffx_vaes_supported(void)
+{
+    return 0;
+}
+
+void ffx_vaes_cbcmac_xn(const struct ffx_aes * const aes,
+                        const unsigned int n,
+                        uint8_t * const * const dst,
+                        const uint8_t * const * const iv,
+                        const uint8_t * const * const src,
+                        const size_t len)
+{
+    (void)aes;
+    (void)n;
+    (void)dst;
+    (void)iv;
+    (void)src;
+    (void)len;
+}
+
+#endif
@@ -0,0 +1,516 @@
+#include <gtest/gtest.h>
+#include <ubiq/fpe/ff1.h>
+#include <ubiq/fpe/ff3_1.h>
+#include <ubiq/fpe/internal/ffx.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+/*
+ * the tests in this file verify that encryption and decryption
+ * don't allocate memory once a context has been used with a given
+ * length of text. the allocation functions are replaced (below) with
+ * versions that count calls while a test is interested in them.
+ *
+ * the replacements depend on glibc's internal names for the real
+ * functions, so the tests are skipped everywhere else. they also
+ * can't coexist with the address sanitizer's own replacements.
+ */
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+
+static std::atomic<bool> counting(false);
+static std::atomic<unsigned long> allocations(0);
+
+extern "C" {
+
+extern void * __libc_malloc(size_t);
+extern void * __libc_calloc(size_t, size_t);
+extern void * __libc_realloc(void *, size_t);
+extern void __libc_free(void *);
+
+void * malloc(size_t len) noexcept
+{
+    if (counting) {
+        allocations++;
+    }
+    return __libc_malloc(len);
+}
+
+void * calloc(size_t num, size_t len) noexcept
+{
+    if (counting) {
+        allocations++;
+    }
+    return __libc_calloc(num, len);
+}
+
+void * realloc(void * ptr, size_t len) noexcept
+{
+    if (counting) {
+        allocations++;
+    }
+    return __libc_realloc(ptr, len);
+}
+
+void free(void * ptr) noexcept
+{
+    __libc_free(ptr);
+}
+
+}
+
+/*
+ * run @fn once to warm up any caches and workspaces,
+ * and then return the number of allocations made by
+ * running it several more times
+ */
+template <typename F>
+static
+unsigned long count_allocations(F fn)
+{
+    unsigned long res;
+
+    fn();
+
+    allocations = 0;
+    counting = true;
+    for (unsigned int i = 0; i < 8; i++) {
+        fn();
+    }
+    counting = false;
+    res = allocations;
+
+    return res;
+}
+
+static
+void ff1_alloc_test(struct ff1_ctx * const ctx, const char * const PT)
+{
+    std::string CT(strlen(PT) * 4 + 1, '\0');
+    std::string out(strlen(PT) * 4 + 1, '\0');
+    struct ff1_tweak * twk;
+    size_t ylen, olen;
+    int res;
+
+    /* once using aes-ni (if supported) and once using evp */
+    for (unsigned int i = 0; i < 2; i++) {
+        EXPECT_EQ(
+            count_allocations([&] {
+                res = ff1_encrypt(ctx, &CT[0], PT, NULL, 0);
+                res |= ff1_decrypt(ctx, &out[0], CT.c_str(), NULL, 0);
+            }),
+            0) << PT;
+        EXPECT_EQ(res, 0);
+        EXPECT_STREQ(out.c_str(), PT);
+
+        ((struct ffx_ctx *)ctx)->aesni = 0;
+    }
+
+    ASSERT_EQ(ff1_tweak_prepare(ctx, NULL, 0, &twk), 0);
+    EXPECT_EQ(
+        count_allocations([&] {
+            res = ff1_encrypt_prepared(ctx, &CT[0], PT, twk);
+            res |= ff1_decrypt_prepared(ctx, &out[0], CT.c_str(), twk);
+        }),
+        0) << PT;
+    EXPECT_EQ(res, 0);
+    EXPECT_STREQ(out.c_str(), PT);
+    ff1_tweak_destroy(twk);
+
+    /* texts that aren't nul-terminated */
+    EXPECT_EQ(
+        count_allocations([&] {
+            ylen = CT.size();
+            res = ff1_encrypt_len(ctx, &CT[0], &ylen, PT, strlen(PT), NULL, 0);
+            olen = out.size();
+            res |= ff1_decrypt_len(ctx, &out[0], &olen, CT.data(), ylen,
+                                   NULL, 0);
+        }),
+        0) << PT;
+    EXPECT_EQ(res, 0);
+    EXPECT_EQ(out.substr(0, olen), PT);
+}
+
+TEST(alloc, ff1)
+{
+    const uint8_t K[] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+    const uint8_t T[] = { 0x37, 0x37, 0x37, 0x37, 0x70, 0x71, 0x72 };
+
+    /*
+     * short enough for native integers, too long for them, and long
+     * enough that the halves are converted to and from big integers
+     * by splitting them (see __bigint_set_num())
+     */
+    const char * const PT[] = {
+        "0123456789",
+        "0123456789012345678901234567890123456789"
+        "0123456789012345678901234567890123456789",
+        "0123456789012345678901234567890123456789"
+        "0123456789012345678901234567890123456789"
+        "0123456789012345678901234567890123456789"
+        "0123456789012345678901234567890123456789",
+    };
+
+    for (unsigned int i = 0; i < sizeof(PT) / sizeof(*PT); i++) {
+        struct ff1_ctx * ctx;
+
+        ASSERT_EQ(ff1_ctx_create(&ctx, K, sizeof(K), T, sizeof(T), 0, 0, 10), 0);
+        ff1_alloc_test(ctx, PT[i]);
+        ff1_ctx_destroy(ctx);
+    }
+}
+
+TEST(alloc, ff1_radix255)
+{
+    const uint8_t K[] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+
+    struct ff1_ctx * ctx;
+
+    ASSERT_EQ(ff1_ctx_create(&ctx, K, sizeof(K), NULL, 0, 0, 0, 255), 0);
+    /* the longer text has halves that are converted by splitting them */
+    for (unsigned int n : { 40, 300 }) {
+        std::string PT;
+
+        for (unsigned int i = 0; i < n; i++) {
+            PT += (char)(1 + (i * 37) % 255);
+        }
+
+        ff1_alloc_test(ctx, PT.c_str());
+    }
+    ff1_ctx_destroy(ctx);
+}
+
+TEST(alloc, ff1_custom_radix)
+{
+    const uint8_t K[] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+
+    const struct {
+        const char * radix;
+        const char * PT;
+    } tests[] = {
+        { "!@#$%^&*()", "!@#$%^&*()!@#$" },
+        { " ÊËÌÍÎÏðñòóôĵĶķĸĹϺϻϼϽϾϿ0123456789abcABC", "123456789abcABC" },
+    };
+
+    for (unsigned int i = 0; i < sizeof(tests) / sizeof(*tests); i++) {
+        struct ff1_ctx * ctx;
+
+        ASSERT_EQ(
+            ff1_ctx_create_custom_radix(
+                &ctx, K, sizeof(K), NULL, 0, 0, 0, (const uint8_t *)tests[i].radix), 0);
+        ff1_alloc_test(ctx, tests[i].PT);
+        ff1_ctx_destroy(ctx);
+    }
+}
+
+TEST(alloc, ff3_1)
+{
+    const uint8_t K[] = {
+        0xef, 0x43, 0x59, 0xd8, 0xd5, 0x80, 0xaa, 0x4f,
+        0x7f, 0x03, 0x6d, 0x6f, 0x04, 0xfc, 0x6a, 0x94,
+    };
+    const uint8_t T[7] = { 0 };
+
+    const char PT[] = "890121234567890000";
+    char CT[sizeof(PT)], out[sizeof(PT)];
+
+    struct ff3_1_ctx * ctx;
+    int res;
+
+    ASSERT_EQ(ff3_1_ctx_create(&ctx, K, sizeof(K), T, 10), 0);
+
+    for (unsigned int i = 0; i < 2; i++) {
+        EXPECT_EQ(
+            count_allocations([&] {
+                res = ff3_1_encrypt(ctx, CT, PT, NULL);
+                res |= ff3_1_decrypt(ctx, out, CT, NULL);
+            }),
+            0);
+        EXPECT_EQ(res, 0);
+        EXPECT_STREQ(out, PT);
+
+        ((struct ffx_ctx *)ctx)->aesni = 0;
+    }
+
+    /* texts that aren't nul-terminated */
+    EXPECT_EQ(
+        count_allocations([&] {
+            size_t ylen = sizeof(CT), olen = sizeof(out);
+
+            res = ff3_1_encrypt_len(ctx, CT, &ylen, PT, strlen(PT), NULL);
+            res |= ff3_1_decrypt_len(ctx, out, &olen, CT, ylen, NULL);
+            out[olen] = '\0';
+        }),
+        0);
+    EXPECT_EQ(res, 0);
+    EXPECT_STREQ(out, PT);
+
+#if defined(__SIZEOF_INT128__)
+    {
+        const struct ffx_len * len;
+        struct ffx_len tmp;
+
+        /* and with the big integer implementation */
+        len = ffx_len_acquire((struct ffx_ctx *)ctx, strlen(PT), &tmp);
+        ASSERT_NE(len, &tmp);
+        ((struct ffx_len *)len)->wide = 0;
+
+        EXPECT_EQ(
+            count_allocations([&] {
+                res = ff3_1_encrypt(ctx, CT, PT, NULL);
+                res |= ff3_1_decrypt(ctx, out, CT, NULL);
+            }),
+            0);
+        EXPECT_EQ(res, 0);
+        EXPECT_STREQ(out, PT);
+
+        ffx_len_release(len, &tmp);
+    }
+#endif
+
+    ff3_1_ctx_destroy(ctx);
+}
+
+/*
+ * a column of fields, some of which are encrypted in lockstep and
+ * the rest of which are left over
+ */
+static const size_t alloc_width = 12, alloc_stride = 16, alloc_fields = 11;
+
+static
+std::string alloc_column(void)
+{
+    std::string col(alloc_stride * alloc_fields, '-');
+
+    for (size_t i = 0; i < alloc_fields; i++) {
+        for (size_t j = 0; j < alloc_width; j++) {
+            col[i * alloc_stride + j] = '0' + (i * 7 + j * 3) % 10;
+        }
+    }
+
+    return col;
+}
+
+/*
+ * like a batch (see below), a column prepares its tweak for itself,
+ * and that should be the only thing that it allocates
+ */
+TEST(alloc, ff1_strided)
+{
+    const uint8_t K[] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+
+    const std::string PT = alloc_column();
+    std::string CT(PT), out(PT);
+    const std::string fld = PT.substr(0, alloc_width);
+    std::string tmp(alloc_width + 1, '\0');
+    struct ff1_ctx * ctx;
+    unsigned long exp;
+    int res;
+
+    ASSERT_EQ(ff1_ctx_create(&ctx, K, sizeof(K), NULL, 0, 0, 0, 10), 0);
+
+    exp = count_allocations([&] {
+        for (unsigned int i = 0; i < 2; i++) {
+            struct ff1_tweak * twk;
+
+            ff1_tweak_prepare(ctx, NULL, 0, &twk);
+            ff1_encrypt_prepared(ctx, &tmp[0], fld.c_str(), twk);
+            ff1_tweak_destroy(twk);
+        }
+    });
+
+    EXPECT_EQ(
+        count_allocations([&] {
+            res = ff1_encrypt_strided(ctx, &CT[0], alloc_stride,
+                                      PT.data(), alloc_stride,
+                                      alloc_width, alloc_fields,
+                                      NULL, 0, NULL);
+            res |= ff1_decrypt_strided(ctx, &out[0], alloc_stride,
+                                       CT.data(), alloc_stride,
+                                       alloc_width, alloc_fields,
+                                       NULL, 0, NULL);
+        }),
+        exp);
+    EXPECT_EQ(res, 0);
+    EXPECT_EQ(out, PT);
+
+    ff1_ctx_destroy(ctx);
+}
+
+TEST(alloc, ff3_1_strided)
+{
+    const uint8_t K[] = {
+        0xef, 0x43, 0x59, 0xd8, 0xd5, 0x80, 0xaa, 0x4f,
+        0x7f, 0x03, 0x6d, 0x6f, 0x04, 0xfc, 0x6a, 0x94,
+    };
+    const uint8_t T[7] = { 0 };
+
+    const std::string PT = alloc_column();
+    std::string CT(PT), out(PT);
+    struct ff3_1_ctx * ctx;
+    int res;
+
+    ASSERT_EQ(ff3_1_ctx_create(&ctx, K, sizeof(K), T, 10), 0);
+
+    EXPECT_EQ(
+        count_allocations([&] {
+            res = ff3_1_encrypt_strided(ctx, &CT[0], alloc_stride,
+                                        PT.data(), alloc_stride,
+                                        alloc_width, alloc_fields,
+                                        NULL, NULL);
+            res |= ff3_1_decrypt_strided(ctx, &out[0], alloc_stride,
+                                         CT.data(), alloc_stride,
+                                         alloc_width, alloc_fields,
+                                         NULL, NULL);
+        }),
+        0);
+    EXPECT_EQ(res, 0);
+    EXPECT_EQ(out, PT);
+
+    ff3_1_ctx_destroy(ctx);
+}
+
+/*
+ * the records of a batch, of several lengths, interleaved so that
+ * they have to be bucketed, and space for their outputs
+ */
+struct alloc_batch
+{
+    alloc_batch(const size_t cnt)
+        : PT(cnt), CT(cnt), out(cnt), pPT(cnt), pCT(cnt), pout(cnt)
+    {
+        const size_t lens[] = { 10, 16, 10, 12, 19, 16 };
+
+        for (size_t i = 0; i < cnt; i++) {
+            const size_t n = lens[i % (sizeof(lens) / sizeof(*lens))];
+
+            for (size_t j = 0; j < n; j++) {
+                PT[i] += '0' + (i * 7 + j * 3) % 10;
+            }
+
+            CT[i].resize(n + 1);
+            out[i].resize(n + 1);
+
+            pPT[i] = PT[i].c_str();
+            pCT[i] = CT[i].data();
+            pout[i] = out[i].data();
+        }
+    }
+
+    std::vector<std::string> PT;
+    std::vector<std::vector<char>> CT, out;
+    std::vector<const char *> pPT;
+    std::vector<char *> pCT, pout;
+};
+
+/*
+ * a batch prepares the default tweak for itself, which allocates
+ * the tweak and its state for each length. nothing else, including
+ * the space to sort the records by length, may be allocated, so the
+ * batch should make exactly as many allocations as preparing the
+ * tweak and using it once for each length
+ */
+TEST(alloc, ff1_batch)
+{
+    const uint8_t K[] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+
+    const size_t cnt = 60;
+
+    alloc_batch b(cnt);
+    std::vector<int> status(cnt);
+    std::vector<char> CT(20);
+    struct ff1_ctx * ctx;
+    unsigned long exp;
+    int res;
+
+    ASSERT_EQ(ff1_ctx_create(&ctx, K, sizeof(K), NULL, 0, 0, 0, 10), 0);
+
+    exp = count_allocations([&] {
+        for (unsigned int i = 0; i < 2; i++) {
+            struct ff1_tweak * twk;
+
+            ff1_tweak_prepare(ctx, NULL, 0, &twk);
+            for (const char * const PT : {
+                     "0123456789", "012345678901", "0123456789012345",
+                     "0123456789012345678" }) {
+                ff1_encrypt_prepared(ctx, CT.data(), PT, twk);
+            }
+            ff1_tweak_destroy(twk);
+        }
+    });
+
+    EXPECT_EQ(
+        count_allocations([&] {
+            res = ff1_encrypt_batch(ctx, b.pCT.data(), b.pPT.data(), NULL,
+                                    NULL, NULL, cnt, status.data());
+            res |= ff1_decrypt_batch(ctx, b.pout.data(),
+                                     (const char * const *)b.pCT.data(),
+                                     NULL, NULL, NULL, cnt, status.data());
+        }),
+        exp);
+    EXPECT_EQ(res, 0);
+    for (size_t i = 0; i < cnt; i++) {
+        EXPECT_STREQ(b.out[i].data(), b.pPT[i]) << i;
+    }
+
+    ff1_ctx_destroy(ctx);
+}
+
+TEST(alloc, ff3_1_batch)
+{
+    const uint8_t K[] = {
+        0xef, 0x43, 0x59, 0xd8, 0xd5, 0x80, 0xaa, 0x4f,
+        0x7f, 0x03, 0x6d, 0x6f, 0x04, 0xfc, 0x6a, 0x94,
+    };
+    const uint8_t T[7] = { 0 };
+
+    const size_t cnt = 60;
+
+    alloc_batch b(cnt);
+    std::vector<int> status(cnt);
+    struct ff3_1_ctx * ctx;
+    int res;
+
+    ASSERT_EQ(ff3_1_ctx_create(&ctx, K, sizeof(K), T, 10), 0);
+
+    EXPECT_EQ(
+        count_allocations([&] {
+            res = ff3_1_encrypt_batch(ctx, b.pCT.data(), b.pPT.data(), NULL,
+                                      NULL, cnt, status.data());
+            res |= ff3_1_decrypt_batch(ctx, b.pout.data(),
+                                       (const char * const *)b.pCT.data(),
+                                       NULL, NULL, cnt, status.data());
+        }),
+        0);
+    EXPECT_EQ(res, 0);
+    for (size_t i = 0; i < cnt; i++) {
+        EXPECT_STREQ(b.out[i].data(), b.pPT[i]) << i;
+    }
+
+    ff3_1_ctx_destroy(ctx);
+}
+
+#else
+
+TEST(alloc, unsupported)
+{
+    GTEST_SKIP() << "allocations can't be counted in this environment";
+}
+
+#endif
@@ -1,698 +1,458 @@
 #include <gtest/gtest.h>
 #include <ubiq/fpe/internal/bn.h>
+#include <ubiq/fpe/internal/digits.h>
+#include <ubiq/fpe/internal/map.h>
 
 #include <unistr.h>
 
-TEST(bn, set_str)
-{
-    char n5[] = "00011010";
-
-    uint8_t * numb;
-    size_t numc;
-    bigint_t n;
-
-    bigint_init(&n);
-
-    bigint_set_str(&n, n5, 5);
-    EXPECT_EQ(bigint_cmp_si(&n, 755), 0);
-
-    bigint_deinit(&n);
-}
-
-static void _copy(uint32_t * u32_dest, const char * const src) {
-  for (int i = 0; i < strlen(src); i++) {
-    u32_dest[i] = (uint8_t)src[i];
-  }
-}
+#include <algorithm>
+#include <random>
 
-static
-void __u32_radix_test(const char * const input, const char * const ialpha,
-                  const char * const oalpha, const char * const expect)
+/*
+ * compare the vectorized conversions with a character-by-character
+ * translation, for alphabets spread over different numbers of rows
+ * of the table and with an invalid character in every position
+ */
+TEST(chars, numerals_avx2)
 {
-    bigint_t n;
-    int r1, r2;
-    size_t len;
-
-    std::vector<uint32_t> output;
-
-    uint32_t * u32_input = u8_to_u32((uint8_t *)input, strlen(input) + 1, NULL, &len);
-    uint32_t * u32_ialpha = u8_to_u32((uint8_t *)ialpha, strlen(ialpha) + 1, NULL, &len);
-    uint32_t * u32_oalpha = u8_to_u32((uint8_t *)oalpha, strlen(oalpha) + 1, NULL, &len);
-    uint32_t * u32_expect = u8_to_u32((uint8_t *)expect, strlen(expect) + 1, NULL, &len);
-
-    /* @n will be the numerical value of @inp */
-    bigint_init(&n);
-
-    r1 = __u32_bigint_set_str(&n, u32_input, u32_ialpha);
-    ASSERT_EQ(r1, 0);
-
-    output.resize(50);
+    std::mt19937 rng(3);
 
-    r2 = __u32_bigint_get_str(output.data(), output.size(), u32_oalpha, &n);
-    EXPECT_EQ(r2, 0);
-    EXPECT_EQ(u32_strlen(output.data()), u32_strlen(u32_expect));
-    for (int i=0; i < u32_strlen(output.data()); i++) {
-      EXPECT_EQ(output[i], u32_expect[i]);
+    if (!ffx_map_avx2_supported()) {
+        GTEST_SKIP() << "avx2 not supported";
     }
 
-    free(u32_input);
-    free(u32_ialpha);
-    free(u32_oalpha);
-    free(u32_expect);
+    for (const unsigned int radix : { 2, 10, 36, 94, 200 }) {
+        std::string alpha;
+        uint8_t in[256], out[256];
 
-    bigint_deinit(&n);
-}
-
-static
-void __radix_test(const char * const input, const char * const ialpha,
-                  const char * const oalpha, const char * const expect)
-{
-    bigint_t n;
-    int r1, r2;
-
-    std::vector<char> output;
-    output.resize(50);
-
-    /* @n will be the numerical value of @inp */
-    bigint_init(&n);
-
-    // std::cerr << " input(" << input << ")   expect(" << expect << ")"<< std::endl;
-    // std::cerr << " ialpha(" << ialpha << ")   oalpha(" << oalpha << ")"<< std::endl;
-    r1 = __bigint_set_str(&n, input, ialpha);
-    ASSERT_EQ(r1, 0);
+        /* distinct, non-nul characters in random order */
+        for (unsigned int c = 1; c < 256; c++) {
+            alpha += (char)c;
+        }
+        std::shuffle(alpha.begin(), alpha.end(), rng);
+        alpha.resize(radix);
 
+        map_numerals_tbl_init(in, out, alpha.c_str(), radix, 0);
 
-    r2 = __bigint_get_str(output.data(), output.size(), oalpha, &n);
-    EXPECT_EQ(r2, 0) ;
-    EXPECT_EQ(strcmp(output.data(), expect), 0) << " output(" << output.data() << ")   expect(" << expect << ")"<< std::endl;
-
-
-    bigint_deinit(&n);
-}
-
-
-static
-void radix_test(const char * const input, const char * const ialpha,
-                const char * const oalpha, const char * const expect)
-{
-    /* convert from one radix to another */
-    __radix_test(input, ialpha, oalpha, expect);
-    /* test that the conversion can be successfully reversed */
-    __radix_test(expect, oalpha, ialpha, input);
+        for (size_t len = 32; len <= 100; len++) {
+            std::vector<uint16_t> num(len), res(len);
+            std::string src, dst(len, '\0');
 
+            for (size_t i = 0; i < len; i++) {
+                num[i] = rng() % radix;
+                src += alpha[num[i]];
+            }
 
-    /* convert from one radix to another */
-    __u32_radix_test(input, ialpha, oalpha, expect);
-    /* test that the conversion can be successfully reversed */
-    __u32_radix_test(expect, oalpha, ialpha, input);
-}
+            EXPECT_EQ(ffx_map_avx2_to_num(res.data(), src.data(), len, in), 0);
+            EXPECT_EQ(res, num) << "radix " << radix << ", length " << len;
 
-TEST(radix, dec2hex)
-{
-    radix_test("100", "0123456789", "0123456789ABCDEF", "64");
-}
+            ffx_map_avx2_from_num(&dst[0], num.data(), len, out);
+            EXPECT_EQ(dst, src) << "radix " << radix << ", length " << len;
 
-TEST(radix, oct2hex)
-{
-    radix_test("100", "01234567", "0123456789ABCDEF", "40");
-}
+            for (size_t i = 0; i < len; i++) {
+                std::string bad(src);
 
-TEST(radix, dec2dec)
-{
-    radix_test("@$#", "!@#$%^&*()", "0123456789", "132");
-}
+                bad[i] = 0;
+                for (unsigned int c = 1; in[(uint8_t)bad[i]] != 0; c++) {
+                    bad[i] = (char)c;
+                }
 
-TEST(radix, oct2dec)
-{
-    radix_test("@$#", "!@#$%^&*", "0123456789", "90");
+                EXPECT_EQ(ffx_map_avx2_to_num(res.data(), bad.data(), len, in), -EINVAL)
+                    << "radix " << radix << ", length " << len << ", position " << i;
+            }
+        }
+    }
 }
 
-TEST(radix, invalid_dest_buffer)
+/*
+ * translation between characters and numerals, through the tables,
+ * at lengths on either side of those at which the vectorized
+ * versions (if supported) take over, for alphabets that use
+ * different numbers of rows of the tables
+ */
+TEST(chars, numerals_tbl)
 {
-    bigint_t n;
-    int r1(0);
-    int r2(0);
-    const char data []= "123456789";
-    const char input_radix [] = "0123456789";
-    const char output_radix [] = "0123456789ABC";
-    std::vector<char> output;
-
+    std::mt19937 rng(4);
 
-    bigint_init(&n);
+    for (const unsigned int radix : { 2, 10, 36, 94, 200, 255 }) {
+        std::string alpha;
+        uint8_t in[256], out[256];
 
-    r1 = __bigint_set_str(&n, data, input_radix);
-    ASSERT_EQ(r1, 0);
+        /* distinct, non-nul characters in random order */
+        for (unsigned int c = 1; c < 256; c++) {
+            alpha += (char)c;
+        }
+        std::shuffle(alpha.begin(), alpha.end(), rng);
+        alpha.resize(radix);
 
-    output.resize(50);
+        map_numerals_tbl_init(in, out, alpha.c_str(), radix, 0);
 
-    // Make sure dest buffer is TOO small
-    r2 = __bigint_get_str(output.data(), 1, output_radix, &n);
-    EXPECT_EQ(r2, -ENOMEM);
+        for (size_t len = 1; len <= 200; len += (len < 70) ? 1 : 13) {
+            std::vector<uint16_t> num(len), res(len);
+            std::string src, dst(len, '\0');
 
-    bigint_deinit(&n);
-}
+            for (size_t i = 0; i < len; i++) {
+                num[i] = rng() % radix;
+                src += alpha[num[i]];
+            }
 
-TEST(radix, invalid_characters_buffer)
-{
-    bigint_t n;
-    int r1(0);
-    const char data []= "123456789";
-    const char input_radix [] = "ABCDEFG";
-    bigint_init(&n);
+            EXPECT_EQ(map_numerals_from_tbl(res.data(), src.data(), len, in), 0);
+            EXPECT_EQ(res, num) << "radix " << radix << ", length " << len;
 
-    r1 = __bigint_set_str(&n, data, input_radix);
-    ASSERT_EQ(r1, -EINVAL);
+            map_numerals_to_tbl(&dst[0], num.data(), len, out);
+            EXPECT_EQ(dst, src) << "radix " << radix << ", length " << len;
 
-  
-    bigint_deinit(&n);
-}
-
-// Use arbitrary radix 62 and test conversions back and forth
-TEST(radix, radix62)
-{
-    char data [5] = "\0\0\0\0";
-    char input_radix[63];
-    const char output_radix [] = "0123456879";
+            for (size_t i = 0; i < len; i += 1 + len / 8) {
+                std::string bad(src);
 
-    memset(input_radix,0, sizeof(input_radix));
+                bad[i] = 0;
+                for (unsigned int c = 1; in[(uint8_t)bad[i]] != 0; c++) {
+                    bad[i] = (char)c;
+                }
 
-    // Arbitrary input string
-    for (int i = 0;i < 62; i++) {
-        input_radix[i] = '0' + i;
+                EXPECT_EQ(map_numerals_from_tbl(res.data(), bad.data(), len, in), -EINVAL)
+                    << "radix " << radix << ", length " << len << ", position " << i;
+            }
+        }
     }
 
-    data[0] = input_radix[1];
-    radix_test(data, input_radix, output_radix, "1");
-
-    data[0] = input_radix[61];
-    radix_test(data, input_radix, output_radix, "61");
-
-}
-
-// Use arbitrary radix > 62 and test conversions back and forth
-TEST(radix, radix63)
-{
-    char data [5] = "\0\0\0\0";
-    char input_radix[65];
-
-    const char output_radix [] = "0123456879";
-
-    memset(input_radix,0, sizeof(input_radix));
-
-    for (int i = 0;i < 63; i++) {
-        input_radix[i] = '0' + i;
+    {
+        uint8_t in[256], out[256];
+        uint16_t num[4];
+
+        /* upper case letters are accepted when case doesn't matter */
+        map_numerals_tbl_init(in, out, "0123456789abcdefghijklmnopqrstuvwxyz", 36, 1);
+        EXPECT_EQ(map_numerals_from_tbl(num, "zZaA", 4, in), 0);
+        EXPECT_EQ(num[0], 35);
+        EXPECT_EQ(num[1], 35);
+        EXPECT_EQ(num[2], 10);
+        EXPECT_EQ(num[3], 10);
     }
-
-    data[0] = input_radix[1];
-    radix_test(data, input_radix, output_radix, "1");
-
-    data[0] = input_radix[62];
-    radix_test(data, input_radix, output_radix, "62");
-
-}
-
-TEST(chars, mapset)
-{
-    int r1;
-
-    char src[]      = "BCDEFGHIJ";
-    char expected[] = "123456789";
-
-    const char input_set[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-    const char output_set[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-
-    char * dst1;
-    char * dst2;
-
-    dst1 = strdup(src);
-    r1 = map_characters(dst1,src,input_set, output_set);
-    ASSERT_EQ(r1, 0);
-    EXPECT_EQ(strcmp(dst1, expected),0) << " dst1 = '" << dst1 << "'";
-
-    dst2 = strdup(dst1);
-    r1 = map_characters(dst2, dst1, output_set, input_set);
-    ASSERT_EQ(r1, 0);
-    EXPECT_EQ(strcmp(dst2, src),0);
-
-    free(dst1);
-    free(dst2);
-
-}
-
-TEST(chars, mapset_2)
-{
-    unsigned long long r1 = 0;
-
-    char src[]      = "JIHGFEDCBABCDEFGHIJ";
-    char expected[] = "9876543210123456789";
-
-    const char input_set[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-    const char output_set[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-
-    char * dst1;
-    char * dst2;
-
-    dst1 = strdup(src);
-
-    r1 = map_characters(dst1,src,input_set, output_set);
-    ASSERT_EQ(r1, 0);
-    EXPECT_EQ(strcmp(dst1, expected),0) << " dst1 = '" << dst1 << "'";
-
-    dst2 = strdup(dst1);
-    r1 = map_characters(dst2, dst1, output_set, input_set);
-    ASSERT_EQ(r1, 0);
-    EXPECT_EQ(strcmp(dst2, src),0);
-
-    free(dst1);
-    free(dst2);
-
-}
-
-
-
-TEST(chars, non_std)
-{
-    unsigned long long r1 = 0;
-
-    char src[] = "!@#$%^&*()";
-    char expected[] = "02468ACEGI";
-
-    const char input_set[] =  "!a@b#c$d%e^f&g*h(i)";
-    const char output_set[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-
-    char * dst1;
-    char * dst2;
-
-    dst1 = strdup(src);
-    ASSERT_EQ(map_characters(dst1,src,input_set, output_set), 0);
-
-    EXPECT_EQ(strcmp(dst1, expected),0) << " dst1 = '" << dst1 << "'";
-
-    dst2 = strdup(dst1);
-    r1 = map_characters(dst2, dst1, output_set, input_set);
-    ASSERT_EQ(r1, 0);
-    EXPECT_EQ(strcmp(dst2, src),0);
-
-    free(dst1);
-    free(dst2);
-
-
-}
-
-TEST(chars, mapset_invalid)
-{
-    unsigned long long r1 = 0;
-
-    char src[]      = "JIHGFEDCBABCDEFGHIJ";
-    char expected[] = "9876543210123456789";
-
-    const char input_set[] = "BCDEFGHIJKLMNOPQRSTUVWXYZ";
-    const char output_set[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-
-    char * dst1;
-
-    dst1 = strdup(src);
-
-    r1 = map_characters(dst1,src,input_set, output_set);
-    EXPECT_NE(r1, 0);
-
-    free(dst1);
-
-}
- 
-TEST(chars, mapset_63)
-{
-    unsigned long long r1 = 0;
-
-    char src[]      = "09";
-    char expected[] = "\x01\x0a";
-
-    const char input_set[] = "0123456789";
-    const char * output_set = get_standard_bignum_radix(63);
-
-    char * dst1;
-
-    dst1 = strdup(src);
-
-    r1 = map_characters(dst1,src,input_set, output_set);
-    EXPECT_EQ(r1, 0);
-    EXPECT_EQ(strcmp(expected, dst1), 0);
-
-    free(dst1);
-
-}
-
-TEST(chars, u32_mapset_63)
-{
-    setlocale(LC_ALL, "C.UTF-8");
-    unsigned long long r1 = 0;
-
-    char src[]      = "09";
-    char expected[] = "\x01\x0a";
-
-    const uint32_t * input_set = (uint32_t * )L"0123456789";
-    const char * output_set = get_standard_bignum_radix(63);
-
-    char * dst1;
-
-    dst1 = strdup(src);
-
-    r1 = map_characters_from_u32(dst1, (uint8_t *) src,input_set, output_set);
-    EXPECT_EQ(r1, 0);
-    EXPECT_EQ(strcmp(expected, dst1), 0);
-
-    free(dst1);
-
-}
-
-TEST(chars, u32_to_mapset_63)
-{
-    setlocale(LC_ALL, "C.UTF-8");
-    unsigned long long r1 = 0;
-
-    char src[]      = "09";
-    char expected[] = "\x01\x0a";
-
-    const uint32_t * input_set = (uint32_t * )L"0123456789";
-    const char * output_set = get_standard_bignum_radix(63);
-
-    char * dst1;
-    uint8_t * dst2;
-
-    dst1 = strdup(src);
-    dst2 = (uint8_t*) calloc(sizeof(src) + 1, sizeof(uint8_t));
-
-    r1 = map_characters_from_u32(dst1, (uint8_t *) src,input_set, output_set);
-    EXPECT_EQ(r1, 0);
-    EXPECT_EQ(strcmp(expected, dst1), 0);
-
-    r1 = map_characters_to_u32(dst2, dst1, output_set, input_set);
-    EXPECT_EQ(r1, 0);
-    EXPECT_EQ(strcmp(src, (char *)dst2), 0);
-
-    free(dst1);
-    free(dst2);
-
-}
-
-TEST(chars, mapset_255)
-{
-    setlocale(LC_ALL, "C.UTF-8");
-    unsigned long long r1 = 0;
-
-    char src[]      = "0Az<";
-    char expected[] = "\x01\x0b\x3e\x57";
-
-    const char * input_set = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz!@#$%^&*()~`{}|[]:;,./?><";
-    const char * output_set = get_standard_bignum_radix(255);
-    uint32_t * u32_input_set = (uint32_t *)calloc(strlen(input_set) + 1, sizeof(uint32_t));
-    size_t len = strlen(input_set) + 1;
-    u32_input_set = u8_to_u32((const uint8_t*)input_set, strlen(input_set), u32_input_set, &len);
-    // printf("len(%d)\n",len);
-
-    char * dst1;
-    char * dst2;
-
-    dst1 = strdup(src);
-    dst2 = (char *) calloc(strlen(src) + 1, sizeof(char));
-
-    r1 = map_characters(dst1, src, input_set, output_set);
-    EXPECT_EQ(r1, 0);
-    EXPECT_EQ(strcmp(expected, dst1), 0);
-
-    // Reverse it
-    r1 = map_characters(dst2, dst1, output_set, input_set);
-    EXPECT_EQ(r1, 0);
-    EXPECT_EQ(strcmp(src, dst2), 0);
-
-
-    r1 = map_characters_from_u32(dst1, (uint8_t*)src, u32_input_set, output_set);
-    EXPECT_EQ(r1, 0);
-    EXPECT_EQ(strcmp(expected, dst1), 0);
-
-    r1 = map_characters_to_u32((uint8_t*)dst2, dst1, output_set, u32_input_set);
-    EXPECT_EQ(r1, 0);
-    EXPECT_EQ(strcmp(dst2, src), 0);
-
-    free(dst1);
-    free(dst2);
-    free(u32_input_set);
-}
-
-
-TEST(radix, t1)
-{
-    unsigned long long r1 = 0;
-
-    char src[]      = "1234567890ABCDEFabcdef";
-    const char i_radix[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
-    const char o_radix[] = "0123456789";
-    char expect[] = "45117932320280791338835719979215890389";
-
-    std::vector<char> data(50);
-  
-   radix_test(src, i_radix, o_radix, expect);
-}
-
-TEST(radix, t2)
-{
-    unsigned long long r1 = 0;
-
-    char src[]      = "3456789AB2CDEFGHcdefgh";
-    const char i_radix[] = "23456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz01";
-    const char o_radix[] = "0123456789";
-    char expect[] = "45117932320280791338835719979215890389";
-
-    std::vector<char> data(50);
-  
-   radix_test(src, i_radix, o_radix, expect);
-}
-
-TEST(radix, t3)
-{
-    unsigned long long r1 = 0;
-
-    char src[]      = "6KNFyZss7SBQ7w7udUwsv8";
-    const char i_radix[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
-    const char o_radix[] = "23456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz01";
-    char expect[] = "8MPH0buu9UDS9y9wfWyuxA";
-
-    std::vector<char> data(50);
-  
-   radix_test(src, i_radix, o_radix, expect);
 }
 
+/*
+ * the utf-8 tables must agree with the positions of the characters
+ * in the alphabet and must reject malformed utf-8 as well as unknown
+ * characters
+ */
+TEST(chars, u8_tbl)
+{
+    const char alpha[] = " ÊËÌÍÎÏðñòóôĵĶķĸĹϺϻϼϽϾϿ0123456789abcABC😀";
+
+    const char * const valid[] = {
+        "123456789abcABC",
+        "Ï3ËcϾķaó5Ͼ1Ϻ6cĹ",
+        "😀 ÊϿ😀",
+    };
+    const char * const invalid[] = {
+        "123456789abcdef",  /* not in the alphabet */
+        "Ï3\xcb",          /* truncated sequence */
+        "\xc3\x8f\x80",    /* stray continuation byte */
+        "\xc0\xa0",        /* overlong encoding of ' ' */
+        "\xed\xa0\x80",    /* surrogate */
+    };
+
+    struct map_u8_tbl tbl;
+    uint32_t * u32_alpha;
+    size_t len;
 
-TEST(radix, t4)
-{
-    unsigned long long r1 = 0;
-    char src[]      = "9G0L29YNJ6";
-    const char i_radix[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-    const char o_radix[] = "!\"#$%'()*+,./0123456789:<=>?ABCDEFGHIJKLMNOPQRSTUVWXYZ[]_`abcdefghijklmnopqrstuvwxyz{}~";
-
-    char expect[] = "=J*K42c(";
-
-    std::vector<char> data(50);
-  
-   radix_test(src, i_radix, o_radix, expect);
-
-   radix_test(expect, o_radix, i_radix, src);
-
-}
-
-TEST(radix, u32)
-{
-    unsigned long long r1 = 0;
-    char src[]      = "1234567890";
-    const char i_radix[] = "0123456789";
-    const wchar_t o_radix[] = L"0123456789";
-
-    const wchar_t expect[] = L"1234567890";
-
-    std::vector<wchar_t> data(50);
-  
-    bigint_t n;
-
-    bigint_init(&n);
-
-    r1 = __bigint_set_str(&n, src, i_radix);
-    EXPECT_EQ(r1, 0);
-
-    r1 = __u32_bigint_get_str((uint32_t *)data.data(), data.size(),  (uint32_t *)o_radix, &n);
-    EXPECT_EQ(r1, 0);
-
-    EXPECT_EQ(memcmp(expect, data.data(), sizeof(expect)), 0);
-    bigint_deinit(&n);
-
-}
-
-TEST(radix, u32_b)
-{
-    unsigned long long r1 = 0;
-    char src[]      = "1234567890";
-    const char i_radix[] = "0123456789";
-    const wchar_t o_radix[] = L"0123456789";
-
-    const wchar_t expect[] = L"1234567890";
-
-    std::vector<wchar_t> data(50);
-  
-    bigint_t n;
-
-    bigint_init(&n);
-
-    r1 = __bigint_set_str(&n, src, i_radix);
-    EXPECT_EQ(r1, 0);
-
-    r1 = __u32_bigint_get_str((uint32_t *)data.data(), data.size(),  (uint32_t *)o_radix, &n);
-    EXPECT_EQ(r1, 0);
-
-    EXPECT_EQ(memcmp(expect, data.data(), sizeof(expect)), 0);
-    bigint_deinit(&n);
-
-}
-
-TEST(radix, u32_c)
-{
-    unsigned long long r1 = 0;
-     char src[]      = "1234567890";
-    const char i_radix[] = "0123456789";
-    const wchar_t o_radix[] = L"ÊËÌÍÎÏðñòó";
-
-    const wchar_t expect[] = L"ËÌÍÎÏðñòóÊ";
-
-    std::vector<wchar_t> data(50);
-  
-    bigint_t n;
-
-    bigint_init(&n);
-
-    r1 = __bigint_set_str(&n, src, i_radix);
-    EXPECT_EQ(r1, 0);
-
-    r1 = __u32_bigint_get_str((uint32_t *)data.data(), data.size(),  (uint32_t *)o_radix, &n);
-    EXPECT_EQ(r1, 0);
-
-    EXPECT_EQ(memcmp(expect, data.data(), sizeof(expect)), 0);
-    bigint_deinit(&n);
-
-}
-
-TEST(radix, u32_d)
-{
-    unsigned long long r1 = 0;
-    char src[]      = "1234567890";
-    const char i_radix[] = "0123456789";
-    const wchar_t o_radix[] = L"ĵĶķĸĹϺϻϼϽϾ";
-
-    const wchar_t expect[] = L"ĶķĸĹϺϻϼϽϾĵ";
-
-    std::vector<wchar_t> data(50);
-  
-    bigint_t n;
-
-    bigint_init(&n);
-
-    r1 = __bigint_set_str(&n, src, i_radix);
-    EXPECT_EQ(r1, 0);
-
-    r1 = __u32_bigint_get_str((uint32_t *)data.data(), data.size(),  (uint32_t *)o_radix, &n);
-    EXPECT_EQ(r1, 0);
-
-    EXPECT_EQ(memcmp(expect, data.data(), sizeof(expect)), 0);
-    bigint_deinit(&n);
-
-}
-
-TEST(radix, u32_e)
-{
-    unsigned long long r1 = 0;
-    char src[]      = "1234567890";
-    const char i_radix[] = "0123456789";
-    const wchar_t o_radix[] = L"ĵĶķĸĹϺϻϼϽϾ";
-
-    const wchar_t expect[] = L"ĶķĸĹϺϻϼϽϾĵ";
+    u32_alpha = u8_to_u32((const uint8_t *)alpha, strlen(alpha) + 1, NULL, &len);
+    ASSERT_NE(u32_alpha, nullptr);
+    ASSERT_EQ(map_numerals_u8_tbl_init(&tbl, u32_alpha), 0);
+
+    for (unsigned int i = 0; i < sizeof(valid) / sizeof(*valid); i++) {
+        std::vector<char> dst2(strlen(valid[i]) + 1);
+        std::vector<uint16_t> num(strlen(valid[i]));
+        size_t n = strlen(valid[i]);
+        uint32_t * u32;
+        size_t u32len;
+
+        u32 = u8_to_u32((const uint8_t *)valid[i], strlen(valid[i]), NULL, &u32len);
+        ASSERT_NE(u32, nullptr);
+
+        EXPECT_EQ(map_numerals_from_u8_tbl(num.data(), &n, (const uint8_t *)valid[i], &tbl), 0);
+        EXPECT_EQ(n, u32len);
+        for (size_t j = 0; j < n; j++) {
+            EXPECT_EQ(u32_alpha[num[j]], u32[j]);
+        }
+        free(u32);
+
+        /* and back again, into exactly enough space and one byte less */
+        len = strlen(valid[i]);
+        EXPECT_EQ(map_numerals_to_u8_tbl((uint8_t *)dst2.data(), &len, num.data(), n, &tbl), 0);
+        EXPECT_EQ(len, strlen(valid[i]));
+        EXPECT_STREQ(dst2.data(), valid[i]);
+        len--;
+        EXPECT_EQ(map_numerals_to_u8_tbl((uint8_t *)dst2.data(), &len, num.data(), n, &tbl), -ENOSPC);
+    }
 
-    std::vector<wchar_t> data(50);
-  
-    bigint_t n;
+    for (unsigned int i = 0; i < sizeof(invalid) / sizeof(*invalid); i++) {
+        std::vector<uint16_t> num(strlen(invalid[i]));
+        size_t n = strlen(invalid[i]);
 
-    bigint_init(&n);
+        EXPECT_EQ(map_numerals_from_u8_tbl(num.data(), &n, (const uint8_t *)invalid[i], &tbl), -EINVAL) << i;
+    }
 
-    r1 = __bigint_set_str(&n, src, i_radix);
-    EXPECT_EQ(r1, 0);
+    {
+        const char str[] = "Ï3Ë\0Ë";
+        uint16_t num[sizeof(str)];
+        size_t n;
+
+        /* the length ends in the middle of a character */
+        n = strlen(str) - 1;
+        EXPECT_EQ(map_numerals_from_u8_tbl(num, &n, (const uint8_t *)str, &tbl), -EINVAL);
+        /* the nul is part of the text */
+        n = sizeof(str) - 1;
+        EXPECT_EQ(map_numerals_from_u8_tbl(num, &n, (const uint8_t *)str, &tbl), -EINVAL);
+        /* and the text ends before it */
+        n = strlen(str);
+        EXPECT_EQ(map_numerals_from_u8_tbl(num, &n, (const uint8_t *)str, &tbl), 0);
+        EXPECT_EQ(n, 3u);
+    }
 
-    r1 = __u32_bigint_get_str((uint32_t *)data.data(), data.size(),  (uint32_t *)o_radix, &n);
-    EXPECT_EQ(r1, 0);
+    {
+        const uint16_t num[] = { 1, (uint16_t)tbl.radix };
+        uint8_t dst[16];
+        size_t n = sizeof(dst);
 
-    EXPECT_EQ(memcmp(expect, data.data(), sizeof(expect)), 0);
-    bigint_deinit(&n);
+        EXPECT_EQ(map_numerals_to_u8_tbl(dst, &n, num, 2, &tbl), -EINVAL);
+    }
 
+    /* ' ' and the emoji */
+    EXPECT_EQ(tbl.minlen, 1u);
+    EXPECT_EQ(tbl.maxlen, 4u);
+
+    map_numerals_u8_tbl_deinit(&tbl);
+    free(u32_alpha);
+}
+
+/*
+ * long arrays of numerals are split in half and converted recursively,
+ * and the native and power-of-2 conversions must agree with the big
+ * integer ones. check a range of lengths, on either side of the point
+ * at which the recursion starts, in radixes up to the largest supported
+ */
+TEST(radix, numerals)
+{
+    const size_t lens[] = { 1, 2, 3, 4, 5, 7, 16, 63, 64, 65, 127, 128, 129, 1000, 4097 };
+    const size_t radixes[] = { 2, 10, 255, 256, 1000, 4096, 65535, 65536 };
+
+    for (unsigned int r = 0; r < sizeof(radixes) / sizeof(*radixes); r++) {
+        const size_t radix = radixes[r];
+        const int pow2 = (radix & (radix - 1)) == 0;
+
+        for (unsigned int i = 0; i < sizeof(lens) / sizeof(*lens); i++) {
+            const size_t len = lens[i];
+            std::vector<uint16_t> num(len), out(len + 2);
+            struct bigint_pow pw;
+            bigint_t n, m, tmp[BIGINT_POW_MAX];
+
+            /* including the largest and smallest numerals */
+            for (size_t j = 0; j < len; j++) {
+                num[j] = (j % 5 == 1) ? radix - 1 : (j * 7919 + 3) % radix;
+            }
+
+            bigint_init(&n);
+            bigint_init(&m);
+            /* for the longest conversion, below */
+            __bigint_pow_init(&pw, len + 2, radix);
+            for (unsigned int k = 0; k < BIGINT_POW_MAX; k++) {
+                bigint_init(&tmp[k]);
+            }
+
+            for (size_t j = 0; j < len; j++) {
+                mpz_mul_ui(m, m, radix);
+                mpz_add_ui(m, m, num[j]);
+            }
+
+            EXPECT_EQ(__bigint_set_num(&n, num.data(), len, radix, &pw, tmp), 0);
+            EXPECT_EQ(bigint_cmp(&n, &m), 0) << "radix " << radix << ", length " << len;
+
+            /* too short, and then with two leading zeros */
+            EXPECT_EQ(__bigint_get_num_consume(out.data(), len - 1, radix, &n, &pw, tmp), -EOVERFLOW);
+            mpz_set(n, m);
+            EXPECT_EQ(__bigint_get_num_consume(out.data(), len + 2, radix, &n, &pw, tmp), 0);
+            EXPECT_EQ(out[0], 0);
+            EXPECT_EQ(out[1], 0);
+            EXPECT_TRUE(std::equal(num.begin(), num.end(), out.begin() + 2))
+                << "radix " << radix << ", length " << len;
+
+            if (mpz_sizeinbase(m, 2) <= 64) {
+                uint64_t x;
+
+                EXPECT_EQ(__u64_set_num(&x, num.data(), len, radix), 0);
+                EXPECT_EQ(x, bigint_get_u64(&m));
+                EXPECT_EQ(__u64_get_num(out.data(), len, radix, x), 0);
+                EXPECT_TRUE(std::equal(num.begin(), num.end(), out.begin()));
+                if (x >= radix) {
+                    EXPECT_EQ(__u64_get_num(out.data(), len - 1, radix, x), -EOVERFLOW);
+                }
+            }
+
+            if (pow2) {
+                const size_t b = (mpz_sizeinbase(m, 2) + 7) / 8 + 1;
+                std::vector<uint8_t> x(b), y(b);
+
+                bigint_export_fixed(&m, y.data(), b);
+                EXPECT_EQ(__bytes_set_num_pow2(x.data(), b, num.data(), len, radix), 0);
+                EXPECT_EQ(x, y) << "radix " << radix << ", length " << len;
+
+                __bytes_get_num_pow2(out.data(), len, radix, x.data(), b);
+                EXPECT_TRUE(std::equal(num.begin(), num.end(), out.begin()));
+            }
+
+            /* a numeral that is out of range */
+            if (radix < 65536) {
+                std::vector<uint8_t> x(2 * len);
+                uint64_t y;
+
+                num[len / 2] = radix;
+                EXPECT_EQ(__bigint_set_num(&n, num.data(), len, radix, &pw, tmp), -EINVAL);
+                EXPECT_EQ(__u64_set_num(&y, &num[len / 2], 1, radix), -EINVAL);
+                if (pow2) {
+                    EXPECT_EQ(__bytes_set_num_pow2(x.data(), x.size(), num.data(), len, radix), -EINVAL);
+                }
+            }
+
+            for (unsigned int k = 0; k < BIGINT_POW_MAX; k++) {
+                bigint_deinit(&tmp[k]);
+            }
+            __bigint_pow_deinit(&pw);
+            bigint_deinit(&m);
+            bigint_deinit(&n);
+        }
+    }
 }
 
-TEST(radix, u32_f)
+/* a string of (lower case) digits as numerals */
+static
+std::vector<uint16_t> str_num(const std::string & str)
 {
-    unsigned long long r1 = 0;
-    char src[]      = "1234567890";
-    const char i_radix[] = "0123456789";
-    const wchar_t o_radix[] = L"ĵĶķĸĹϺϻϼϽϾ";
-
-    const wchar_t expect[] = L"ĶķĸĹϺϻϼϽϾĵ";
+    std::vector<uint16_t> num;
 
-    std::vector<wchar_t> data(50);
-  
-    bigint_t n;
-
-    bigint_init(&n);
-
-    r1 = __bigint_set_str(&n, src, i_radix);
-    EXPECT_EQ(r1, 0);
-
-    r1 = __u32_bigint_get_str((uint32_t *)data.data(), 2,  (uint32_t *)o_radix, &n);
-    EXPECT_EQ(r1, -ENOMEM);
-    bigint_deinit(&n);
+    for (const char c : str) {
+        num.push_back(strchr("0123456789abcdefghijklmnopqrstuvwxyz", c) -
+                      "0123456789abcdefghijklmnopqrstuvwxyz");
+    }
 
+    return num;
 }
 
-TEST(radix, u32_g)
+TEST(digits, blocks)
 {
-    unsigned long long r1 = 0;
-    char src[]      = "1234567890";
-    const char i_radix[] = "0123456789";
-    const wchar_t o_radix[] = L"012345678Ͼ";
-
-    const wchar_t expect[] = L"12345678Ͼ0";
-
-    std::vector<wchar_t> data(50);
-  
-    bigint_t n;
-
-    bigint_init(&n);
+    std::mt19937_64 rng(1);
 
-    r1 = __bigint_set_str(&n, src, i_radix);
-    EXPECT_EQ(r1, 0);
-
-    r1 = __u32_bigint_get_str((uint32_t *)data.data(), data.size(),  (uint32_t *)o_radix, &n);
-    EXPECT_EQ(r1, 0);
+    if (!ffx_digits_supported()) {
+        GTEST_SKIP() << "vectorized digit conversion not supported";
+    }
 
-    EXPECT_EQ(memcmp(expect, data.data(), sizeof(expect)), 0);
-    bigint_deinit(&n);
+    for (unsigned int i = 0; i < 10000; i++) {
+        const uint64_t x = rng() >> (i % 64);
+        char exp[17];
+        uint16_t num[16];
+        uint64_t y;
+
+        snprintf(exp, sizeof(exp), "%016llx", (unsigned long long)x);
+        ffx_digits_put_hex16(num, x);
+        EXPECT_EQ(std::vector<uint16_t>(num, num + 16), str_num(exp));
+        EXPECT_EQ(ffx_digits_get_hex16(&y, num), 0);
+        EXPECT_EQ(y, x);
+
+        snprintf(exp, sizeof(exp), "%016llu",
+                 (unsigned long long)(x % 10000000000000000));
+        ffx_digits_put_dec16(num, x % 10000000000000000);
+        EXPECT_EQ(std::vector<uint16_t>(num, num + 16), str_num(exp));
+        EXPECT_EQ(ffx_digits_get_dec16(&y, num), 0);
+        EXPECT_EQ(y, x % 10000000000000000);
+    }
 
+    {
+        std::vector<uint16_t> num = str_num("0123456789abcdef");
+        uint64_t y;
+
+        EXPECT_EQ(ffx_digits_get_hex16(&y, num.data()), 0);
+        EXPECT_EQ(y, 0x0123456789abcdef);
+        EXPECT_EQ(ffx_digits_get_dec16(&y, num.data()), -EINVAL);
+
+        /*
+         * numerals just beyond each radix and those that
+         * would become valid if they were truncated to a byte
+         */
+        for (const uint16_t d : { 16, 255, 256, 0x100 + 1, 0x8000, 0xffff }) {
+            num[7] = d;
+            EXPECT_EQ(ffx_digits_get_hex16(&y, num.data()), -EINVAL) << d;
+            EXPECT_EQ(ffx_digits_get_dec16(&y, num.data()), -EINVAL) << d;
+        }
+    }
 }
 
-TEST(radix, quick_test)
-{
-    bigint_t n;
-    int r1(0);
-    const char data []= "1234";
-    const char input_radix [] = " 0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-    bigint_init(&n);
-
-    r1 = __bigint_set_str(&n, data, input_radix);
-    ASSERT_EQ(r1, 0);
-
-    // gmp_printf("%Zd\n", n);
-  
-    bigint_deinit(&n);
+/*
+ * the native conversions for radix 10 and 16 are done in blocks
+ * when the processor supports it. check them, at every length,
+ * against the big integer library
+ */
+TEST(digits, native)
+{
+    std::mt19937_64 rng(2);
+
+    for (const unsigned int radix : { 10, 16 }) {
+        for (size_t len = 1; len <= 32; len++) {
+            for (unsigned int i = 0; i < 32; i++) {
+                std::vector<uint16_t> num, out(len);
+                std::string str;
+                bigint_t n;
+
+                for (size_t j = 0; j < len; j++) {
+                    str += "0123456789abcdef"[rng() % radix];
+                }
+                num = str_num(str);
+
+                bigint_init(&n);
+                bigint_set_str(&n, str.c_str(), radix);
+
+                if (len <= ((radix == 10) ? 19u : 16u)) {
+                    uint64_t x;
+
+                    EXPECT_EQ(__u64_set_num(&x, num.data(), len, radix), 0);
+                    EXPECT_EQ(x, bigint_get_u64(&n)) << str;
+                    EXPECT_EQ(__u64_get_num(out.data(), len, radix, x), 0);
+                    EXPECT_EQ(out, num);
+
+                    if (str[0] != '0') {
+                        EXPECT_EQ(
+                            __u64_get_num(out.data(), len - 1, radix, x),
+                            -EOVERFLOW) << str;
+                    }
+                }
+
+#if defined(__SIZEOF_INT128__)
+                {
+                    const std::vector<uint16_t> rev(num.rbegin(), num.rend());
+                    unsigned __int128 x;
+
+                    EXPECT_EQ(__u128_set_rnum(&x, rev.data(), len, radix), 0);
+                    EXPECT_EQ((uint64_t)(x >> 64), mpz_getlimbn(n, 1)) << str;
+                    EXPECT_EQ((uint64_t)x, mpz_getlimbn(n, 0)) << str;
+                    EXPECT_EQ(__u128_get_rnum(out.data(), len, radix, x), 0);
+                    EXPECT_EQ(out, rev);
+
+                    if (str[0] != '0') {
+                        EXPECT_EQ(
+                            __u128_get_rnum(out.data(), len - 1, radix, x),
+                            -EOVERFLOW) << str;
+                    }
+                }
+#endif
+
+                num[len / 2] = radix;
+                if (len <= 16) {
+                    uint64_t x;
+
+                    EXPECT_EQ(__u64_set_num(&x, num.data(), len, radix), -EINVAL);
+                }
+
+                bigint_deinit(&n);
+            }
+        }
+    }
 }
-
@@ -1,9 +1,36 @@
 #include <gtest/gtest.h>
 #include <ubiq/fpe/ff1.h>
+#include <ubiq/fpe/pool.h>
 #include <ubiq/fpe/internal/bn.h>
+#include <ubiq/fpe/internal/ffx.h>
 
 #include <unistr.h>
 
+/*
+ * encrypt and decrypt using a prepared version of the
+ * context's default tweak. each operation is done twice
+ * so that the second uses the state cached by the first
+ */
+static
+void ff1_test_prepared(struct ff1_ctx * const ctx,
+                       const char * const PT, const char * const CT)
+{
+    struct ff1_tweak * twk;
+    std::vector<char> out(strlen(PT) + strlen(CT) + 1);
+
+    ASSERT_EQ(ff1_tweak_prepare(ctx, NULL, 0, &twk), 0);
+
+    for (unsigned int i = 0; i < 2; i++) {
+        EXPECT_EQ(ff1_encrypt_prepared(ctx, out.data(), PT, twk), 0);
+        EXPECT_EQ(strcmp(out.data(), CT), 0);
+
+        EXPECT_EQ(ff1_decrypt_prepared(ctx, out.data(), CT, twk), 0);
+        EXPECT_EQ(strcmp(out.data(), PT), 0);
+    }
+
+    ff1_tweak_destroy(twk);
+}
+
 static
 void ff1_test(const uint8_t * const K, const size_t k,
               const uint8_t * const T, const size_t t,
@@ -27,6 +54,8 @@ void ff1_test(const uint8_t * const K, const size_t k,
         EXPECT_EQ(ff1_decrypt(ctx, out, CT, NULL, 0), 0);
         EXPECT_EQ(strcmp(out, PT), 0);
 
+        ff1_test_prepared(ctx, PT, CT);
+
         ff1_ctx_destroy(ctx);
     }
 
@@ -57,6 +86,8 @@ void ff1_test_custom_radix(const uint8_t * const K, const size_t k,
         EXPECT_EQ(ff1_decrypt(ctx, out, CT, NULL, 0), 0);
         EXPECT_EQ(strcmp(out, PT), 0) << "  out(" << out << ")   PT(" << PT << ")";
 
+        ff1_test_prepared(ctx, PT, CT);
+
         ff1_ctx_destroy(ctx);
     }
 
@@ -777,4 +808,901 @@ TEST(ff1, unicode_c)
     const char radix[] =   " ÊËÌÍÎÏðñòóôĵĶķĸĹϺϻϼϽϾϿ0123456789abcABC";
 
     ff1_test_custom_radix(K, sizeof(K), T, sizeof(T), PT, CT, radix);
-}
\ No newline at end of file
+}
+
+TEST(ff1, prepared_tweak)
+{
+    const uint8_t K[] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+
+    /* long enough that P || Q has several static blocks */
+    uint8_t T[100];
+
+    const char * const PT[] = {
+        "0123456789",
+        "01234567890123456789",
+        "012345678901234567890123456789012345678901234567890123456789",
+    };
+
+    struct ff1_ctx * ctx, * other;
+    struct ff1_tweak * twk;
+
+    for (unsigned int i = 0; i < sizeof(T); i++) {
+        T[i] = i;
+    }
+
+    ASSERT_EQ(ff1_ctx_create(&ctx, K, sizeof(K), NULL, 0, 0, 0, 10), 0);
+    ASSERT_EQ(ff1_ctx_create(&other, K, sizeof(K), NULL, 0, 0, 0, 10), 0);
+
+    ASSERT_EQ(ff1_tweak_prepare(ctx, T, sizeof(T), &twk), 0);
+
+    /* interleave lengths to exercise the per-length state */
+    for (unsigned int j = 0; j < 2; j++) {
+        for (unsigned int i = 0; i < sizeof(PT) / sizeof(*PT); i++) {
+            std::vector<char> ct(strlen(PT[i]) + 1), out(strlen(PT[i]) + 1);
+
+            EXPECT_EQ(ff1_encrypt(ctx, ct.data(), PT[i], T, sizeof(T)), 0);
+
+            EXPECT_EQ(ff1_encrypt_prepared(ctx, out.data(), PT[i], twk), 0);
+            EXPECT_EQ(strcmp(out.data(), ct.data()), 0);
+
+            EXPECT_EQ(ff1_decrypt_prepared(ctx, out.data(), ct.data(), twk), 0);
+            EXPECT_EQ(strcmp(out.data(), PT[i]), 0);
+
+            /* the tweak can't be used with a context it wasn't made for */
+            EXPECT_EQ(ff1_encrypt_prepared(other, out.data(), PT[i], twk), -EINVAL);
+        }
+    }
+
+    ff1_tweak_destroy(twk);
+
+    ff1_ctx_destroy(other);
+    ff1_ctx_destroy(ctx);
+}
+
+/*
+ * for lengths on either side of the 64-bit limit of the native
+ * engine, compare its results to those of the big integer engine
+ */
+TEST(ff1, native_engine)
+{
+    const uint8_t K[] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+    const uint8_t T[] = { 0x37, 0x37, 0x37, 0x37, 0x70, 0x71, 0x72 };
+
+    const unsigned int radixes[] = { 2, 7, 10, 16, 36, 62, 100, 255 };
+
+    for (unsigned int i = 0; i < sizeof(radixes) / sizeof(*radixes); i++) {
+        const unsigned int radix = radixes[i];
+        const char * const alpha = get_standard_bignum_radix(radix);
+
+        struct ff1_ctx * ctx;
+        struct ffx_ctx * ffx;
+
+        ASSERT_EQ(ff1_ctx_create(&ctx, K, sizeof(K), T, sizeof(T), 0, 0, radix), 0);
+        /* the ffx context is the first member of the ff1 context */
+        ffx = (struct ffx_ctx *)ctx;
+
+        /* the largest v for which radix**v fits in 64 bits */
+        unsigned int vmax = 0;
+        for (uint64_t m = radix; m <= UINT64_MAX / radix; m *= radix) {
+            vmax++;
+        }
+        vmax++;
+
+        for (unsigned int n = 2 * vmax - 3; n <= 2 * vmax + 2; n++) {
+            const struct ffx_len * len;
+            struct ffx_len tmp;
+
+            std::string PT, CT1, CT2, out;
+            int native;
+
+            if (n < ffx->txtlen.min) {
+                continue;
+            }
+
+            for (unsigned int j = 0; j < n; j++) {
+                PT += alpha[(j * 7 + n) % radix];
+            }
+            CT1.resize(n + 1);
+            CT2.resize(n + 1);
+            out.resize(n + 1);
+
+            len = ffx_len_acquire(ffx, n, &tmp);
+            ASSERT_NE(len, &tmp);
+            native = len->native;
+            EXPECT_EQ(native, n <= 2 * vmax) << "radix " << radix << ", length " << n;
+
+            EXPECT_EQ(ff1_encrypt(ctx, &CT1[0], PT.c_str(), NULL, 0), 0);
+            EXPECT_EQ(ff1_decrypt(ctx, &out[0], CT1.c_str(), NULL, 0), 0);
+            EXPECT_EQ(strcmp(out.c_str(), PT.c_str()), 0);
+
+            ((struct ffx_len *)len)->native = 0;
+            EXPECT_EQ(ff1_encrypt(ctx, &CT2[0], PT.c_str(), NULL, 0), 0);
+            ((struct ffx_len *)len)->native = native;
+
+            EXPECT_EQ(strcmp(CT1.c_str(), CT2.c_str()), 0)
+                << "radix " << radix << ", length " << n;
+
+            ffx_len_release(len, &tmp);
+        }
+
+        ff1_ctx_destroy(ctx);
+    }
+}
+
+/*
+ * for a radix that is a power of 2, compare the results of the
+ * specialized engines with those of the general ones, with both
+ * short texts (native integers) and long ones (byte arrays)
+ */
+TEST(ff1, pow2_engine)
+{
+    const uint8_t K[] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+    const uint8_t T[] = { 0x37, 0x37, 0x37, 0x37, 0x70, 0x71, 0x72 };
+
+    for (unsigned int k = 1; k <= 7; k++) {
+        const unsigned int radix = 1u << k;
+        const char * const alpha = get_standard_bignum_radix(radix);
+
+        struct ff1_ctx * ctx;
+        struct ffx_ctx * ffx;
+
+        ASSERT_EQ(ff1_ctx_create(&ctx, K, sizeof(K), T, sizeof(T), 0, 0, radix), 0);
+        ffx = (struct ffx_ctx *)ctx;
+        EXPECT_EQ(ffx->radix_bits, k);
+
+        for (unsigned int n = ffx->txtlen.min; n < 300; n += 1 + n / 4) {
+            std::string PT, CT1, CT2, out;
+
+            for (unsigned int j = 0; j < n; j++) {
+                PT += alpha[(j * 7 + n) % radix];
+            }
+            /* the largest possible values, to exercise the carries */
+            if (n % 2) {
+                PT.replace(0, n / 2, n / 2, alpha[radix - 1]);
+            }
+            CT1.resize(n + 1);
+            CT2.resize(n + 1);
+            out.resize(n + 1);
+
+            EXPECT_EQ(ff1_encrypt(ctx, &CT1[0], PT.c_str(), NULL, 0), 0);
+            EXPECT_EQ(ff1_decrypt(ctx, &out[0], CT1.c_str(), NULL, 0), 0);
+            EXPECT_STREQ(out.c_str(), PT.c_str());
+
+            ffx->radix_bits = 0;
+            EXPECT_EQ(ff1_encrypt(ctx, &CT2[0], PT.c_str(), NULL, 0), 0);
+            ffx->radix_bits = k;
+
+            EXPECT_STREQ(CT1.c_str(), CT2.c_str())
+                << "radix " << radix << ", length " << n;
+
+            PT[n / 2] = '\xff';
+            EXPECT_EQ(ff1_encrypt(ctx, &CT1[0], PT.c_str(), NULL, 0), -EINVAL);
+        }
+
+        ff1_ctx_destroy(ctx);
+    }
+}
+
+/*
+ * the numeral interface must agree with the string interface where
+ * both are possible and must work in every engine for a radix that
+ * is too large for strings
+ */
+TEST(ff1, numerals)
+{
+    const uint8_t K[] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+    const uint8_t T[] = { 0x37, 0x37, 0x37, 0x37, 0x70, 0x71, 0x72 };
+
+    const unsigned int radixes[] = {
+        10, 36, 62, 128, 255, 256, 1000, 4096, 65535, 65536,
+    };
+
+    for (unsigned int i = 0; i < sizeof(radixes) / sizeof(*radixes); i++) {
+        const unsigned int radix = radixes[i];
+        const char * const alpha = get_standard_bignum_radix(radix);
+
+        struct ff1_ctx * ctx;
+        struct ffx_ctx * ffx;
+
+        ASSERT_EQ(ff1_ctx_create(&ctx, K, sizeof(K), T, sizeof(T), 0, 0, radix), 0);
+        ffx = (struct ffx_ctx *)ctx;
+
+        for (unsigned int n = ffx->txtlen.min; n < 200; n += 1 + n / 4) {
+            const struct ffx_len * len;
+            struct ffx_len tmp;
+
+            std::vector<uint16_t> PT(n), CT1(n), CT2(n), out(n);
+
+            /* zero is as valid a numeral as any other */
+            for (unsigned int j = 0; j < n; j++) {
+                PT[j] = (j % 3 == 0) ? 0 : (j * 7919 + n) % radix;
+            }
+
+            EXPECT_EQ(ff1_encrypt_numerals(ctx, CT1.data(), PT.data(), n, NULL, 0), 0);
+            EXPECT_EQ(ff1_decrypt_numerals(ctx, out.data(), CT1.data(), n, NULL, 0), 0);
+            EXPECT_EQ(out, PT) << "radix " << radix << ", length " << n;
+
+            /* in place */
+            out = PT;
+            EXPECT_EQ(ff1_encrypt_numerals(ctx, out.data(), out.data(), n, NULL, 0), 0);
+            EXPECT_EQ(out, CT1);
+
+            if (alpha) {
+                std::string str, CT;
+
+                for (unsigned int j = 0; j < n; j++) {
+                    str += alpha[PT[j]];
+                }
+                CT.resize(n + 1);
+
+                EXPECT_EQ(ff1_encrypt(ctx, &CT[0], str.c_str(), NULL, 0), 0);
+                for (unsigned int j = 0; j < n; j++) {
+                    EXPECT_EQ(CT[j], alpha[CT1[j]]) << "radix " << radix << ", length " << n;
+                }
+            } else {
+                std::vector<char> str(n + 1, '1'), CT(n + 1);
+
+                str[n] = '\0';
+                EXPECT_EQ(ff1_encrypt(ctx, CT.data(), str.data(), NULL, 0), -EINVAL);
+            }
+
+            /* and with the general engines */
+            len = ffx_len_acquire(ffx, n, &tmp);
+            const int native = len->native;
+            const unsigned int bits = ffx->radix_bits;
+
+            ((struct ffx_len *)len)->native = 0;
+            ffx->radix_bits = 0;
+            EXPECT_EQ(ff1_encrypt_numerals(ctx, CT2.data(), PT.data(), n, NULL, 0), 0);
+            ((struct ffx_len *)len)->native = native;
+            ffx->radix_bits = bits;
+
+            EXPECT_EQ(CT1, CT2) << "radix " << radix << ", length " << n;
+
+            ffx_len_release(len, &tmp);
+
+            if (radix < 65536) {
+                PT[n / 2] = radix;
+                EXPECT_EQ(ff1_encrypt_numerals(ctx, CT1.data(), PT.data(), n, NULL, 0), -EINVAL);
+            }
+        }
+
+        ff1_ctx_destroy(ctx);
+    }
+}
+
+/*
+ * an alphabet of more than 255 multibyte characters produces
+ * the same results as the numerals that represent them
+ */
+TEST(ff1, large_alphabet)
+{
+    const uint8_t K[] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+    const uint8_t T[] = { 0x37, 0x37, 0x37, 0x37, 0x70, 0x71, 0x72 };
+
+    const unsigned int radix = 3000;
+
+    struct ff1_ctx * ctx1, * ctx2;
+    std::vector<uint32_t> u32;
+    std::string alpha;
+    uint8_t * u8;
+    size_t len;
+
+    /* cjk ideographs */
+    for (unsigned int i = 0; i < radix; i++) {
+        u32.push_back(0x4e00 + i);
+    }
+    u32.push_back(0);
+    u8 = u32_to_u8(u32.data(), u32.size(), NULL, &len);
+    ASSERT_NE(u8, nullptr);
+    alpha = (const char *)u8;
+    free(u8);
+
+    ASSERT_EQ(ff1_ctx_create_custom_radix(&ctx1, K, sizeof(K), T, sizeof(T), 0, 0, (const uint8_t *)alpha.c_str()), 0);
+    ASSERT_EQ(ff1_ctx_create(&ctx2, K, sizeof(K), T, sizeof(T), 0, 0, radix), 0);
+    EXPECT_EQ(((struct ffx_ctx *)ctx1)->radix, radix);
+
+    for (unsigned int n : { 2, 3, 5, 6, 20, 100 }) {
+        std::vector<uint16_t> PT(n), CT(n);
+        std::vector<uint32_t> str(n + 1);
+        std::vector<char> out(4 * n + 1), tmp(4 * n + 1);
+        uint8_t * PT8;
+
+        for (unsigned int j = 0; j < n; j++) {
+            PT[j] = (j * 7919 + n) % radix;
+            str[j] = u32[PT[j]];
+        }
+        PT8 = u32_to_u8(str.data(), str.size(), NULL, &len);
+        ASSERT_NE(PT8, nullptr);
+
+        EXPECT_EQ(ff1_encrypt(ctx1, out.data(), (const char *)PT8, NULL, 0), 0);
+        EXPECT_EQ(ff1_encrypt_numerals(ctx2, CT.data(), PT.data(), n, NULL, 0), 0);
+
+        for (unsigned int j = 0; j < n; j++) {
+            str[j] = u32[CT[j]];
+        }
+        {
+            uint8_t * const CT8 = u32_to_u8(str.data(), str.size(), NULL, &len);
+
+            ASSERT_NE(CT8, nullptr);
+            EXPECT_STREQ(out.data(), (const char *)CT8) << "length " << n;
+            free(CT8);
+        }
+
+        EXPECT_EQ(ff1_decrypt(ctx1, tmp.data(), out.data(), NULL, 0), 0);
+        EXPECT_STREQ(tmp.data(), (const char *)PT8);
+
+        free(PT8);
+    }
+
+    ff1_ctx_destroy(ctx2);
+    ff1_ctx_destroy(ctx1);
+}
+
+TEST(ff1, invalid_input)
+{
+    const uint8_t K[] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+
+    /* short enough for native integers and too long for them */
+    const char * const PT[] = {
+        "0123456x89",
+        "0123456789012345678901234567890123456789x",
+    };
+
+    struct ff1_ctx * ctx;
+
+    ASSERT_EQ(ff1_ctx_create(&ctx, K, sizeof(K), NULL, 0, 0, 0, 10), 0);
+
+    for (unsigned int i = 0; i < sizeof(PT) / sizeof(*PT); i++) {
+        std::vector<char> out(strlen(PT[i]) + 1);
+
+        EXPECT_EQ(ff1_encrypt(ctx, out.data(), PT[i], NULL, 0), -EINVAL);
+        EXPECT_EQ(ff1_decrypt(ctx, out.data(), PT[i], NULL, 0), -EINVAL);
+    }
+
+    ff1_ctx_destroy(ctx);
+}
+
+/*
+ * records in a batch are encrypted exactly as they would be one
+ * at a time, regardless of their lengths, tweaks, and whether the
+ * records around them fail
+ */
+TEST(ff1, batch)
+{
+    const uint8_t K[] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+    const uint8_t T1[] = { 0x37, 0x37, 0x37, 0x37, 0x70, 0x71, 0x72 };
+    const uint8_t T2[] = { 0x39, 0x38, 0x37, 0x36, 0x35, 0x34, 0x33 };
+
+    /* the last two characters are not part of the records */
+    const char * const PT[] = {
+        "0123456789xx",
+        "01234567890123456789012345678901234567890123456789xx",
+        "0123456x89xx",
+        "9876543210xx",
+        "1xx",
+        "01234567890123456789012345678901234567890123456789xx",
+    };
+    const uint8_t * const T[] = { NULL, T1, NULL, T2, NULL, NULL };
+    const size_t Tlen[] = { 0, sizeof(T1), 0, sizeof(T2), 0, 0 };
+    const size_t cnt = sizeof(PT) / sizeof(*PT);
+
+    std::vector<std::vector<char>> CT(cnt), out(cnt);
+    std::vector<char *> pCT(cnt), pout(cnt);
+    std::vector<size_t> len(cnt);
+    std::vector<int> status(cnt);
+
+    struct ff1_ctx * ctx;
+
+    ASSERT_EQ(ff1_ctx_create(&ctx, K, sizeof(K), T2, sizeof(T2), 0, 0, 10), 0);
+
+    for (size_t i = 0; i < cnt; i++) {
+        len[i] = strlen(PT[i]) - 2;
+        CT[i].resize(len[i] + 1);
+        out[i].resize(len[i] + 1);
+        pCT[i] = CT[i].data();
+        pout[i] = out[i].data();
+    }
+
+    /* the third record is invalid, and the fifth is too short */
+    EXPECT_EQ(ff1_encrypt_batch(ctx, pCT.data(), PT, len.data(),
+                                T, Tlen, cnt, status.data()), -EINVAL);
+    EXPECT_EQ(ff1_decrypt_batch(ctx, pout.data(), pCT.data(), NULL,
+                                T, Tlen, cnt, NULL), -EINVAL);
+
+    for (size_t i = 0; i < cnt; i++) {
+        const std::string pt(PT[i], len[i]);
+        std::vector<char> exp(len[i] + 1);
+
+        if (i == 2 || i == 4) {
+            EXPECT_EQ(status[i], -EINVAL) << i;
+            continue;
+        }
+
+        EXPECT_EQ(status[i], 0) << i;
+        EXPECT_EQ(ff1_encrypt(ctx, exp.data(), pt.c_str(), T[i], Tlen[i]), 0);
+        EXPECT_STREQ(CT[i].data(), exp.data()) << i;
+        EXPECT_STREQ(out[i].data(), pt.c_str()) << i;
+    }
+
+    /* without any tweaks, every record uses the default */
+    EXPECT_EQ(ff1_encrypt_batch(ctx, pCT.data(), PT, len.data(),
+                                NULL, NULL, 2, status.data()), 0);
+    EXPECT_EQ(status[0], 0);
+    EXPECT_EQ(status[1], 0);
+    for (size_t i = 0; i < 2; i++) {
+        const std::string pt(PT[i], len[i]);
+        std::vector<char> exp(len[i] + 1);
+
+        EXPECT_EQ(ff1_encrypt(ctx, exp.data(), pt.c_str(), NULL, 0), 0);
+        EXPECT_STREQ(CT[i].data(), exp.data()) << i;
+    }
+
+    ff1_ctx_destroy(ctx);
+}
+
+/*
+ * a batch spread over the threads of a pool produces the same
+ * outputs and statuses as the same batch run in a single thread
+ */
+TEST(ff1, batch_mt)
+{
+    const uint8_t K[] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+    const uint8_t T1[] = { 0x37, 0x37, 0x37, 0x37, 0x70, 0x71, 0x72 };
+
+    const size_t cnt = 5000;
+
+    std::vector<std::string> PT(cnt);
+    std::vector<std::vector<char>> CT(cnt), exp(cnt), out(cnt);
+    std::vector<const char *> pPT(cnt);
+    std::vector<char *> pCT(cnt), pexp(cnt), pout(cnt);
+    std::vector<const uint8_t *> T(cnt);
+    std::vector<size_t> Tlen(cnt);
+    std::vector<int> status(cnt), estatus(cnt);
+
+    struct ff1_ctx * ctx;
+    struct fpe_pool * pool;
+
+    ASSERT_EQ(ff1_ctx_create(&ctx, K, sizeof(K), NULL, 0, 0, 0, 10), 0);
+    ASSERT_EQ(fpe_pool_create(&pool, 4, 0), 0);
+
+    /*
+     * a mix of lengths, some too long for native integers, and
+     * tweaks. two of the records, near the end, are invalid
+     */
+    for (size_t i = 0; i < cnt; i++) {
+        for (size_t j = 0; j < 6 + i % 37; j++) {
+            PT[i] += '0' + (i + j * 3) % 10;
+        }
+        if (i == cnt - 100 || i == cnt - 10) {
+            PT[i][3] = 'x';
+        }
+
+        T[i] = (i % 3) ? NULL : T1;
+        Tlen[i] = (i % 3) ? 0 : sizeof(T1);
+
+        CT[i].resize(PT[i].size() + 1);
+        exp[i].resize(PT[i].size() + 1);
+        out[i].resize(PT[i].size() + 1);
+
+        pPT[i] = PT[i].c_str();
+        pCT[i] = CT[i].data();
+        pexp[i] = exp[i].data();
+        pout[i] = out[i].data();
+    }
+
+    EXPECT_EQ(ff1_encrypt_batch(ctx, pexp.data(), pPT.data(), NULL,
+                                T.data(), Tlen.data(), cnt,
+                                estatus.data()), -EINVAL);
+
+    EXPECT_EQ(ff1_encrypt_batch_mt(ctx, pool, pCT.data(), pPT.data(), NULL,
+                                   T.data(), Tlen.data(), cnt,
+                                   status.data()), -EINVAL);
+    EXPECT_EQ(ff1_decrypt_batch_mt(ctx, pool, pout.data(),
+                                   (const char * const *)pCT.data(), NULL,
+                                   T.data(), Tlen.data(), cnt,
+                                   NULL), -EINVAL);
+
+    for (size_t i = 0; i < cnt; i++) {
+        EXPECT_EQ(status[i], estatus[i]) << i;
+        if (!status[i]) {
+            EXPECT_STREQ(CT[i].data(), exp[i].data()) << i;
+            EXPECT_STREQ(out[i].data(), PT[i].c_str()) << i;
+        }
+    }
+
+    /* without a pool, the calling thread does the work */
+    EXPECT_EQ(ff1_encrypt_batch_mt(ctx, NULL, pCT.data(), pPT.data(), NULL,
+                                   T.data(), Tlen.data(), 10,
+                                   status.data()), 0);
+    for (size_t i = 0; i < 10; i++) {
+        EXPECT_STREQ(CT[i].data(), exp[i].data()) << i;
+    }
+
+    fpe_pool_destroy(pool);
+    ff1_ctx_destroy(ctx);
+}
+
+/*
+ * runs of records of the same length are processed several at a time,
+ * with the prf for all of them run together. the results are the same
+ * as for records processed individually, with any of the aes and
+ * vectorized round implementations, and for runs broken up by tweaks, invalid records,
+ * and lengths too long for native integers
+ */
+TEST(ff1, batch_lanes)
+{
+    const uint8_t K[] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+    const uint8_t T1[] = { 0x37, 0x37, 0x37, 0x37, 0x70, 0x71, 0x72 };
+    const uint8_t T2[] = { 0x39, 0x38, 0x37, 0x36, 0x35, 0x34, 0x33 };
+
+    const size_t lens[] = { 6, 10, 19, 38, 60 };
+    const size_t cnt = 300;
+
+    std::vector<std::string> PT(cnt);
+    std::vector<std::vector<char>> CT(cnt), out(cnt);
+    std::vector<const char *> pPT(cnt);
+    std::vector<char *> pCT(cnt), pout(cnt);
+    std::vector<const uint8_t *> T(cnt);
+    std::vector<size_t> Tlen(cnt);
+    std::vector<int> status(cnt);
+
+    struct ff1_ctx * ctx;
+    struct ffx_ctx * ffx;
+
+    ASSERT_EQ(ff1_ctx_create(&ctx, K, sizeof(K), T2, sizeof(T2), 0, 0, 10), 0);
+    ffx = (struct ffx_ctx *)ctx;
+
+    for (size_t i = 0; i < cnt; i++) {
+        const size_t n = lens[(i / 40) % 5];
+
+        for (size_t j = 0; j < n; j++) {
+            PT[i] += '0' + (i * 7 + j * 3) % 10;
+        }
+        if (i == 53) {
+            PT[i][2] = 'x';
+        }
+
+        T[i] = (i % 23) ? NULL : T1;
+        Tlen[i] = (i % 23) ? 0 : sizeof(T1);
+
+        CT[i].resize(PT[i].size() + 1);
+        out[i].resize(PT[i].size() + 1);
+
+        pPT[i] = PT[i].c_str();
+        pCT[i] = CT[i].data();
+        pout[i] = out[i].data();
+    }
+
+    for (int impl = 4; impl >= 0; impl--) {
+        const int aesni = ffx->aesni, vaes = ffx->vaes;
+        const int avx2 = ffx->avx2, avx512 = ffx->avx512;
+
+        if (impl < 4) {
+            ffx->avx512 = 0;
+        }
+        if (impl < 3) {
+            ffx->avx2 = 0;
+        }
+        if (impl < 2) {
+            ffx->vaes = 0;
+        }
+        if (impl < 1) {
+            ffx->aesni = 0;
+        }
+
+        EXPECT_EQ(ff1_encrypt_batch(ctx, pCT.data(), pPT.data(), NULL,
+                                    T.data(), Tlen.data(), cnt,
+                                    status.data()), -EINVAL);
+        EXPECT_EQ(ff1_decrypt_batch(ctx, pout.data(),
+                                    (const char * const *)pCT.data(), NULL,
+                                    T.data(), Tlen.data(), cnt, NULL),
+                  -EINVAL);
+
+        for (size_t i = 0; i < cnt; i++) {
+            std::vector<char> exp(PT[i].size() + 1);
+
+            if (i == 53) {
+                EXPECT_EQ(status[i], -EINVAL);
+                continue;
+            }
+
+            EXPECT_EQ(status[i], 0) << i;
+            EXPECT_EQ(ff1_encrypt(ctx, exp.data(), pPT[i], T[i], Tlen[i]), 0);
+            EXPECT_STREQ(CT[i].data(), exp.data())
+                << "aesni " << ffx->aesni << ", vaes " << ffx->vaes
+                << ", avx2 " << ffx->avx2 << ", avx512 " << ffx->avx512
+                << ", record " << i;
+            EXPECT_STREQ(out[i].data(), pPT[i]) << i;
+        }
+
+        ffx->aesni = aesni;
+        ffx->vaes = vaes;
+        ffx->avx2 = avx2;
+        ffx->avx512 = avx512;
+    }
+
+    ff1_ctx_destroy(ctx);
+}
+
+/*
+ * records of mixed lengths are bucketed by length, so records of the
+ * same length are processed together even when they're interleaved
+ * with others. each record's result ends up in its own position, and
+ * the error returned is that of the first record, in order, to fail
+ */
+TEST(ff1, batch_buckets)
+{
+    const uint8_t K[] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+    const uint8_t T1[] = { 0x37, 0x37, 0x37, 0x37, 0x70, 0x71, 0x72 };
+    const size_t lens[] = { 16, 10, 3, 16, 12, 60, 10 };
+
+    const size_t cnt = 400;
+
+    std::vector<std::string> PT(cnt);
+    std::vector<std::vector<char>> CT(cnt), out(cnt);
+    std::vector<const char *> pPT(cnt);
+    std::vector<char *> pCT(cnt), pout(cnt);
+    std::vector<const uint8_t *> T(cnt);
+    std::vector<size_t> Tlen(cnt);
+    std::vector<int> status(cnt);
+
+    struct ff1_ctx * ctx;
+
+    ASSERT_EQ(ff1_ctx_create(&ctx, K, sizeof(K), NULL, 0, 0, 0, 10), 0);
+
+    /*
+     * the records of length 3 are too short, and the one with an
+     * invalid character comes before any of them
+     */
+    for (size_t i = 0; i < cnt; i++) {
+        const size_t n = lens[i % (sizeof(lens) / sizeof(*lens))];
+
+        for (size_t j = 0; j < n; j++) {
+            PT[i] += '0' + (i * 7 + j * 3) % 10;
+        }
+        if (i == 1) {
+            PT[i][4] = 'x';
+        }
+
+        T[i] = (i % 11) ? NULL : T1;
+        Tlen[i] = (i % 11) ? 0 : sizeof(T1);
+
+        CT[i].resize(PT[i].size() + 1);
+        out[i].resize(PT[i].size() + 1);
+
+        pPT[i] = PT[i].c_str();
+        pCT[i] = CT[i].data();
+        pout[i] = out[i].data();
+    }
+    pPT[cnt - 1] = NULL;
+
+    EXPECT_EQ(ff1_encrypt_batch(ctx, pCT.data(), pPT.data(), NULL,
+                                T.data(), Tlen.data(), cnt,
+                                status.data()), -EINVAL);
+    EXPECT_EQ(ff1_decrypt_batch(ctx, pout.data(),
+                                (const char * const *)pCT.data(), NULL,
+                                T.data(), Tlen.data(), cnt - 1, NULL),
+              -EINVAL);
+
+    for (size_t i = 0; i < cnt; i++) {
+        std::vector<char> exp(PT[i].size() + 1);
+
+        if (i == 1 || i == cnt - 1 || PT[i].size() == 3) {
+            EXPECT_EQ(status[i], -EINVAL) << i;
+            continue;
+        }
+
+        EXPECT_EQ(status[i], 0) << i;
+        EXPECT_EQ(ff1_encrypt(ctx, exp.data(), pPT[i], T[i], Tlen[i]), 0);
+        EXPECT_STREQ(CT[i].data(), exp.data()) << i;
+        EXPECT_STREQ(out[i].data(), pPT[i]) << i;
+    }
+
+    ff1_ctx_destroy(ctx);
+}
+
+/*
+ * fields packed back to back and at an offset within larger
+ * records are encrypted as they would be individually, and the
+ * bytes around them are left alone
+ */
+TEST(ff1, strided)
+{
+    const uint8_t K[] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+    const uint8_t T[] = { 0x37, 0x37, 0x37, 0x37, 0x70, 0x71, 0x72 };
+
+    const size_t width = 16, cnt = 100;
+
+    struct ff1_ctx * ctx;
+
+    ASSERT_EQ(ff1_ctx_create(&ctx, K, sizeof(K), NULL, 0, 0, 0, 10), 0);
+
+    /* the fields are packed when the stride equals the width */
+    for (const size_t off : { 0, 3 }) {
+        const size_t stride = width + 2 * off;
+
+        std::string col, out, tmp;
+        std::vector<int> status(cnt);
+
+        for (size_t i = 0; i < cnt; i++) {
+            col += std::string(off, '|');
+            for (size_t j = 0; j < width; j++) {
+                col += '0' + (i * 7 + j * 3) % 10;
+            }
+            col += std::string(off, '|');
+        }
+        /* an invalid field */
+        col[off + 17 * stride + 5] = 'x';
+
+        out = col;
+        EXPECT_EQ(ff1_encrypt_strided(ctx, &out[off], stride,
+                                      &col[off], stride, width, cnt,
+                                      T, sizeof(T), status.data()),
+                  -EINVAL);
+
+        for (size_t i = 0; i < cnt; i++) {
+            const std::string pt = col.substr(off + i * stride, width);
+            std::vector<char> exp(width + 1);
+
+            if (i == 17) {
+                EXPECT_EQ(status[i], -EINVAL);
+                EXPECT_EQ(out.substr(i * stride, stride),
+                          col.substr(i * stride, stride));
+                continue;
+            }
+
+            EXPECT_EQ(status[i], 0);
+            EXPECT_EQ(ff1_encrypt(ctx, exp.data(), pt.c_str(), T, sizeof(T)), 0);
+            EXPECT_EQ(out.substr(off + i * stride, width), exp.data()) << i;
+            EXPECT_EQ(out.substr(i * stride, off), std::string(off, '|'));
+            EXPECT_EQ(out.substr(i * stride + off + width, off), std::string(off, '|'));
+        }
+
+        /* and back again, in place */
+        tmp = out;
+        EXPECT_EQ(ff1_decrypt_strided(ctx, &tmp[off], stride,
+                                      &tmp[off], stride, width, cnt,
+                                      T, sizeof(T), NULL),
+                  -EINVAL);
+        EXPECT_EQ(tmp, col);
+    }
+
+    ff1_ctx_destroy(ctx);
+}
+
+/*
+ * a column whose width is out of range is rejected before any
+ * length parameters are computed and cached for it
+ */
+TEST(ff1, strided_width)
+{
+    const uint8_t K[] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+
+    struct ff1_ctx * ctx;
+    struct ffx_ctx * ffx;
+    unsigned int cnt;
+
+    std::string col(64, '1'), out(64, '|');
+
+    ASSERT_EQ(ff1_ctx_create(&ctx, K, sizeof(K), NULL, 0, 0, 0, 10), 0);
+    ffx = (struct ffx_ctx *)ctx;
+
+    cnt = ffx->lens.cnt;
+
+    EXPECT_EQ(ff1_encrypt_strided(ctx, &out[0], 1, &col[0], 1,
+                                  ffx->txtlen.min - 1, 2,
+                                  NULL, 0, NULL), -EINVAL);
+    EXPECT_EQ(ff1_encrypt_strided(ctx, &out[0], 1, &col[0], 1,
+                                  ffx->txtlen.max + 1, 2,
+                                  NULL, 0, NULL), -EINVAL);
+
+    EXPECT_EQ(ffx->lens.cnt, cnt);
+    EXPECT_EQ(out, std::string(64, '|'));
+
+    ff1_ctx_destroy(ctx);
+}
+
+/*
+ * texts are read from the middle of larger buffers and the
+ * output is exactly the size of the text, for alphabets of
+ * single- and multibyte characters
+ */
+TEST(ff1, explicit_length)
+{
+    const uint8_t K[] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+
+    const struct {
+        const char * radix;
+        const char * line;
+        size_t off, len;
+    } tests[] = {
+        { "0123456789", "abc,0123456789,def", 4, 10 },
+        { "0123456789", "01234567890123456789012345678901234567890", 3, 37 },
+        { " ÊËÌÍÎÏðñòóôĵĶķĸĹϺϻϼϽϾϿ0123456789abcABC", "xx,ÏÍ3ÊËcϾ,yy", 3, 12 },
+    };
+
+    for (unsigned int i = 0; i < sizeof(tests) / sizeof(*tests); i++) {
+        const std::string pt(tests[i].line + tests[i].off, tests[i].len);
+
+        struct ff1_ctx * ctx;
+        std::vector<char> exp, out, tmp;
+        size_t len;
+
+        ASSERT_EQ(
+            ff1_ctx_create_custom_radix(
+                &ctx, K, sizeof(K), NULL, 0, 0, 0,
+                (const uint8_t *)tests[i].radix), 0);
+
+        exp.resize(ff1_output_len(ctx, pt.size()) + 1);
+        ASSERT_EQ(ff1_encrypt(ctx, exp.data(), pt.c_str(), NULL, 0), 0);
+
+        /* the size is sufficient but need not be exact */
+        len = ff1_output_len(ctx, pt.size());
+        EXPECT_GE(len, strlen(exp.data()));
+        out.resize(len);
+        EXPECT_EQ(ff1_encrypt_len(ctx, out.data(), &len,
+                                  tests[i].line + tests[i].off, tests[i].len,
+                                  NULL, 0), 0);
+        EXPECT_EQ(std::string(out.data(), len), exp.data());
+
+        /* exactly enough space, and then one byte too few */
+        out.assign(len, '\0');
+        EXPECT_EQ(ff1_encrypt_len(ctx, out.data(), &len,
+                                  tests[i].line + tests[i].off, tests[i].len,
+                                  NULL, 0), 0);
+        EXPECT_EQ(std::string(out.data(), len), exp.data());
+        len--;
+        EXPECT_EQ(ff1_encrypt_len(ctx, out.data(), &len,
+                                  tests[i].line + tests[i].off, tests[i].len,
+                                  NULL, 0), -ENOSPC);
+
+        len = out.size();
+        tmp.resize(ff1_output_len(ctx, len));
+        len = tmp.size();
+        EXPECT_EQ(ff1_decrypt_len(ctx, tmp.data(), &len,
+                                  out.data(), out.size(), NULL, 0), 0);
+        EXPECT_EQ(std::string(tmp.data(), len), pt);
+
+        ff1_ctx_destroy(ctx);
+    }
+}
@@ -1,5 +1,13 @@
 #include <gtest/gtest.h>
 #include <ubiq/fpe/ff3_1.h>
+#include <ubiq/fpe/pool.h>
+#include <ubiq/fpe/internal/bn.h>
+#include <ubiq/fpe/internal/ffx.h>
+
+#include <string>
+#include <vector>
+
+#include <unistr.h>
 
 static
 void ff3_1_test(const uint8_t * const K, const size_t k,
@@ -185,3 +193,604 @@ TEST(ff3_1, ubiq9)
 
     ff3_1_test(K, sizeof(K), T, PT, CT, 36);
 }
+
+/*
+ * translate @str from the characters of one alphabet to those of
+ * another. the characters of @from are single bytes, while those
+ * of @to may be multibyte characters, given as separate strings
+ */
+static
+std::string ff3_1_translate(const char * const str,
+                            const char * const from,
+                            const std::vector<std::string> & to)
+{
+    std::string res;
+
+    for (const char * s = str; *s; s++) {
+        res += to[strchr(from, *s) - from];
+    }
+
+    return res;
+}
+
+/*
+ * encryption with a custom alphabet is the same as with the
+ * standard one, with the characters substituted for each other
+ */
+TEST(ff3_1, custom_radix)
+{
+    const uint8_t K[] = {
+        0xef, 0x43, 0x59, 0xd8, 0xd5, 0x80, 0xaa, 0x4f,
+        0x7f, 0x03, 0x6d, 0x6f, 0x04, 0xfc, 0x6a, 0x94,
+    };
+    const uint8_t T[7] = { 0 };
+
+    const char PT[] = "890121234567890000";
+    const char CT[] = "075870132022772250";
+
+    const std::vector<std::vector<std::string>> alphas = {
+        { "0", "1", "2", "3", "4", "5", "6", "7", "8", "9" },
+        { "!", "@", "#", "$", "%", "^", "&", "*", "(", ")" },
+        { "ð", "ñ", "ò", "ó", "ô", "ĵ", "Ķ", "ķ", "ĸ", "Ĺ" },
+        { "a", "ĵ", "b", "Ķ", "c", "ķ", "d", "ĸ", "e", "Ĺ" },
+    };
+
+    for (const auto & alpha : alphas) {
+        std::string radix, pt, ct, out;
+        struct ff3_1_ctx * ctx;
+
+        for (const auto & c : alpha) {
+            radix += c;
+        }
+        pt = ff3_1_translate(PT, "0123456789", alpha);
+        ct = ff3_1_translate(CT, "0123456789", alpha);
+        out.resize(ct.size() + 1);
+
+        ASSERT_EQ(
+            ff3_1_ctx_create_custom_radix(
+                &ctx, K, sizeof(K), T, (const uint8_t *)radix.c_str()), 0);
+
+        EXPECT_EQ(ff3_1_encrypt(ctx, &out[0], pt.c_str(), NULL), 0);
+        EXPECT_STREQ(out.c_str(), ct.c_str()) << radix;
+        EXPECT_EQ(ff3_1_decrypt(ctx, &out[0], ct.c_str(), NULL), 0);
+        EXPECT_STREQ(out.c_str(), pt.c_str()) << radix;
+
+        /* a character that isn't in the alphabet */
+        pt[pt.size() / 2] = 'z';
+        EXPECT_EQ(ff3_1_encrypt(ctx, &out[0], pt.c_str(), NULL), -EINVAL);
+
+        ff3_1_ctx_destroy(ctx);
+    }
+}
+
+/*
+ * an alphabet larger than 255 characters, which is only
+ * possible with multibyte characters, at every length
+ */
+TEST(ff3_1, custom_radix_large)
+{
+    const uint8_t K[] = {
+        0xef, 0x43, 0x59, 0xd8, 0xd5, 0x80, 0xaa, 0x4f,
+        0x7f, 0x03, 0x6d, 0x6f, 0x04, 0xfc, 0x6a, 0x94,
+    };
+    const uint8_t T[7] = {
+        0x37, 0x37, 0x37, 0x37, 0x70, 0x71, 0x72,
+    };
+
+    std::vector<std::string> alpha;
+    std::string radix;
+
+    struct ff3_1_ctx * ctx;
+    struct ffx_ctx * ffx;
+
+    /* 1000 characters from the cjk block */
+    for (uint32_t c = 0x4e00; c < 0x4e00 + 1000; c++) {
+        uint8_t buf[4];
+        size_t len = sizeof(buf);
+
+        u32_to_u8(&c, 1, buf, &len);
+        alpha.emplace_back((const char *)buf, len);
+        radix += alpha.back();
+    }
+
+    ASSERT_EQ(
+        ff3_1_ctx_create_custom_radix(
+            &ctx, K, sizeof(K), T, (const uint8_t *)radix.c_str()), 0);
+    ffx = (struct ffx_ctx *)ctx;
+    EXPECT_EQ(ffx->radix, 1000u);
+
+    for (unsigned int n = ffx->txtlen.min; n <= ffx->txtlen.max; n++) {
+        std::string PT, CT, out;
+
+        for (unsigned int j = 0; j < n; j++) {
+            PT += alpha[(j * 7919 + n) % alpha.size()];
+        }
+        CT.resize(PT.size() + 1);
+        out.resize(PT.size() + 1);
+
+        EXPECT_EQ(ff3_1_encrypt(ctx, &CT[0], PT.c_str(), NULL), 0);
+        EXPECT_EQ(strlen(CT.c_str()), PT.size());
+        EXPECT_STRNE(CT.c_str(), PT.c_str());
+        EXPECT_EQ(ff3_1_decrypt(ctx, &out[0], CT.c_str(), NULL), 0);
+        EXPECT_STREQ(out.c_str(), PT.c_str()) << "length " << n;
+    }
+
+    ff3_1_ctx_destroy(ctx);
+}
+
+#if defined(__SIZEOF_INT128__)
+/*
+ * for the shortest and longest supported lengths, compare the
+ * results of the 128-bit engine to those of the big integer engine.
+ * the number of lengths is limited to what fits in the cache
+ */
+TEST(ff3_1, wide_engine)
+{
+    const uint8_t K[] = {
+        0xef, 0x43, 0x59, 0xd8, 0xd5, 0x80, 0xaa, 0x4f,
+        0x7f, 0x03, 0x6d, 0x6f, 0x04, 0xfc, 0x6a, 0x94,
+    };
+    const uint8_t T[7] = {
+        0x37, 0x37, 0x37, 0x37, 0x70, 0x71, 0x72,
+    };
+
+    /* the big integer engine only supports radixes up to 62 */
+    const unsigned int radixes[] = { 2, 7, 10, 16, 36, 62 };
+
+    for (unsigned int i = 0; i < sizeof(radixes) / sizeof(*radixes); i++) {
+        const unsigned int radix = radixes[i];
+        const char * const alpha = get_standard_bignum_radix(radix);
+
+        struct ff3_1_ctx * ctx;
+        struct ffx_ctx * ffx;
+
+        ASSERT_EQ(ff3_1_ctx_create(&ctx, K, sizeof(K), T, radix), 0);
+        /* the ffx context is the first member of the ff3-1 context */
+        ffx = (struct ffx_ctx *)ctx;
+
+        for (unsigned int n = ffx->txtlen.min; n <= ffx->txtlen.max; n++) {
+            const struct ffx_len * len;
+            struct ffx_len tmp;
+
+            std::string PT, CT1, CT2, out;
+
+            if (n >= ffx->txtlen.min + FFX_LEN_CACHE / 2 &&
+                n + FFX_LEN_CACHE / 2 <= ffx->txtlen.max) {
+                continue;
+            }
+
+            for (unsigned int j = 0; j < n; j++) {
+                PT += alpha[(j * 7 + n) % radix];
+            }
+            CT1.resize(n + 1);
+            CT2.resize(n + 1);
+            out.resize(n + 1);
+
+            len = ffx_len_acquire(ffx, n, &tmp);
+            EXPECT_TRUE(len->wide) << "radix " << radix << ", length " << n;
+
+            EXPECT_EQ(ff3_1_encrypt(ctx, &CT1[0], PT.c_str(), NULL), 0);
+            EXPECT_EQ(ff3_1_decrypt(ctx, &out[0], CT1.c_str(), NULL), 0);
+            EXPECT_EQ(strcmp(out.c_str(), PT.c_str()), 0);
+
+            ASSERT_NE(len, &tmp);
+            ((struct ffx_len *)len)->wide = 0;
+            EXPECT_EQ(ff3_1_encrypt(ctx, &CT2[0], PT.c_str(), NULL), 0);
+            ((struct ffx_len *)len)->wide = 1;
+
+            EXPECT_EQ(strcmp(CT1.c_str(), CT2.c_str()), 0)
+                << "radix " << radix << ", length " << n;
+
+            ffx_len_release(len, &tmp);
+        }
+
+        ff3_1_ctx_destroy(ctx);
+    }
+}
+#endif
+
+/*
+ * records in a batch are encrypted exactly as they would be one
+ * at a time, regardless of their tweaks and whether the records
+ * around them fail
+ */
+TEST(ff3_1, batch)
+{
+    const uint8_t K[] = {
+        0xef, 0x43, 0x59, 0xd8, 0xd5, 0x80, 0xaa, 0x4f,
+        0x7f, 0x03, 0x6d, 0x6f, 0x04, 0xfc, 0x6a, 0x94,
+    };
+    const uint8_t T0[7] = { 0 };
+    const uint8_t T1[7] = {
+        0x39, 0x38, 0x37, 0x36, 0x35, 0x34, 0x33,
+    };
+
+    /* the last character is not part of the records */
+    const char * const PT[] = {
+        "890121234567890000x",
+        "89012123456789000x",
+        "8901212x4567890000x",
+        "89012123456789000000000000x",
+    };
+    const uint8_t * const T[] = { NULL, T1, T1, NULL };
+    const size_t cnt = sizeof(PT) / sizeof(*PT);
+
+    std::vector<std::vector<char>> CT(cnt), out(cnt);
+    std::vector<char *> pCT(cnt), pout(cnt);
+    std::vector<size_t> len(cnt);
+    std::vector<int> status(cnt);
+
+    struct ff3_1_ctx * ctx;
+
+    ASSERT_EQ(ff3_1_ctx_create(&ctx, K, sizeof(K), T0, 10), 0);
+
+    for (size_t i = 0; i < cnt; i++) {
+        len[i] = strlen(PT[i]) - 1;
+        CT[i].resize(len[i] + 1);
+        out[i].resize(len[i] + 1);
+        pCT[i] = CT[i].data();
+        pout[i] = out[i].data();
+    }
+
+    /* the third record is invalid */
+    EXPECT_EQ(ff3_1_encrypt_batch(ctx, pCT.data(), PT, len.data(),
+                                  T, cnt, status.data()), -EINVAL);
+    EXPECT_EQ(ff3_1_decrypt_batch(ctx, pout.data(), pCT.data(), NULL,
+                                  T, cnt, NULL), -EINVAL);
+
+    for (size_t i = 0; i < cnt; i++) {
+        const std::string pt(PT[i], len[i]);
+        std::vector<char> exp(len[i] + 1);
+
+        if (i == 2) {
+            EXPECT_EQ(status[i], -EINVAL);
+            continue;
+        }
+
+        EXPECT_EQ(status[i], 0) << i;
+        EXPECT_EQ(ff3_1_encrypt(ctx, exp.data(), pt.c_str(), T[i]), 0);
+        EXPECT_STREQ(CT[i].data(), exp.data()) << i;
+        EXPECT_STREQ(out[i].data(), pt.c_str()) << i;
+    }
+
+    ff3_1_ctx_destroy(ctx);
+}
+
+/* see the ff1 version of this test */
+TEST(ff3_1, batch_mt)
+{
+    const uint8_t K[] = {
+        0xef, 0x43, 0x59, 0xd8, 0xd5, 0x80, 0xaa, 0x4f,
+        0x7f, 0x03, 0x6d, 0x6f, 0x04, 0xfc, 0x6a, 0x94,
+    };
+    const uint8_t T0[7] = { 0 };
+    const uint8_t T1[7] = { 0x39, 0x38, 0x37, 0x36, 0x35, 0x34, 0x33 };
+
+    const size_t cnt = 3000;
+
+    std::vector<std::string> PT(cnt);
+    std::vector<std::vector<char>> CT(cnt), exp(cnt), out(cnt);
+    std::vector<const char *> pPT(cnt);
+    std::vector<char *> pCT(cnt), pexp(cnt), pout(cnt);
+    std::vector<const uint8_t *> T(cnt);
+    std::vector<int> status(cnt), estatus(cnt);
+
+    struct ff3_1_ctx * ctx;
+    struct fpe_pool * pool;
+
+    ASSERT_EQ(ff3_1_ctx_create(&ctx, K, sizeof(K), T0, 10), 0);
+    ASSERT_EQ(fpe_pool_create(&pool, 3, 0), 0);
+
+    for (size_t i = 0; i < cnt; i++) {
+        for (size_t j = 0; j < 6 + i % 51; j++) {
+            PT[i] += '0' + (i + j * 7) % 10;
+        }
+        if (i == cnt / 2) {
+            PT[i][0] = 'x';
+        }
+
+        T[i] = (i % 2) ? NULL : T1;
+
+        CT[i].resize(PT[i].size() + 1);
+        exp[i].resize(PT[i].size() + 1);
+        out[i].resize(PT[i].size() + 1);
+
+        pPT[i] = PT[i].c_str();
+        pCT[i] = CT[i].data();
+        pexp[i] = exp[i].data();
+        pout[i] = out[i].data();
+    }
+
+    EXPECT_EQ(ff3_1_encrypt_batch(ctx, pexp.data(), pPT.data(), NULL,
+                                  T.data(), cnt, estatus.data()), -EINVAL);
+
+    EXPECT_EQ(ff3_1_encrypt_batch_mt(ctx, pool, pCT.data(), pPT.data(), NULL,
+                                     T.data(), cnt, status.data()), -EINVAL);
+    EXPECT_EQ(ff3_1_decrypt_batch_mt(ctx, pool, pout.data(),
+                                     (const char * const *)pCT.data(), NULL,
+                                     T.data(), cnt, NULL), -EINVAL);
+
+    for (size_t i = 0; i < cnt; i++) {
+        EXPECT_EQ(status[i], estatus[i]) << i;
+        if (!status[i]) {
+            EXPECT_STREQ(CT[i].data(), exp[i].data()) << i;
+            EXPECT_STREQ(out[i].data(), PT[i].c_str()) << i;
+        }
+    }
+
+    fpe_pool_destroy(pool);
+    ff3_1_ctx_destroy(ctx);
+}
+
+/* see the ff1 version of this test */
+TEST(ff3_1, batch_lanes)
+{
+    const uint8_t K[] = {
+        0xef, 0x43, 0x59, 0xd8, 0xd5, 0x80, 0xaa, 0x4f,
+        0x7f, 0x03, 0x6d, 0x6f, 0x04, 0xfc, 0x6a, 0x94,
+    };
+    const uint8_t T0[7] = { 0x37, 0x37, 0x37, 0x37, 0x70, 0x71, 0x72 };
+    const uint8_t T1[7] = { 0x39, 0x38, 0x37, 0x36, 0x35, 0x34, 0x33 };
+
+    const size_t lens[] = { 6, 10, 19, 38, 56 };
+    const size_t cnt = 300;
+
+    std::vector<std::string> PT(cnt);
+    std::vector<std::vector<char>> CT(cnt), out(cnt);
+    std::vector<const char *> pPT(cnt);
+    std::vector<char *> pCT(cnt), pout(cnt);
+    std::vector<const uint8_t *> T(cnt);
+    std::vector<int> status(cnt);
+
+    struct ff3_1_ctx * ctx;
+    struct ffx_ctx * ffx;
+
+    ASSERT_EQ(ff3_1_ctx_create(&ctx, K, sizeof(K), T0, 10), 0);
+    ffx = (struct ffx_ctx *)ctx;
+
+    /* records with different tweaks are processed together */
+    for (size_t i = 0; i < cnt; i++) {
+        const size_t n = lens[(i / 40) % 5];
+
+        for (size_t j = 0; j < n; j++) {
+            PT[i] += '0' + (i * 7 + j * 3) % 10;
+        }
+        if (i == 53) {
+            PT[i][2] = 'x';
+        }
+
+        T[i] = (i % 3) ? NULL : T1;
+
+        CT[i].resize(PT[i].size() + 1);
+        out[i].resize(PT[i].size() + 1);
+
+        pPT[i] = PT[i].c_str();
+        pCT[i] = CT[i].data();
+        pout[i] = out[i].data();
+    }
+
+    for (int impl = 2; impl >= 0; impl--) {
+        const int aesni = ffx->aesni, vaes = ffx->vaes;
+
+        if (impl < 2) {
+            ffx->vaes = 0;
+        }
+        if (impl < 1) {
+            ffx->aesni = 0;
+        }
+
+        EXPECT_EQ(ff3_1_encrypt_batch(ctx, pCT.data(), pPT.data(), NULL,
+                                      T.data(), cnt, status.data()), -EINVAL);
+        EXPECT_EQ(ff3_1_decrypt_batch(ctx, pout.data(),
+                                      (const char * const *)pCT.data(), NULL,
+                                      T.data(), cnt, NULL), -EINVAL);
+
+        for (size_t i = 0; i < cnt; i++) {
+            std::vector<char> exp(PT[i].size() + 1);
+
+            if (i == 53) {
+                EXPECT_EQ(status[i], -EINVAL);
+                continue;
+            }
+
+            EXPECT_EQ(status[i], 0) << i;
+            EXPECT_EQ(ff3_1_encrypt(ctx, exp.data(), pPT[i], T[i]), 0);
+            EXPECT_STREQ(CT[i].data(), exp.data())
+                << "aesni " << ffx->aesni << ", vaes " << ffx->vaes
+                << ", record " << i;
+            EXPECT_STREQ(out[i].data(), pPT[i]) << i;
+        }
+
+        ffx->aesni = aesni;
+        ffx->vaes = vaes;
+    }
+
+    ff3_1_ctx_destroy(ctx);
+}
+
+/* see the ff1 version of this test */
+TEST(ff3_1, batch_buckets)
+{
+    const uint8_t K[] = {
+        0xef, 0x43, 0x59, 0xd8, 0xd5, 0x80, 0xaa, 0x4f,
+        0x7f, 0x03, 0x6d, 0x6f, 0x04, 0xfc, 0x6a, 0x94,
+    };
+    const uint8_t T0[7] = { 0 };
+    const uint8_t T1[7] = { 0x39, 0x38, 0x37, 0x36, 0x35, 0x34, 0x33 };
+    const size_t lens[] = { 16, 10, 3, 16, 12, 56, 10 };
+
+    const size_t cnt = 400;
+
+    std::vector<std::string> PT(cnt);
+    std::vector<std::vector<char>> CT(cnt), out(cnt);
+    std::vector<const char *> pPT(cnt);
+    std::vector<char *> pCT(cnt), pout(cnt);
+    std::vector<const uint8_t *> T(cnt);
+    std::vector<int> status(cnt);
+
+    struct ff3_1_ctx * ctx;
+
+    ASSERT_EQ(ff3_1_ctx_create(&ctx, K, sizeof(K), T0, 10), 0);
+
+    for (size_t i = 0; i < cnt; i++) {
+        const size_t n = lens[i % (sizeof(lens) / sizeof(*lens))];
+
+        for (size_t j = 0; j < n; j++) {
+            PT[i] += '0' + (i * 7 + j * 3) % 10;
+        }
+        if (i == 1) {
+            PT[i][4] = 'x';
+        }
+
+        T[i] = (i % 3) ? NULL : T1;
+
+        CT[i].resize(PT[i].size() + 1);
+        out[i].resize(PT[i].size() + 1);
+
+        pPT[i] = PT[i].c_str();
+        pCT[i] = CT[i].data();
+        pout[i] = out[i].data();
+    }
+    pPT[cnt - 1] = NULL;
+
+    EXPECT_EQ(ff3_1_encrypt_batch(ctx, pCT.data(), pPT.data(), NULL,
+                                  T.data(), cnt, status.data()), -EINVAL);
+    EXPECT_EQ(ff3_1_decrypt_batch(ctx, pout.data(),
+                                  (const char * const *)pCT.data(), NULL,
+                                  T.data(), cnt - 1, NULL), -EINVAL);
+
+    for (size_t i = 0; i < cnt; i++) {
+        std::vector<char> exp(PT[i].size() + 1);
+
+        if (i == 1 || i == cnt - 1 || PT[i].size() == 3) {
+            EXPECT_EQ(status[i], -EINVAL) << i;
+            continue;
+        }
+
+        EXPECT_EQ(status[i], 0) << i;
+        EXPECT_EQ(ff3_1_encrypt(ctx, exp.data(), pPT[i], T[i]), 0);
+        EXPECT_STREQ(CT[i].data(), exp.data()) << i;
+        EXPECT_STREQ(out[i].data(), pPT[i]) << i;
+    }
+
+    ff3_1_ctx_destroy(ctx);
+}
+
+/*
+ * packed fields are encrypted as they would be individually,
+ * in place and into a separate column
+ */
+TEST(ff3_1, strided)
+{
+    const uint8_t K[] = {
+        0xef, 0x43, 0x59, 0xd8, 0xd5, 0x80, 0xaa, 0x4f,
+        0x7f, 0x03, 0x6d, 0x6f, 0x04, 0xfc, 0x6a, 0x94,
+    };
+    const uint8_t T[7] = {
+        0x39, 0x38, 0x37, 0x36, 0x35, 0x34, 0x33,
+    };
+
+    const size_t width = 18, cnt = 50;
+
+    struct ff3_1_ctx * ctx;
+    std::string col, out;
+    std::vector<int> status(cnt);
+
+    ASSERT_EQ(ff3_1_ctx_create(&ctx, K, sizeof(K), T, 10), 0);
+
+    for (size_t i = 0; i < cnt; i++) {
+        for (size_t j = 0; j < width; j++) {
+            col += '0' + (i * 7 + j * 3) % 10;
+        }
+    }
+
+    out.resize(col.size());
+    EXPECT_EQ(ff3_1_encrypt_strided(ctx, &out[0], width, col.data(), width,
+                                    width, cnt, NULL, status.data()), 0);
+
+    for (size_t i = 0; i < cnt; i++) {
+        const std::string pt = col.substr(i * width, width);
+        std::vector<char> exp(width + 1);
+
+        EXPECT_EQ(status[i], 0);
+        EXPECT_EQ(ff3_1_encrypt(ctx, exp.data(), pt.c_str(), NULL), 0);
+        EXPECT_EQ(out.substr(i * width, width), exp.data()) << i;
+    }
+
+    EXPECT_EQ(ff3_1_decrypt_strided(ctx, &out[0], width, out.data(), width,
+                                    width, cnt, NULL, NULL), 0);
+    EXPECT_EQ(out, col);
+
+    ff3_1_ctx_destroy(ctx);
+}
+
+/* see the ff1 version of this test */
+TEST(ff3_1, strided_width)
+{
+    const uint8_t K[] = {
+        0xef, 0x43, 0x59, 0xd8, 0xd5, 0x80, 0xaa, 0x4f,
+        0x7f, 0x03, 0x6d, 0x6f, 0x04, 0xfc, 0x6a, 0x94,
+    };
+    const uint8_t T[7] = { 0 };
+
+    struct ff3_1_ctx * ctx;
+    struct ffx_ctx * ffx;
+    unsigned int cnt;
+
+    std::string col(128, '1'), out(128, '|');
+
+    ASSERT_EQ(ff3_1_ctx_create(&ctx, K, sizeof(K), T, 10), 0);
+    ffx = (struct ffx_ctx *)ctx;
+
+    cnt = ffx->lens.cnt;
+
+    EXPECT_EQ(ff3_1_encrypt_strided(ctx, &out[0], 1, &col[0], 1,
+                                    ffx->txtlen.min - 1, 2,
+                                    NULL, NULL), -EINVAL);
+    EXPECT_EQ(ff3_1_encrypt_strided(ctx, &out[0], 1, &col[0], 1,
+                                    ffx->txtlen.max + 1, 2,
+                                    NULL, NULL), -EINVAL);
+
+    EXPECT_EQ(ffx->lens.cnt, cnt);
+    EXPECT_EQ(out, std::string(128, '|'));
+
+    ff3_1_ctx_destroy(ctx);
+}
+
+/*
+ * texts are read from the middle of larger buffers and the
+ * output is exactly the size of the text
+ */
+TEST(ff3_1, explicit_length)
+{
+    const uint8_t K[] = {
+        0xef, 0x43, 0x59, 0xd8, 0xd5, 0x80, 0xaa, 0x4f,
+        0x7f, 0x03, 0x6d, 0x6f, 0x04, 0xfc, 0x6a, 0x94,
+    };
+    const uint8_t T[7] = { 0 };
+
+    const char line[] = "id,890121234567890000,x";
+    const char CT[] = "075870132022772250";
+
+    struct ff3_1_ctx * ctx;
+    char out[sizeof(CT) - 1], tmp[sizeof(CT) - 1];
+    size_t len;
+
+    ASSERT_EQ(ff3_1_ctx_create(&ctx, K, sizeof(K), T, 10), 0);
+
+    EXPECT_EQ(ff3_1_output_len(ctx, sizeof(out)), sizeof(out));
+
+    len = sizeof(out);
+    EXPECT_EQ(ff3_1_encrypt_len(ctx, out, &len, line + 3, sizeof(out), NULL), 0);
+    EXPECT_EQ(len, sizeof(out));
+    EXPECT_EQ(std::string(out, len), CT);
+
+    len = sizeof(tmp);
+    EXPECT_EQ(ff3_1_decrypt_len(ctx, tmp, &len, out, sizeof(out), NULL), 0);
+    EXPECT_EQ(std::string(tmp, len), std::string(line + 3, sizeof(tmp)));
+
+    len = sizeof(out) - 1;
+    EXPECT_EQ(ff3_1_encrypt_len(ctx, out, &len, line + 3, sizeof(out), NULL), -ENOSPC);
+
+    ff3_1_ctx_destroy(ctx);
+}
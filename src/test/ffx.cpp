@@ -6,41 +6,9 @@
 #include <uniwidth.h>
 #include <wchar.h>
 #include <chrono>
+#include <cmath>
 
 
-TEST(ffx, revs)
-{
-    char s[] = "abcde";
-    char d[sizeof(s)];
-
-    ASSERT_EQ(d, ffx_revs(d, s));
-    EXPECT_EQ(strcmp(d, "edcba"), 0);
-
-    ASSERT_EQ(s, ffx_revs(s, s));
-    EXPECT_EQ(strcmp(s, "edcba"), 0);
-
-    s[strlen(s) - 1] = '\0';
-    ASSERT_EQ(d, ffx_revs(d, s));
-    EXPECT_EQ(strcmp(d, "bcde"), 0);
-
-    ASSERT_EQ(s, ffx_revs(s, s));
-    EXPECT_EQ(strcmp(s, "bcde"), 0);
-}
-
-TEST(ffx, str)
-{
-    char s[5];
-    bigint_t n;
-
-    bigint_init(&n);
-    bigint_set_str(&n, "559", 10);
-
-    EXPECT_EQ(ffx_str(s, 5, 4, 12, &n), 0);
-    EXPECT_EQ(strcmp(s, "03a7"), 0);
-
-    bigint_deinit(&n);
-}
-
 TEST(ffx, u8_to_u32)
 {
     setlocale(LC_ALL, "C.UTF-8");
@@ -79,4 +47,337 @@ TEST(ffx, u8_to_u32)
 
 
 
-}
\ No newline at end of file
+}
+
+TEST(ffx, prf_aesni)
+{
+    const uint8_t K[] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+        0xef, 0x43, 0x59, 0xd8, 0xd5, 0x80, 0xaa, 0x4f,
+        0x7f, 0x03, 0x6d, 0x6f, 0x04, 0xfc, 0x6a, 0x94,
+    };
+
+    uint8_t src[64];
+
+    if (!ffx_aesni_supported()) {
+        GTEST_SKIP() << "aes-ni not supported";
+    }
+
+    for (unsigned int i = 0; i < sizeof(src); i++) {
+        src[i] = i * 7;
+    }
+
+    for (size_t k = 16; k <= 32; k += 8) {
+        struct ffx_ctx * ctx;
+        struct ffx_ws * ws;
+
+        ASSERT_EQ(ffx_ctx_create((void **)&ctx,
+                                 sizeof(*ctx), 0,
+                                 K, k,
+                                 NULL, 0,
+                                 SIZE_MAX,
+                                 0, 0,
+                                 10), 0);
+        ASSERT_NE(ctx->aesni, 0);
+
+        ws = ffx_ws_acquire(ctx);
+        ASSERT_NE(ws, nullptr);
+
+        for (size_t len = 16; len <= sizeof(src); len += 16) {
+            uint8_t evp[16], ni[16];
+
+            ctx->aesni = 0;
+            EXPECT_EQ(ffx_prf(ctx, ws, evp, src, len), 0);
+            ctx->aesni = 1;
+            EXPECT_EQ(ffx_prf(ctx, ws, ni, src, len), 0);
+
+            EXPECT_EQ(memcmp(evp, ni, sizeof(ni)), 0)
+                << "key length " << k << ", data length " << len;
+        }
+
+        ffx_ws_release(ctx, ws);
+        ffx_ctx_destroy(ctx, 0);
+    }
+}
+
+TEST(ffx, prf_iv)
+{
+    const uint8_t K[] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+
+    struct ffx_ctx * ctx;
+    struct ffx_ws * ws;
+    uint8_t src[80];
+
+    for (unsigned int i = 0; i < sizeof(src); i++) {
+        src[i] = i * 13;
+    }
+
+    ASSERT_EQ(ffx_ctx_create((void **)&ctx,
+                             sizeof(*ctx), 0,
+                             K, sizeof(K),
+                             NULL, 0,
+                             SIZE_MAX,
+                             0, 0,
+                             10), 0);
+    ws = ffx_ws_acquire(ctx);
+    ASSERT_NE(ws, nullptr);
+
+    /*
+     * encrypting a prefix and then continuing the chain
+     * must produce the same result as encrypting it all
+     */
+    for (int aesni = ctx->aesni; aesni >= 0; aesni--) {
+        ctx->aesni = aesni;
+
+        for (size_t k = 0; k <= sizeof(src); k += 16) {
+            uint8_t all[16], C[16], part[16];
+
+            EXPECT_EQ(ffx_prf(ctx, ws, all, src, sizeof(src)), 0);
+            EXPECT_EQ(ffx_prf(ctx, ws, C, src, k), 0);
+            EXPECT_EQ(
+                ffx_prf_iv(ctx, ws, part, C, src + k, sizeof(src) - k), 0);
+
+            EXPECT_EQ(memcmp(all, part, sizeof(part)), 0)
+                << "aesni " << aesni << ", prefix length " << k;
+        }
+    }
+
+    ffx_ws_release(ctx, ws);
+    ffx_ctx_destroy(ctx, 0);
+}
+
+TEST(ffx, prf_xn)
+{
+    const uint8_t K[] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+
+    struct ffx_ctx * ctx;
+    struct ffx_ws * ws;
+
+    uint8_t src[FFX_AES_LANES][64], iv[FFX_AES_LANES][16];
+    uint8_t dst[FFX_AES_LANES][16];
+    uint8_t * pdst[FFX_AES_LANES];
+    const uint8_t * psrc[FFX_AES_LANES], * piv[FFX_AES_LANES];
+
+    for (unsigned int k = 0; k < FFX_AES_LANES; k++) {
+        for (unsigned int i = 0; i < sizeof(src[k]); i++) {
+            src[k][i] = i * 13 + k;
+        }
+        for (unsigned int i = 0; i < sizeof(iv[k]); i++) {
+            iv[k][i] = i * 7 + k;
+        }
+
+        pdst[k] = dst[k];
+        psrc[k] = src[k];
+        piv[k] = iv[k];
+    }
+
+    ASSERT_EQ(ffx_ctx_create((void **)&ctx,
+                             sizeof(*ctx), 0,
+                             K, sizeof(K),
+                             NULL, 0,
+                             SIZE_MAX,
+                             0, 0,
+                             10), 0);
+    ws = ffx_ws_acquire(ctx);
+    ASSERT_NE(ws, nullptr);
+
+    EXPECT_EQ(ffx_prf_xn(ctx, ws, FFX_AES_LANES + 1,
+                         pdst, piv, psrc, 16), -EINVAL);
+    EXPECT_EQ(ffx_prf_xn(ctx, ws, 1, pdst, piv, psrc, 15), -EINVAL);
+
+    /*
+     * every chain, however many are processed together and
+     * whichever implementation does it, is the same as when
+     * it is processed by itself
+     */
+    for (int impl = 2; impl >= 0; impl--) {
+        const int aesni = ctx->aesni, vaes = ctx->vaes;
+
+        if (impl < 2) {
+            ctx->vaes = 0;
+        }
+        if (impl < 1) {
+            ctx->aesni = 0;
+        }
+
+        for (unsigned int n = 1; n <= FFX_AES_LANES; n++) {
+            for (size_t len = 16; len <= sizeof(src[0]); len += 16) {
+                memset(dst, 0, sizeof(dst));
+                EXPECT_EQ(ffx_prf_xn(ctx, ws, n, pdst, piv, psrc, len), 0);
+
+                for (unsigned int k = 0; k < FFX_AES_LANES; k++) {
+                    uint8_t exp[16];
+
+                    if (k >= n) {
+                        memset(exp, 0, sizeof(exp));
+                    } else {
+                        EXPECT_EQ(ffx_prf_iv(ctx, ws, exp, iv[k],
+                                             src[k], len), 0);
+                    }
+
+                    EXPECT_EQ(memcmp(dst[k], exp, sizeof(exp)), 0)
+                        << "aesni " << ctx->aesni << ", vaes " << ctx->vaes
+                        << ", " << n << " chains, chain " << k
+                        << ", length " << len;
+                }
+            }
+        }
+
+        ctx->aesni = aesni;
+        ctx->vaes = vaes;
+    }
+
+    ffx_ws_release(ctx, ws);
+    ffx_ctx_destroy(ctx, 0);
+}
+
+/*
+ * the vectorized ff1 rounds produce the same results as the
+ * arithmetic done one text at a time, including at the limits
+ * of the prf output and of the moduli
+ */
+TEST(ffx, round_xn)
+{
+    const uint64_t moduli[] = {
+        2, 10, 100000000, 2176782336 /* 36**6 */,
+        (uint64_t)1 << 31, ((uint64_t)1 << 32) - 1,
+    };
+
+    uint8_t R[FFX_AES_LANES][16], W[FFX_AES_LANES][8];
+    const uint8_t * pR[FFX_AES_LANES];
+    uint8_t * pW[FFX_AES_LANES];
+
+    uint32_t seed = 1;
+
+    for (unsigned int k = 0; k < FFX_AES_LANES; k++) {
+        pR[k] = R[k];
+        pW[k] = W[k];
+    }
+
+    for (int impl = 1; impl >= 0; impl--) {
+        if (impl ? !ffx_round_avx512_supported()
+            : !ffx_round_avx2_supported()) {
+            continue;
+        }
+
+        for (const uint64_t m : moduli) {
+            for (unsigned int d = 4; d <= 16; d += 4) {
+                for (unsigned int n = 1; n <= FFX_AES_LANES; n++) {
+                    const int add = n % 2;
+                    const unsigned int b = 1 + n % 4;
+
+                    uint64_t A[FFX_AES_LANES], B[FFX_AES_LANES];
+                    uint64_t eA[FFX_AES_LANES], eB[FFX_AES_LANES];
+
+                    for (unsigned int k = 0; k < FFX_AES_LANES; k++) {
+                        for (unsigned int j = 0; j < sizeof(R[k]); j++) {
+                            seed = seed * 1103515245 + 12345;
+                            /* some all-ones outputs, too */
+                            R[k][j] = (k % 5 == 0) ? 0xff : seed >> 16;
+                        }
+
+                        seed = seed * 1103515245 + 12345;
+                        A[k] = eA[k] = (k % 7 == 0) ? m - 1 : seed % m;
+                        seed = seed * 1103515245 + 12345;
+                        B[k] = eB[k] = seed % m;
+                    }
+
+                    memset(W, 0xa5, sizeof(W));
+
+                    if (impl) {
+                        ffx_round_avx512_xn(n, A, B, pR, d, m, add, pW, 2, b);
+                    } else {
+                        ffx_round_avx2_xn(n, A, B, pR, d, m, add, pW, 2, b);
+                    }
+
+                    for (unsigned int k = 0; k < n; k++) {
+                        unsigned __int128 z = 0;
+                        uint64_t y, c;
+
+                        for (unsigned int j = 0; j < d; j++) {
+                            z = (z << 8) | R[k][j];
+                        }
+                        y = z % m;
+                        c = add ? (eA[k] + y) % m : (eA[k] + m - y) % m;
+
+                        EXPECT_EQ(A[k], eB[k]);
+                        EXPECT_EQ(B[k], c)
+                            << "avx512 " << impl << ", modulus " << m
+                            << ", " << d << " bytes, " << n
+                            << " texts, text " << k;
+
+                        for (unsigned int j = 0; j < sizeof(W[k]); j++) {
+                            const uint8_t e = (j >= 2 && j < 2 + b)
+                                ? c >> (8 * (1 + b - j)) : 0xa5;
+
+                            EXPECT_EQ(W[k][j], e) << k << ", byte " << j;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST(ffx, len)
+{
+    const uint8_t K[16] = { 0 };
+
+    const unsigned int radixes[] = { 2, 3, 10, 16, 36, 62, 64, 255 };
+
+    for (unsigned int i = 0; i < sizeof(radixes) / sizeof(*radixes); i++) {
+        struct ffx_ctx * ctx;
+
+        ASSERT_EQ(ffx_ctx_create((void **)&ctx,
+                                 sizeof(*ctx), 0,
+                                 K, sizeof(K),
+                                 NULL, 0,
+                                 SIZE_MAX,
+                                 0, 0,
+                                 radixes[i]), 0);
+
+        /* more lengths than the cache can hold */
+        for (unsigned int n = 2; n < 2 + 2 * FFX_LEN_CACHE; n++) {
+            const struct ffx_len * len;
+            struct ffx_len tmp;
+            bigint_t m;
+
+            len = ffx_len_acquire(ctx, n, &tmp);
+            ASSERT_NE(len, nullptr);
+
+            EXPECT_EQ(len->n, n);
+            EXPECT_EQ(len->u, n / 2);
+            EXPECT_EQ(len->v, n - n / 2);
+            EXPECT_EQ(len->b,
+                      ((unsigned int)ceil(log2(radixes[i]) * len->v) + 7) / 8)
+                << "radix " << radixes[i] << ", length " << n;
+            EXPECT_EQ(len->d, 4 * ((len->b + 3) / 4) + 4);
+
+            bigint_init(&m);
+            bigint_set_ui(&m, radixes[i]);
+            bigint_pow_ui(&m, &m, len->u);
+            EXPECT_EQ(bigint_cmp(&m, &len->mU), 0);
+            bigint_mul_ui(&m, &m, len->u != len->v ? radixes[i] : 1);
+            EXPECT_EQ(bigint_cmp(&m, &len->mV), 0);
+            bigint_deinit(&m);
+
+            /* cached entries are returned as-is the second time */
+            if (len != &tmp) {
+                EXPECT_EQ(ffx_len_acquire(ctx, n, &tmp), len);
+            }
+
+            ffx_len_release(len, &tmp);
+        }
+
+        EXPECT_EQ(ctx->lens.cnt, FFX_LEN_CACHE);
+
+        ffx_ctx_destroy(ctx, 0);
+    }
+}
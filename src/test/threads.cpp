@@ -0,0 +1,377 @@
+#include <gtest/gtest.h>
+#include <ubiq/fpe/ff1.h>
+#include <ubiq/fpe/ff3_1.h>
+#include <ubiq/fpe/pool.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * the tests in this file share a single context between several
+ * threads and check that every thread gets the same results as
+ * a single thread using the context by itself
+ */
+
+static const unsigned int NTHREADS = 8;
+
+/*
+ * texts of more lengths than the context caches, so that the
+ * threads race to fill the cache and then some of them fall back
+ * to computing the parameters themselves. the longer texts are
+ * too long for native integers
+ */
+static
+std::vector<std::string> thread_texts(const unsigned int minlen,
+                                      const unsigned int maxlen)
+{
+    std::vector<std::string> txts;
+
+    for (unsigned int len = minlen; len <= maxlen; len++) {
+        std::string s;
+
+        for (unsigned int i = 0; i < len; i++) {
+            s += '0' + (i * 7 + len) % 10;
+        }
+        txts.push_back(s);
+    }
+
+    return txts;
+}
+
+/*
+ * run @fn on @n threads at once and return the elapsed time
+ */
+template <typename F>
+static
+std::chrono::duration<double> thread_run(const unsigned int n, F fn)
+{
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> thr;
+
+    for (unsigned int i = 0; i < n; i++) {
+        thr.emplace_back(fn, i);
+    }
+    for (auto & t : thr) {
+        t.join();
+    }
+
+    return std::chrono::steady_clock::now() - start;
+}
+
+TEST(threads, ff1)
+{
+    const uint8_t K[] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+    const uint8_t T[] = { 0x37, 0x37, 0x37, 0x37, 0x70, 0x71, 0x72 };
+
+    const std::vector<std::string> PT = thread_texts(6, 60);
+    std::vector<std::string> CT;
+
+    std::atomic<unsigned int> failures(0);
+    struct ff1_ctx * ctx;
+
+    ASSERT_EQ(ff1_ctx_create(&ctx, K, sizeof(K), T, sizeof(T), 0, 0, 10), 0);
+
+    /* the expected results, from a context that's never been used */
+    {
+        struct ff1_ctx * ref;
+
+        ASSERT_EQ(
+            ff1_ctx_create(&ref, K, sizeof(K), T, sizeof(T), 0, 0, 10), 0);
+        for (const auto & pt : PT) {
+            std::string ct(pt.size(), '\0');
+
+            ASSERT_EQ(ff1_encrypt(ref, &ct[0], pt.c_str(), NULL, 0), 0);
+            CT.push_back(ct);
+        }
+        ff1_ctx_destroy(ref);
+    }
+
+    thread_run(NTHREADS, [&](const unsigned int id) {
+        for (unsigned int j = 0; j < 4; j++) {
+            for (size_t i = 0; i < PT.size(); i++) {
+                /* each thread starts at a different length */
+                const size_t k = (i + id * 7) % PT.size();
+                std::string ct(PT[k].size(), '\0');
+                std::string pt(PT[k].size(), '\0');
+
+                if (ff1_encrypt(ctx, &ct[0], PT[k].c_str(), NULL, 0) ||
+                    ct != CT[k] ||
+                    ff1_decrypt(ctx, &pt[0], ct.c_str(), NULL, 0) ||
+                    pt != PT[k]) {
+                    failures++;
+                }
+            }
+        }
+    });
+
+    EXPECT_EQ(failures, 0u);
+
+    ff1_ctx_destroy(ctx);
+}
+
+TEST(threads, ff1_prepared)
+{
+    const uint8_t K[] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+    const uint8_t T[] = { 0x37, 0x37, 0x37, 0x37, 0x70, 0x71, 0x72 };
+
+    const std::vector<std::string> PT = thread_texts(6, 30);
+    std::vector<std::string> CT;
+
+    std::atomic<unsigned int> failures(0);
+    struct ff1_ctx * ctx;
+
+    ASSERT_EQ(ff1_ctx_create(&ctx, K, sizeof(K), NULL, 0, 0, 0, 10), 0);
+
+    for (const auto & pt : PT) {
+        std::string ct(pt.size(), '\0');
+
+        ASSERT_EQ(
+            ff1_encrypt(ctx, &ct[0], pt.c_str(), T, sizeof(T)), 0);
+        CT.push_back(ct);
+    }
+
+    /* the context is shared, but each thread prepares its own tweak */
+    thread_run(NTHREADS, [&](const unsigned int) {
+        struct ff1_tweak * twk;
+
+        if (ff1_tweak_prepare(ctx, T, sizeof(T), &twk)) {
+            failures++;
+            return;
+        }
+
+        for (size_t i = 0; i < PT.size(); i++) {
+            std::string ct(PT[i].size(), '\0');
+            std::string pt(PT[i].size(), '\0');
+
+            if (ff1_encrypt_prepared(ctx, &ct[0], PT[i].c_str(), twk) ||
+                ct != CT[i] ||
+                ff1_decrypt_prepared(ctx, &pt[0], ct.c_str(), twk) ||
+                pt != PT[i]) {
+                failures++;
+            }
+        }
+
+        ff1_tweak_destroy(twk);
+    });
+
+    EXPECT_EQ(failures, 0u);
+
+    ff1_ctx_destroy(ctx);
+}
+
+TEST(threads, ff3_1)
+{
+    const uint8_t K[] = {
+        0xef, 0x43, 0x59, 0xd8, 0xd5, 0x80, 0xaa, 0x4f,
+        0x7f, 0x03, 0x6d, 0x6f, 0x04, 0xfc, 0x6a, 0x94,
+    };
+    const uint8_t T[7] = { 0 };
+
+    const std::vector<std::string> PT = thread_texts(6, 56);
+    std::vector<std::string> CT;
+
+    std::atomic<unsigned int> failures(0);
+    struct ff3_1_ctx * ctx;
+
+    ASSERT_EQ(ff3_1_ctx_create(&ctx, K, sizeof(K), T, 10), 0);
+
+    {
+        struct ff3_1_ctx * ref;
+
+        ASSERT_EQ(ff3_1_ctx_create(&ref, K, sizeof(K), T, 10), 0);
+        for (const auto & pt : PT) {
+            std::string ct(pt.size(), '\0');
+
+            ASSERT_EQ(ff3_1_encrypt(ref, &ct[0], pt.c_str(), NULL), 0);
+            CT.push_back(ct);
+        }
+        ff3_1_ctx_destroy(ref);
+    }
+
+    thread_run(NTHREADS, [&](const unsigned int id) {
+        for (unsigned int j = 0; j < 4; j++) {
+            for (size_t i = 0; i < PT.size(); i++) {
+                const size_t k = (i + id * 7) % PT.size();
+                std::string ct(PT[k].size(), '\0');
+                std::string pt(PT[k].size(), '\0');
+
+                if (ff3_1_encrypt(ctx, &ct[0], PT[k].c_str(), NULL) ||
+                    ct != CT[k] ||
+                    ff3_1_decrypt(ctx, &pt[0], ct.c_str(), NULL) ||
+                    pt != PT[k]) {
+                    failures++;
+                }
+            }
+        }
+    });
+
+    EXPECT_EQ(failures, 0u);
+
+    ff3_1_ctx_destroy(ctx);
+}
+
+/*
+ * the same amount of work per thread, with 1 thread and then with
+ * as many as there are processors. with the context shared, the
+ * elapsed time should stay about the same. the timing depends on
+ * the machine, so it's reported rather than checked. this is a
+ * benchmark rather than a test, so it only runs when asked for, with
+ * --gtest_also_run_disabled_tests
+ */
+TEST(threads, DISABLED_scaling)
+{
+    const uint8_t K[] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+    const char PT[] = "0123456789012345";
+
+    const unsigned int ncpu =
+        std::max(1u, std::thread::hardware_concurrency());
+
+    std::atomic<unsigned int> failures(0);
+    struct ff1_ctx * ctx;
+
+    ASSERT_EQ(ff1_ctx_create(&ctx, K, sizeof(K), NULL, 0, 0, 0, 10), 0);
+
+    const auto work = [&](const unsigned int) {
+        char CT[sizeof(PT)];
+
+        for (unsigned int i = 0; i < 20000; i++) {
+            if (ff1_encrypt(ctx, CT, PT, NULL, 0)) {
+                failures++;
+            }
+        }
+    };
+
+    const auto t1 = thread_run(1, work);
+    const auto tn = thread_run(ncpu, work);
+
+    EXPECT_EQ(failures, 0u);
+
+    RecordProperty("threads", ncpu);
+    RecordProperty("speedup", std::to_string(ncpu * t1 / tn));
+    std::cout << "[          ] " << ncpu << " threads: "
+              << ncpu * t1 / tn << "x the throughput of 1" << std::endl;
+
+    ff1_ctx_destroy(ctx);
+}
+
+TEST(threads, pool)
+{
+    const uint8_t K[] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+
+    const std::vector<std::string> PT = thread_texts(6, 40);
+    std::vector<std::string> CT;
+
+    std::atomic<unsigned int> failures(0);
+    struct ff1_ctx * ctx;
+    struct fpe_pool * pool;
+
+    EXPECT_EQ(fpe_pool_create(&pool, 2, ~0u), -EINVAL);
+
+    ASSERT_EQ(ff1_ctx_create(&ctx, K, sizeof(K), NULL, 0, 0, 0, 10), 0);
+    for (const auto & pt : PT) {
+        std::string ct(pt.size(), '\0');
+
+        ASSERT_EQ(ff1_encrypt(ctx, &ct[0], pt.c_str(), NULL, 0), 0);
+        CT.push_back(ct);
+    }
+
+    /*
+     * one thread per processor, pinned, and more threads than there
+     * are records. several threads share the pool, and each batch
+     * must be run to completion, by itself
+     */
+#if defined(__linux__)
+    ASSERT_EQ(fpe_pool_create(&pool, 0, FPE_POOL_PIN), 0);
+    fpe_pool_destroy(pool);
+#endif
+    ASSERT_EQ(fpe_pool_create(&pool, PT.size() + 3, 0), 0);
+
+    thread_run(4, [&](const unsigned int id) {
+        for (size_t n = 0; n <= PT.size(); n += 1 + id) {
+            std::vector<std::string> out(n);
+            std::vector<const char *> pPT(n);
+            std::vector<char *> pout(n);
+
+            for (size_t i = 0; i < n; i++) {
+                out[i].resize(PT[i].size());
+                pPT[i] = PT[i].c_str();
+                pout[i] = &out[i][0];
+            }
+
+            if (ff1_encrypt_batch_mt(ctx, pool, pout.data(), pPT.data(),
+                                     NULL, NULL, NULL, n, NULL)) {
+                failures++;
+            }
+            for (size_t i = 0; i < n; i++) {
+                if (out[i] != CT[i]) {
+                    failures++;
+                }
+            }
+        }
+    });
+
+    EXPECT_EQ(failures, 0u);
+
+    fpe_pool_destroy(pool);
+    ff1_ctx_destroy(ctx);
+}
+
+/* as with the scaling benchmark above, the speedup is only reported */
+TEST(threads, DISABLED_pool_scaling)
+{
+    const uint8_t K[] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+    const size_t cnt = 100000;
+
+    std::vector<std::string> PT(cnt, "0123456789012345"), CT(PT);
+    std::vector<const char *> pPT(cnt);
+    std::vector<char *> pCT(cnt);
+
+    struct ff1_ctx * ctx;
+    struct fpe_pool * pool;
+    int res;
+
+    for (size_t i = 0; i < cnt; i++) {
+        pPT[i] = PT[i].c_str();
+        pCT[i] = &CT[i][0];
+    }
+
+    ASSERT_EQ(ff1_ctx_create(&ctx, K, sizeof(K), NULL, 0, 0, 0, 10), 0);
+    ASSERT_EQ(fpe_pool_create(&pool, 0, 0), 0);
+
+    const auto t1 = thread_run(1, [&](const unsigned int) {
+        res = ff1_encrypt_batch(ctx, pCT.data(), pPT.data(), NULL,
+                                NULL, NULL, cnt, NULL);
+    });
+    EXPECT_EQ(res, 0);
+
+    const auto tn = thread_run(1, [&](const unsigned int) {
+        res = ff1_encrypt_batch_mt(ctx, pool, pCT.data(), pPT.data(), NULL,
+                                   NULL, NULL, cnt, NULL);
+    });
+    EXPECT_EQ(res, 0);
+
+    std::cout << "[          ] pool of "
+              << std::thread::hardware_concurrency() << " threads: "
+              << t1 / tn << "x the throughput of 1" << std::endl;
+
+    fpe_pool_destroy(pool);
+    ff1_ctx_destroy(ctx);
+}